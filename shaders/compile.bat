@@ -1,3 +1,4 @@
-"C:/Vulkan SDK/Bin/glslc.exe" shader.vert -o vert.spv
-"C:/Vulkan SDK/Bin/glslc.exe" shader.frag -o frag.spv
+"%VULKAN_SDK%/Bin/glslc.exe" shader.vert -o vert.spv
+"%VULKAN_SDK%/Bin/glslc.exe" shader.frag -o frag.spv
+"%VULKAN_SDK%/Bin/glslc.exe" animate.comp -o animate.spv
 pause
\ No newline at end of file
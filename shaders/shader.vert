@@ -1,20 +1,16 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+// Camera transform, reversed-Z. The mesh lies in the z = 0 plane.
+layout(push_constant) uniform Camera {
+    mat4 viewProjection;
+} camera;
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    gl_Position = camera.viewProjection * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColor;
+}
@@ -0,0 +1,244 @@
+#include "async_compute.h"
+
+#include <stdexcept>
+
+
+void ComputePipeline::Init(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule shader, uint32_t storageBufferCount,
+	uint32_t pushConstantSize, uint32_t maxDescriptorSets)
+{
+	this->device = device;
+	this->pipelineCache = pipelineCache;
+	this->storageBufferCount = storageBufferCount;
+	this->pushConstantSize = pushConstantSize;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(storageBufferCount);
+	for (uint32_t i = 0; i < storageBufferCount; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+	setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutInfo.bindingCount = storageBufferCount;
+	setLayoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute descriptor set layout");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = pushConstantSize;
+
+	VkPipelineLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &setLayout;
+	layoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+	layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline layout");
+	}
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = storageBufferCount * maxDescriptorSets;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = maxDescriptorSets;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute descriptor pool");
+	}
+
+	SetShader(shader);
+}
+
+
+void ComputePipeline::Destroy()
+{
+	// Descriptor sets are freed together with the pool.
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	vkDestroyPipeline(device, pipeline, nullptr);
+	vkDestroyPipelineLayout(device, layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+
+	descriptorPool = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+	layout = VK_NULL_HANDLE;
+	setLayout = VK_NULL_HANDLE;
+}
+
+
+void ComputePipeline::SetShader(VkShaderModule shader)
+{
+	// A compute pipeline is a single stage. It's cheap to compile, so it's created right away instead of
+	// going through the pipeline library, but still with the pipeline cache.
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shader;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = layout;
+
+	VkPipeline newPipeline = VK_NULL_HANDLE;
+	if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline");
+	}
+
+	vkDestroyPipeline(device, pipeline, nullptr);
+	pipeline = newPipeline;
+}
+
+
+VkDescriptorSet ComputePipeline::CreateDescriptorSet(const std::vector<VkDescriptorBufferInfo>& storageBuffers)
+{
+	if (storageBuffers.size() != storageBufferCount) {
+		throw std::runtime_error("Compute descriptor set needs one buffer per binding");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &setLayout;
+
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate compute descriptor set");
+	}
+
+	std::vector<VkWriteDescriptorSet> writes(storageBufferCount);
+	for (uint32_t i = 0; i < storageBufferCount; ++i) {
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = descriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &storageBuffers[i];
+	}
+	vkUpdateDescriptorSets(device, storageBufferCount, writes.data(), 0, nullptr);
+
+	return descriptorSet;
+}
+
+
+void ComputePipeline::CmdDispatch(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, const void* pushConstants,
+	uint32_t itemCount, uint32_t localSize) const
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &descriptorSet, 0, nullptr);
+
+	if (pushConstantSize > 0) {
+		vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, pushConstants);
+	}
+
+	uint32_t groupCount = (itemCount + localSize - 1) / localSize;
+	if (groupCount > 0) {
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	}
+}
+
+
+void ComputeQueue::Init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t graphicsFamily, uint32_t slotCount)
+{
+	this->device = device;
+	this->queue = queue;
+	this->queueFamily = queueFamily;
+	this->graphicsFamily = graphicsFamily;
+
+	slots.resize(slotCount);
+	for (Slot& slot : slots) {
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &slot.pool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create compute command pool");
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = slot.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, &slot.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate compute command buffer");
+		}
+	}
+
+	timeline.Init(device);
+}
+
+
+void ComputeQueue::Destroy()
+{
+	// Waits for the last submission.
+	timeline.Destroy();
+
+	// Command buffers are freed together with their pool.
+	for (Slot& slot : slots) {
+		vkDestroyCommandPool(device, slot.pool, nullptr);
+	}
+	slots.clear();
+}
+
+
+VkCommandBuffer ComputeQueue::BeginFrame(uint32_t slot)
+{
+	if (vkResetCommandPool(device, slots[slot].pool, 0) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to reset compute command pool");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkCommandBuffer commandBuffer = slots[slot].commandBuffer;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin compute command buffer");
+	}
+
+	// The slot's previous compute work has finished by now: rendering waited for it before the frame pacer let the
+	// slot be reused, or its frame was skipped and the swapchain recreation after it waited for the device to be idle.
+	// Submissions on one queue may still overlap in general, so this frame's writes are ordered after earlier ones.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &barrier, 0, nullptr, 0, nullptr);
+
+	return commandBuffer;
+}
+
+
+TimelinePoint ComputeQueue::Submit(VkCommandBuffer commandBuffer)
+{
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record compute command buffer");
+	}
+
+	TimelinePoint signal = timeline.GetNextPoint();
+
+	SubmitBatch submit;
+	submit.AddCommandBuffer(commandBuffer);
+	submit.Signal(signal);
+
+	if (submit.Submit(queue) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit compute command buffer");
+	}
+
+	timeline.Advance();
+	return signal;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "queue_timeline.h"
+
+
+// A compute pipeline whose only descriptor set holds storage buffers, at bindings 0 to storageBufferCount - 1,
+// plus an optional push constant block. That covers simulation, culling and post-processing kernels that read and
+// write buffers. The descriptor sets are allocated once from the pipeline's own pool and rebound every dispatch.
+class ComputePipeline
+{
+public:
+	void Init(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule shader, uint32_t storageBufferCount,
+		uint32_t pushConstantSize, uint32_t maxDescriptorSets);
+	void Destroy();
+
+	// Replaces the pipeline with one made from another shader with the same interface, for hot reload.
+	// The old pipeline must not be in use by the GPU anymore.
+	void SetShader(VkShaderModule shader);
+
+	// One buffer per binding. Sets live until Destroy().
+	VkDescriptorSet CreateDescriptorSet(const std::vector<VkDescriptorBufferInfo>& storageBuffers);
+
+	// Binds the pipeline and the set, pushes pushConstantSize bytes and dispatches enough workgroups of localSize
+	// invocations to cover itemCount items. The shader must skip invocations beyond itemCount.
+	void CmdDispatch(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, const void* pushConstants,
+		uint32_t itemCount, uint32_t localSize) const;
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+	uint32_t storageBufferCount = 0;
+	uint32_t pushConstantSize = 0;
+};
+
+
+// Submits compute work once per frame on a queue of its own, so it runs concurrently with rasterization.
+// A family with VK_QUEUE_COMPUTE_BIT but without graphics is usually served by the asynchronous compute engines,
+// which fill the shader cores the rasterizer leaves idle.
+//
+// Every submission signals the next value of a timeline semaphore. The graphics submission of the same frame waits
+// for it at the stage that consumes the results, everything before that stage overlaps with the compute work.
+// Without a compute family the graphics queue is passed in and the work simply runs before the frame.
+//
+// Command buffers come from one transient pool per frame slot, reset as a whole like FrameCommandPools. A slot is only
+// reused once the frame pacer has waited for the slot's last frame, and the graphics work of that frame waited for
+// the compute work of the slot, so nothing in the pool is in use anymore.
+//
+// Not thread safe, used from the main thread only.
+class ComputeQueue
+{
+public:
+	// queue may be the graphics queue if there is no compute family or async compute is off.
+	void Init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t graphicsFamily, uint32_t slotCount);
+
+	// Waits for all submitted work.
+	void Destroy();
+
+	// Resets the pool of the slot and begins its command buffer for one-time submission.
+	VkCommandBuffer BeginFrame(uint32_t slot);
+
+	// Ends and submits the command buffer. Returns the timeline point reached when it's complete.
+	TimelinePoint Submit(VkCommandBuffer commandBuffer);
+
+	uint32_t GetQueueFamily() const { return queueFamily; }
+	bool IsAsync() const { return queueFamily != graphicsFamily; }
+
+	uint64_t GetSubmitCount() const { return timeline.GetLastSubmittedValue(); }
+
+private:
+	struct Slot
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t queueFamily = 0;
+	uint32_t graphicsFamily = 0;
+
+	std::vector<Slot> slots;
+
+	QueueTimeline timeline;
+};
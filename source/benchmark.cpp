@@ -0,0 +1,171 @@
+#include "benchmark.h"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "json.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+uint64_t GetPeakProcessMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+	// Kilobytes on Linux.
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+
+void BenchmarkRecorder::Begin(const FrameStatsRing& ring)
+{
+	isMeasuring = true;
+	copiedFrameCount = ring.GetFrameCount();
+	samples.clear();
+	startTime = std::chrono::steady_clock::now();
+	endTime = startTime;
+}
+
+
+void BenchmarkRecorder::Update(const FrameStatsRing& ring)
+{
+	if (isMeasuring && ring.GetFrameCount() - copiedFrameCount >= FrameStatsRing::CAPACITY / 2) {
+		CopyNewSamples(ring);
+	}
+}
+
+
+void BenchmarkRecorder::End(const FrameStatsRing& ring)
+{
+	if (!isMeasuring) {
+		return;
+	}
+
+	endTime = std::chrono::steady_clock::now();
+	CopyNewSamples(ring);
+	isMeasuring = false;
+}
+
+
+double BenchmarkRecorder::GetSeconds() const
+{
+	return std::chrono::duration<double>(endTime - startTime).count();
+}
+
+
+void BenchmarkRecorder::CopyNewSamples(const FrameStatsRing& ring)
+{
+	// Only pushed on this thread, so nothing is overwritten while copying.
+	uint64_t frameCount = ring.GetFrameCount();
+	std::vector<FrameSample> newSamples = ring.GetRecent(static_cast<uint32_t>(frameCount - copiedFrameCount));
+
+	samples.insert(samples.end(), newSamples.begin(), newSamples.end());
+	copiedFrameCount = frameCount;
+}
+
+
+void WriteBenchmarkResults(const std::string& path, const BenchmarkSettings& settings, const BenchmarkResults& results)
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+
+	double framesPerSecond = results.seconds > 0.0 ? results.frameCount / results.seconds : 0.0;
+	double drawsPerSecond = framesPerSecond * settings.drawCount;
+	double trianglesPerSecond = drawsPerSecond * settings.trianglesPerDraw;
+
+	file << std::fixed << std::setprecision(3);
+
+	file << "{\n  \"settings\": {\n    \"device\": ";
+	WriteJsonString(file, settings.deviceName);
+	file << ",\n    \"deviceUuid\": ";
+	WriteJsonString(file, settings.deviceUuid);
+	file << ",\n    \"headless\": " << (settings.headless ? "true" : "false")
+		<< ",\n    \"warmupFrames\": " << settings.warmupFrames
+		<< ",\n    \"measuredFrames\": " << settings.measuredFrames
+		<< ",\n    \"framesInFlight\": " << settings.framesInFlight
+		<< ",\n    \"presentPolicy\": ";
+	WriteJsonString(file, settings.presentPolicy);
+	file << ",\n    \"presentMode\": ";
+	WriteJsonString(file, settings.presentMode);
+	file << ",\n    \"swapchainImages\": " << settings.swapchainImageCount
+		<< ",\n    \"draws\": " << settings.drawCount
+		<< ",\n    \"trianglesPerDraw\": " << settings.trianglesPerDraw
+		<< ",\n    \"recordThreads\": " << settings.recordThreadCount
+		<< ",\n    \"vertexStreams\": " << settings.vertexStreamCount
+		<< ",\n    \"indexBits\": " << settings.indexSize * 8
+		<< ",\n    \"msaaSamples\": " << settings.sampleCount
+		<< ",\n    \"compute\": ";
+	WriteJsonString(file, settings.computeMode);
+	file << "\n  },\n";
+
+	file << "  \"completed\": " << (results.completed ? "true" : "false") << ",\n";
+
+	file << "  \"throughput\": {\n    \"seconds\": " << results.seconds
+		<< ",\n    \"frames\": " << results.frameCount
+		<< ",\n    \"framesPerSecond\": " << framesPerSecond
+		<< ",\n    \"drawsPerSecond\": " << drawsPerSecond
+		<< ",\n    \"trianglesPerSecond\": " << trianglesPerSecond
+		<< "\n  },\n";
+
+	// CPU durations of a frame and its phases, in milliseconds.
+	file << "  \"latencyMs\": {";
+	for (uint32_t i = 0; i < FRAME_STAT_COUNT; ++i) {
+		const FrameStatPercentiles& stat = results.frameStats.stats[i];
+		file << (i == 0 ? "\n" : ",\n") << "    ";
+		WriteJsonString(file, GetFrameStatName(static_cast<FrameStat>(i)));
+		file << ": { \"p50\": " << stat.p50 << ", \"p95\": " << stat.p95 << ", \"p99\": " << stat.p99 << ", \"max\": " << stat.max << " }";
+	}
+	file << "\n  },\n";
+
+	file << "  \"inputToPresentMs\": ";
+	if (results.inputToPresentSampleCount > 0) {
+		const FrameStatPercentiles& latency = results.inputToPresentMs;
+		file << "{ \"frames\": " << results.inputToPresentSampleCount
+			<< ", \"until\": " << (results.isInputToPresentDisplayed ? "\"presented\"" : "\"queuePresent\"")
+			<< ", \"p50\": " << latency.p50 << ", \"p95\": " << latency.p95 << ", \"p99\": " << latency.p99 << ", \"max\": " << latency.max << " }";
+	}
+	else {
+		file << "null";
+	}
+	file << ",\n";
+
+	file << "  \"hitches\": " << results.frameStats.hitchCount << ",\n";
+
+	file << "  \"gpuFrameMs\": ";
+	if (results.gpuFrameMs >= 0.0) {
+		file << results.gpuFrameMs;
+	}
+	else {
+		file << "null";
+	}
+	file << ",\n";
+
+	file << "  \"memory\": {\n    \"peakGpuBlockBytes\": " << results.peakGpuBlockBytes
+		<< ",\n    \"peakGpuUsedBytes\": " << results.peakGpuUsedBytes
+		<< ",\n    \"peakProcessBytes\": " << results.peakProcessBytes
+		<< "\n  }\n}\n";
+
+	if (!file.good()) {
+		throw std::runtime_error("Failed to write " + path);
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_stats.h"
+
+
+// What a benchmark run rendered and how, written along with the results so runs can be compared.
+struct BenchmarkSettings
+{
+	std::string deviceName;
+	std::string deviceUuid;
+	std::string computeMode;
+	bool headless = false;
+	uint64_t warmupFrames = 0;
+	uint64_t measuredFrames = 0;
+	uint32_t framesInFlight = 0;
+	std::string presentPolicy;
+	std::string presentMode;
+	uint32_t swapchainImageCount = 0;
+	uint32_t drawCount = 0;
+	uint32_t trianglesPerDraw = 0;
+	uint32_t recordThreadCount = 0;
+	uint32_t vertexStreamCount = 0;
+	uint32_t indexSize = 0;
+	uint32_t sampleCount = 0;
+};
+
+
+struct BenchmarkResults
+{
+	// False if the run ended before all measured frames were rendered, for example because the window was closed.
+	bool completed = false;
+
+	// Frames rendered while measuring, and how long they took until the GPU was idle.
+	uint64_t frameCount = 0;
+	double seconds = 0.0;
+
+	// Percentiles of the frames that have a sample, every one but the very first frame of the run.
+	FrameStatsSummary frameStats;
+
+	// Average GPU time of a frame, negative if the queue has no timestamps.
+	double gpuFrameMs = -1.0;
+
+	// Of the present policy used, from the input a frame was rendered with until it was presented, or until
+	// vkQueuePresentKHR returned if isInputToPresentDisplayed is false. No samples in headless mode.
+	FrameStatPercentiles inputToPresentMs;
+	uint64_t inputToPresentSampleCount = 0;
+	bool isInputToPresentDisplayed = false;
+
+	uint64_t peakGpuBlockBytes = 0;
+	uint64_t peakGpuUsedBytes = 0;
+	uint64_t peakProcessBytes = 0;
+};
+
+
+// Peak working set of the process in bytes, zero if the platform doesn't tell.
+uint64_t GetPeakProcessMemory();
+
+
+// Collects every frame sample of the measured part of a benchmark from a FrameStatsRing, which only holds the last
+// FrameStatsRing::CAPACITY frames.
+class BenchmarkRecorder
+{
+public:
+	// Measures from the next frame pushed to the ring on.
+	void Begin(const FrameStatsRing& ring);
+
+	// After every frame. Copies the new samples whenever half the ring has been refilled, so none are overwritten first.
+	void Update(const FrameStatsRing& ring);
+
+	// Copies the remaining samples and stops the clock.
+	void End(const FrameStatsRing& ring);
+
+	bool IsMeasuring() const { return isMeasuring; }
+	const std::vector<FrameSample>& GetSamples() const { return samples; }
+	double GetSeconds() const;
+
+private:
+	void CopyNewSamples(const FrameStatsRing& ring);
+
+	bool isMeasuring = false;
+
+	// Frame count of the ring up to which samples were copied.
+	uint64_t copiedFrameCount = 0;
+
+	std::vector<FrameSample> samples;
+	std::chrono::steady_clock::time_point startTime;
+	std::chrono::steady_clock::time_point endTime;
+};
+
+
+// Settings and results as one JSON object. Throughput is derived from the measured frames and their duration.
+void WriteBenchmarkResults(const std::string& path, const BenchmarkSettings& settings, const BenchmarkResults& results);
@@ -0,0 +1,55 @@
+#include "depth_buffer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <stdexcept>
+
+
+// Vulkan's clip space depth range is [0, 1], GLM's default is OpenGL's [-1, 1]. The project defines
+// GLM_FORCE_DEPTH_ZERO_TO_ONE for every file, so all GLM code agrees on it.
+static_assert(GLM_CONFIG_CLIP_CONTROL & GLM_CLIP_CONTROL_ZO_BIT, "GLM_FORCE_DEPTH_ZERO_TO_ONE is not defined for the project");
+
+
+VkFormat SelectDepthFormat(VkPhysicalDevice physicalDevice)
+{
+	const VkFormat candidates[] = {
+		VK_FORMAT_D32_SFLOAT,
+		VK_FORMAT_D32_SFLOAT_S8_UINT,
+		VK_FORMAT_D24_UNORM_S8_UINT,
+		VK_FORMAT_D16_UNORM
+	};
+
+	for (VkFormat format : candidates) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			return format;
+		}
+	}
+
+	throw std::runtime_error("Failed to find a supported depth format");
+}
+
+
+glm::mat4 MakeReversedZPerspective(float fovY, float aspect, float nearPlane, float farPlane)
+{
+	// Swapping the planes maps the near plane to 1 and the far plane to 0.
+	return glm::perspective(fovY, aspect, farPlane, nearPlane);
+}
+
+
+VkPipelineDepthStencilStateCreateInfo MakeReversedZDepthState()
+{
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_GREATER;
+	// Neither bounds nor stencil are tested, both would cost a read per fragment.
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.minDepthBounds = 0.0f;
+	depthStencil.maxDepthBounds = 1.0f;
+	depthStencil.stencilTestEnable = VK_FALSE;
+	return depthStencil;
+}
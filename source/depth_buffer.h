@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+
+// Reversed-Z: the near plane is at depth 1 and the far plane at depth 0. Floating point numbers are densest near 0,
+// and the perspective divide puts most of the scene close to the far plane, so the two cancel out and a 32 bit float
+// depth buffer keeps its precision over the whole range. Everything that compares depth is reversed with it:
+// the buffer is cleared to the far plane, 0, and nearer fragments have greater depth.
+const float REVERSED_Z_CLEAR_DEPTH = 0.0f;
+
+
+// The first of D32_SFLOAT, D32_SFLOAT_S8_UINT, D24_UNORM_S8_UINT and D16_UNORM the device can use as a depth
+// attachment with optimal tiling. Float formats come first, reversed-Z gains nothing with fixed point depth.
+// Throws if the device supports none of them.
+VkFormat SelectDepthFormat(VkPhysicalDevice physicalDevice);
+
+
+// Perspective projection into Vulkan's [0, 1] clip space depth range with reversed-Z, for a right handed view space
+// looking down -z. fovY in radians.
+glm::mat4 MakeReversedZPerspective(float fovY, float aspect, float nearPlane, float farPlane);
+
+
+// Depth test and write with the reversed-Z comparison. The test is strict, so a draw over identical geometry drawn
+// before is rejected by the early depth test and never shaded.
+// Early depth testing needs the fragment shader to neither discard nor write gl_FragDepth, shaders used with this
+// state should keep it that way.
+VkPipelineDepthStencilStateCreateInfo MakeReversedZDepthState();
@@ -0,0 +1,267 @@
+#include "device_selection.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+
+// Points per device type. They are far apart, so memory, queues and features only order devices of the same type.
+static int64_t GetDeviceTypePoints(VkPhysicalDeviceType type)
+{
+	switch (type) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		return 10000;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		return 5000;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		return 2000;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:
+		return 100;
+	default:
+		return 0;
+	}
+}
+
+
+static bool HasDeviceExtension(const std::vector<VkExtensionProperties>& extensions, const char* extensionName)
+{
+	for (const auto& extension : extensions) {
+		if (std::strcmp(extension.extensionName, extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static std::string ToLower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return text;
+}
+
+
+void DeviceCandidate::AddScore(const std::string& reason, int64_t points)
+{
+	if (points == 0) {
+		return;
+	}
+
+	DeviceScoreTerm term;
+	term.reason = reason;
+	term.points = points;
+	scoreTerms.push_back(term);
+
+	score += points;
+}
+
+
+const char* GetPhysicalDeviceTypeName(VkPhysicalDeviceType type)
+{
+	switch (type) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		return "discrete";
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		return "integrated";
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		return "virtual";
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:
+		return "cpu";
+	default:
+		return "other";
+	}
+}
+
+
+std::string FormatDeviceUuid(const std::array<uint8_t, VK_UUID_SIZE>& uuid)
+{
+	static const char* HEX_DIGITS = "0123456789abcdef";
+
+	std::string text;
+	for (size_t i = 0; i < uuid.size(); ++i) {
+		if (i == 4 || i == 6 || i == 8 || i == 10) {
+			text += '-';
+		}
+		text += HEX_DIGITS[uuid[i] >> 4];
+		text += HEX_DIGITS[uuid[i] & 0xF];
+	}
+	return text;
+}
+
+
+DeviceCandidate DescribePhysicalDevice(VkPhysicalDevice device, uint32_t index)
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+	DeviceCandidate candidate;
+	candidate.device = device;
+	candidate.index = index;
+	candidate.name = deviceProperties.deviceName;
+	candidate.type = deviceProperties.deviceType;
+
+	// VkPhysicalDeviceIDProperties is core since Vulkan 1.1. Older devices are rejected anyway.
+	if (deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+		VkPhysicalDeviceIDProperties idProperties{};
+		idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &idProperties;
+		vkGetPhysicalDeviceProperties2(device, &properties2);
+
+		std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), candidate.uuid.begin());
+	}
+
+	return candidate;
+}
+
+
+void ScorePhysicalDevice(DeviceCandidate& candidate)
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(candidate.device, &deviceProperties);
+
+	candidate.AddScore(std::string(GetPhysicalDeviceTypeName(candidate.type)) + " device", GetDeviceTypePoints(candidate.type));
+
+	// The largest device local heap is where render targets and vertex buffers live. Integrated GPUs report
+	// system memory here, the device type keeps them behind a discrete GPU with less of it.
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(candidate.device, &memoryProperties);
+
+	VkDeviceSize deviceLocalBytes = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+		if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			deviceLocalBytes = std::max(deviceLocalBytes, memoryProperties.memoryHeaps[i].size);
+		}
+	}
+	VkDeviceSize deviceLocalMiB = deviceLocalBytes / (1024 * 1024);
+	// One point per 64 MiB, up to 64 GiB.
+	candidate.AddScore(std::to_string(deviceLocalMiB) + " MiB device local memory",
+		static_cast<int64_t>(std::min<VkDeviceSize>(deviceLocalMiB / 64, 1024)));
+
+	// A transfer family without graphics is usually backed by copy engines, which upload while the graphics
+	// queue renders. A compute family without graphics runs compute work next to rendering.
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(candidate.device, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(candidate.device, &queueFamilyCount, queueFamilyList.data());
+
+	bool hasTransferFamily = false;
+	bool hasComputeFamily = false;
+	for (const auto& queueFamily : queueFamilyList) {
+		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+			continue;
+		}
+		if (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) {
+			hasComputeFamily = true;
+		}
+		else if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) {
+			hasTransferFamily = true;
+		}
+	}
+	candidate.AddScore("dedicated transfer queue family", hasTransferFamily ? 500 : 0);
+	candidate.AddScore("async compute queue family", hasComputeFamily ? 500 : 0);
+
+	// Limits that tell a capable device from a minimal one.
+	const VkPhysicalDeviceLimits& limits = deviceProperties.limits;
+	candidate.AddScore("max 2D image " + std::to_string(limits.maxImageDimension2D), limits.maxImageDimension2D / 1024);
+	candidate.AddScore("timestamps on all graphics and compute queues", limits.timestampComputeAndGraphics ? 100 : 0);
+
+	// Optional extensions the application uses when the device has them.
+	uint32_t deviceExtensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(candidate.device, nullptr, &deviceExtensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> deviceExtensionList(deviceExtensionCount);
+	vkEnumerateDeviceExtensionProperties(candidate.device, nullptr, &deviceExtensionCount, deviceExtensionList.data());
+
+	candidate.AddScore(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+		HasDeviceExtension(deviceExtensionList, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) ? 100 : 0);
+}
+
+
+void RankDeviceCandidates(std::vector<DeviceCandidate>& candidates)
+{
+	std::stable_sort(candidates.begin(), candidates.end(), [](const DeviceCandidate& a, const DeviceCandidate& b) {
+		if (a.IsSuitable() != b.IsSuitable()) {
+			return a.IsSuitable();
+		}
+		if (a.score != b.score) {
+			return a.score > b.score;
+		}
+		return a.index < b.index;
+	});
+}
+
+
+bool MatchesDeviceOverride(const DeviceCandidate& candidate, const std::string& deviceOverride)
+{
+	std::string overrideText = ToLower(deviceOverride);
+
+	std::string overrideHex = overrideText;
+	overrideHex.erase(std::remove(overrideHex.begin(), overrideHex.end(), '-'), overrideHex.end());
+
+	std::string uuidHex = FormatDeviceUuid(candidate.uuid);
+	uuidHex.erase(std::remove(uuidHex.begin(), uuidHex.end(), '-'), uuidHex.end());
+
+	if (overrideHex == uuidHex) {
+		return true;
+	}
+
+	return ToLower(candidate.name).find(overrideText) != std::string::npos;
+}
+
+
+size_t PickDeviceCandidate(const std::vector<DeviceCandidate>& rankedCandidates, const std::string& deviceOverride)
+{
+	std::string rejectedMatches;
+
+	for (size_t i = 0; i < rankedCandidates.size(); ++i) {
+		const DeviceCandidate& candidate = rankedCandidates[i];
+
+		if (!deviceOverride.empty() && !MatchesDeviceOverride(candidate, deviceOverride)) {
+			continue;
+		}
+
+		if (candidate.IsSuitable()) {
+			return i;
+		}
+
+		rejectedMatches += "\n  " + candidate.name + ": " + candidate.rejectReason;
+	}
+
+	if (deviceOverride.empty()) {
+		throw std::runtime_error("Failed to find a suitable Physical Device" + rejectedMatches);
+	}
+	if (rejectedMatches.empty()) {
+		throw std::runtime_error("No Physical Device matches --device " + deviceOverride);
+	}
+	throw std::runtime_error("The Physical Device matching --device " + deviceOverride + " is not suitable" + rejectedMatches);
+}
+
+
+void WriteDeviceRanking(std::ostream& stream, const std::vector<DeviceCandidate>& rankedCandidates, size_t selectedIndex)
+{
+	stream << "Physical Devices by score:\n";
+
+	for (size_t i = 0; i < rankedCandidates.size(); ++i) {
+		const DeviceCandidate& candidate = rankedCandidates[i];
+
+		stream << (i == selectedIndex ? "* " : "  ") << candidate.name << " (" << GetPhysicalDeviceTypeName(candidate.type)
+			<< ", " << FormatDeviceUuid(candidate.uuid) << ")";
+
+		if (!candidate.IsSuitable()) {
+			stream << " rejected: " << candidate.rejectReason << "\n";
+			continue;
+		}
+
+		stream << " score " << candidate.score << ":";
+		for (size_t j = 0; j < candidate.scoreTerms.size(); ++j) {
+			stream << (j == 0 ? " " : ", ") << candidate.scoreTerms[j].reason << " +" << candidate.scoreTerms[j].points;
+		}
+		stream << "\n";
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// One reason a device scored the points it did, printed with the ranking so the choice can be explained.
+struct DeviceScoreTerm
+{
+	std::string reason;
+	int64_t points = 0;
+};
+
+
+// A physical device considered by device selection.
+struct DeviceCandidate
+{
+	VkPhysicalDevice device = VK_NULL_HANDLE;
+
+	// Position in the vkEnumeratePhysicalDevices list. Ties are broken by it, so the driver's order still counts.
+	uint32_t index = 0;
+
+	std::string name;
+	VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+
+	// VkPhysicalDeviceIDProperties::deviceUUID, stable across processes and the same in every API on the machine.
+	// All zero if the device doesn't report one.
+	std::array<uint8_t, VK_UUID_SIZE> uuid{};
+
+	// Empty if the device meets the requirements of the application.
+	std::string rejectReason;
+
+	int64_t score = 0;
+	std::vector<DeviceScoreTerm> scoreTerms;
+
+	bool IsSuitable() const { return rejectReason.empty(); }
+
+	void AddScore(const std::string& reason, int64_t points);
+};
+
+
+const char* GetPhysicalDeviceTypeName(VkPhysicalDeviceType type);
+
+// Lower case hex in the 8-4-4-4-12 layout, like other tools print device UUIDs.
+std::string FormatDeviceUuid(const std::array<uint8_t, VK_UUID_SIZE>& uuid);
+
+
+// Name, type and UUID of the device. It isn't scored yet.
+DeviceCandidate DescribePhysicalDevice(VkPhysicalDevice device, uint32_t index);
+
+
+// Adds the points that don't depend on the application's surface: device type, device local memory, dedicated
+// transfer and compute queue families, limits and the optional extensions the application uses when present.
+// The device type dominates, so a discrete GPU wins over an integrated one or a CPU implementation unless it
+// lacks something the others have by a wide margin.
+void ScorePhysicalDevice(DeviceCandidate& candidate);
+
+
+// Suitable devices first, highest score first, then in enumeration order.
+void RankDeviceCandidates(std::vector<DeviceCandidate>& candidates);
+
+
+// True if deviceOverride is the UUID of the device, with or without dashes, or part of its name. Case is ignored.
+bool MatchesDeviceOverride(const DeviceCandidate& candidate, const std::string& deviceOverride);
+
+
+// Index into ranked candidates of the device to use: the best suitable one, or the best suitable one matching a
+// non empty deviceOverride. Throws if there is none, naming the devices that matched but were rejected.
+size_t PickDeviceCandidate(const std::vector<DeviceCandidate>& rankedCandidates, const std::string& deviceOverride);
+
+
+// Every candidate with its score and the terms that make it up, or why it was rejected.
+void WriteDeviceRanking(std::ostream& stream, const std::vector<DeviceCandidate>& rankedCandidates, size_t selectedIndex);
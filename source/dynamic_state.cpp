@@ -0,0 +1,39 @@
+#include "dynamic_state.h"
+
+
+DynamicPipelineState MakeDynamicPipelineState(VkExtent2D extent)
+{
+	DynamicPipelineState state;
+
+	state.viewport.width = static_cast<float>(extent.width);
+	state.viewport.height = static_cast<float>(extent.height);
+
+	state.scissor.offset = { 0, 0 };
+	state.scissor.extent = extent;
+
+	return state;
+}
+
+
+const std::vector<VkDynamicState>& GetDynamicStates()
+{
+	static const std::vector<VkDynamicState> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
+		VK_DYNAMIC_STATE_LINE_WIDTH,
+		VK_DYNAMIC_STATE_DEPTH_BIAS,
+		VK_DYNAMIC_STATE_BLEND_CONSTANTS
+	};
+
+	return dynamicStates;
+}
+
+
+void CmdSetDynamicState(VkCommandBuffer commandBuffer, const DynamicPipelineState& state)
+{
+	vkCmdSetViewport(commandBuffer, 0, 1, &state.viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &state.scissor);
+	vkCmdSetLineWidth(commandBuffer, state.lineWidth);
+	vkCmdSetDepthBias(commandBuffer, state.depthBiasConstantFactor, state.depthBiasClamp, state.depthBiasSlopeFactor);
+	vkCmdSetBlendConstants(commandBuffer, state.blendConstants);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+
+// Pipeline state that is set with vkCmdSet* at record time instead of being baked into pipelines.
+// Everything in here may change between draws, with the window size or with the render target
+// without ever compiling a pipeline again.
+//
+// Only state that is cheap to change on all hardware belongs here. Anything that changes the shader code
+// the driver generates (blend enable, formats, sample count...) stays in the pipeline.
+struct DynamicPipelineState
+{
+	VkViewport viewport{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+	VkRect2D scissor{};
+
+	// Thickness of lines in fragments. Anything other than 1.0 requires the wideLines feature.
+	float lineWidth = 1.0f;
+
+	// Only applied if the pipeline has depthBiasEnable set.
+	float depthBiasConstantFactor = 0.0f;
+	float depthBiasClamp = 0.0f;
+	float depthBiasSlopeFactor = 0.0f;
+
+	// Only used by blend factors with CONSTANT in their name.
+	float blendConstants[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+
+// Viewport and scissor covering the whole extent, everything else at its default.
+DynamicPipelineState MakeDynamicPipelineState(VkExtent2D extent);
+
+
+// The states of DynamicPipelineState, for VkPipelineDynamicStateCreateInfo. Every pipeline uses the same list,
+// so every pipeline is compatible with CmdSetDynamicState.
+const std::vector<VkDynamicState>& GetDynamicStates();
+
+
+// Sets all of the state. Dynamic state is per command buffer and not inherited by secondary command buffers,
+// so it has to be set in every command buffer that draws.
+void CmdSetDynamicState(VkCommandBuffer commandBuffer, const DynamicPipelineState& state);
@@ -0,0 +1,122 @@
+#include "frame_commands.h"
+
+#include <stdexcept>
+
+
+void FrameCommandPools::Init(VkDevice device, uint32_t queueFamilyIndex, uint32_t slotCount, uint32_t workerCount)
+{
+	this->device = device;
+	slots.resize(slotCount);
+
+	for (Slot& slot : slots) {
+		slot.pool = CreatePool(queueFamilyIndex);
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = slot.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, &slot.primary) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate frame command buffer");
+		}
+
+		slot.workerPools.resize(workerCount);
+		for (WorkerPool& workerPool : slot.workerPools) {
+			workerPool.pool = CreatePool(queueFamilyIndex);
+		}
+	}
+}
+
+
+void FrameCommandPools::Destroy()
+{
+	// Command buffers are freed together with their pool.
+	for (Slot& slot : slots) {
+		for (WorkerPool& workerPool : slot.workerPools) {
+			vkDestroyCommandPool(device, workerPool.pool, nullptr);
+		}
+		vkDestroyCommandPool(device, slot.pool, nullptr);
+	}
+
+	slots.clear();
+}
+
+
+VkCommandBuffer FrameCommandPools::BeginFrame(uint32_t slot)
+{
+	// No VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT: the memory stays with the pool, the next frame needs about as much.
+	if (vkResetCommandPool(device, slots[slot].pool, 0) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to reset frame command pool");
+	}
+
+	for (WorkerPool& workerPool : slots[slot].workerPools) {
+		if (vkResetCommandPool(device, workerPool.pool, 0) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to reset worker command pool");
+		}
+		workerPool.usedCount = 0;
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	// Submitted once and re-recorded for the next use of the slot.
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(slots[slot].primary, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording command buffer");
+	}
+
+	return slots[slot].primary;
+}
+
+
+VkCommandBuffer FrameCommandPools::BeginSecondary(uint32_t slot, uint32_t worker, const VkCommandBufferInheritanceInfo& inheritanceInfo)
+{
+	WorkerPool& workerPool = slots[slot].workerPools[worker];
+
+	if (workerPool.usedCount == workerPool.secondaries.size()) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = workerPool.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer secondary;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &secondary) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate secondary command buffer");
+		}
+		workerPool.secondaries.push_back(secondary);
+	}
+
+	VkCommandBuffer secondary = workerPool.secondaries[workerPool.usedCount++];
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	// RENDER_PASS_CONTINUE_BIT: the buffer is executed entirely inside the render pass given by the inheritance info.
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording secondary command buffer");
+	}
+
+	return secondary;
+}
+
+
+VkCommandPool FrameCommandPools::CreatePool(uint32_t queueFamilyIndex)
+{
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+	// Command buffers live for a single frame. Without RESET_COMMAND_BUFFER_BIT the pool is only reset as a whole,
+	// which lets the driver use a simpler allocator.
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	VkCommandPool pool;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create frame command pool");
+	}
+
+	return pool;
+}
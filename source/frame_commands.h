@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+
+// Command pools for recording the frame from scratch every time it's drawn.
+// Every frame slot has its own pool created with VK_COMMAND_POOL_CREATE_TRANSIENT_BIT. Once the frame pacer has waited for the slot's last frame,
+// nothing allocated from its pool is used by the GPU anymore, so the whole pool is reset with a single vkResetCommandPool.
+// That is cheaper than resetting command buffers one by one and lets the driver reuse the memory of the last recording.
+//
+// For multithreaded recording every slot also has one pool per worker thread. Command pools are externally synchronized,
+// so each worker records secondary command buffers from its own pool and no locking is needed.
+class FrameCommandPools
+{
+public:
+	// One slot per frame in flight. Creating the maximum up front means changing frames in flight needs no new pools.
+	void Init(VkDevice device, uint32_t queueFamilyIndex, uint32_t slotCount, uint32_t workerCount = 0);
+	void Destroy();
+
+	// Resets the pools of the slot and begins its primary command buffer for one-time submission.
+	// Must only be called once the previous submission of the slot has completed.
+	VkCommandBuffer BeginFrame(uint32_t slot);
+
+	// Begins a secondary command buffer from the worker's pool of the slot. Only the worker with that index may call it
+	// between two BeginFrame calls. Buffers are allocated on first use and reused in the following frames.
+	VkCommandBuffer BeginSecondary(uint32_t slot, uint32_t worker, const VkCommandBufferInheritanceInfo& inheritanceInfo);
+
+	VkCommandPool GetPool(uint32_t slot) const { return slots[slot].pool; }
+
+private:
+	struct WorkerPool
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> secondaries;
+
+		// Secondaries handed out since the last reset.
+		size_t usedCount = 0;
+	};
+
+	struct Slot
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+
+		// Allocated once. Resetting the pool resets it too, so it's simply begun again.
+		VkCommandBuffer primary = VK_NULL_HANDLE;
+
+		std::vector<WorkerPool> workerPools;
+	};
+
+	VkCommandPool CreatePool(uint32_t queueFamilyIndex);
+
+	VkDevice device = VK_NULL_HANDLE;
+
+	std::vector<Slot> slots;
+};
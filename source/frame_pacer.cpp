@@ -0,0 +1,308 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+static double ToMilliseconds(std::chrono::steady_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+
+void FramePacer::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, size_t imageCount)
+{
+	this->device = device;
+	this->framesInFlight = std::clamp(framesInFlight, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+
+	// Timestamps are only usable if the queue family writes valid bits into them.
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyList.data());
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilyList[queueFamilyIndex].timestampValidBits : 0;
+	if (validBits > 0) {
+		timestampPeriod = deviceProperties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? UINT64_MAX : ((uint64_t(1) << validBits) - 1);
+	}
+
+	ResetAverages();
+	graphicsTimeline.Init(device);
+	CreateFrameSemaphores();
+	SetImageCount(imageCount);
+}
+
+
+void FramePacer::Destroy()
+{
+	DestroyQueryPool();
+	DestroyImageSemaphores();
+	DestroyFrameSemaphores();
+	graphicsTimeline.Destroy();
+}
+
+
+uint32_t FramePacer::SetFramesInFlight(uint32_t count)
+{
+	count = std::clamp(count, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+	if (count == framesInFlight) {
+		return framesInFlight;
+	}
+
+	// Semaphores may be in use by the GPU, so the only safe moment to replace them is when it's idle.
+	vkDeviceWaitIdle(device);
+
+	for (uint32_t i = 0; i < imageCount; ++i) {
+		CollectTimings(i);
+	}
+
+	DestroyFrameSemaphores();
+	framesInFlight = count;
+	CreateFrameSemaphores();
+
+	return framesInFlight;
+}
+
+
+void FramePacer::SetImageCount(size_t imageCount)
+{
+	for (uint32_t i = 0; i < this->imageCount; ++i) {
+		CollectTimings(i);
+	}
+
+	this->imageCount = imageCount;
+
+	// A recreated swapchain usually has as many images as the old one, its semaphores are kept then.
+	if (imageCount != renderFinishedSemaphores.size()) {
+		DestroyImageSemaphores();
+		CreateImageSemaphores();
+	}
+
+	// The device is idle, no image is in use.
+	imageValues.assign(imageCount, 0);
+	pendingTimings.assign(imageCount, FrameTimings{});
+	isTimingPending.assign(imageCount, false);
+
+	DestroyQueryPool();
+	CreateQueryPool();
+}
+
+
+void FramePacer::BeginFrame()
+{
+	currentCpuWait = std::chrono::steady_clock::duration{};
+
+	// Wait until the GPU has finished the frame that used this slot framesInFlight frames ago.
+	WaitForValue(slotValues[currentFrame]);
+}
+
+
+void FramePacer::WaitForImage(uint32_t imageIndex)
+{
+	// Wait if a previous frame is still using this image. Usually that frame is older than the one
+	// BeginFrame waited for, and the cached counter value answers without a call into the driver.
+	WaitForValue(imageValues[imageIndex]);
+
+	// The previous submission to this image has completed, so its timestamps can be read
+	// before the new submission resets them.
+	CollectTimings(imageIndex);
+
+	currentImage = imageIndex;
+}
+
+
+void FramePacer::EndFrame()
+{
+	// The frame has been submitted with GetFrameCompletePoint(). Mark the slot and the image as in use until it's reached.
+	uint64_t frameValue = graphicsTimeline.Advance();
+	slotValues[currentFrame] = frameValue;
+	imageValues[currentImage] = frameValue;
+
+	FrameTimings& timings = pendingTimings[currentImage];
+	timings = FrameTimings{};
+	timings.frameNumber = frameNumber;
+	timings.cpuWaitMs = ToMilliseconds(currentCpuWait);
+	isTimingPending[currentImage] = true;
+
+	++frameNumber;
+	currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+
+void FramePacer::CmdBeginTiming(VkCommandBuffer commandBuffer, uint32_t timingSlot)
+{
+	if (timestampQueryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Queries must be reset before they are written again.
+	vkCmdResetQueryPool(commandBuffer, timestampQueryPool, timingSlot * 2, 2);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, timingSlot * 2);
+}
+
+
+void FramePacer::CmdEndTiming(VkCommandBuffer commandBuffer, uint32_t timingSlot)
+{
+	if (timestampQueryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Written once all previous commands have completed.
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, timingSlot * 2 + 1);
+}
+
+
+FrameTimings FramePacer::GetAverageTimings() const
+{
+	FrameTimings average;
+	average.frameNumber = lastTimings.frameNumber;
+
+	if (averagedFrameCount > 0) {
+		average.cpuWaitMs = timingsSum.cpuWaitMs / averagedFrameCount;
+	}
+	if (gpuTimedFrameCount > 0) {
+		average.gpuBusyMs = timingsSum.gpuBusyMs / gpuTimedFrameCount;
+	}
+
+	return average;
+}
+
+
+void FramePacer::ResetAverages()
+{
+	timingsSum = FrameTimings{};
+	timingsSum.gpuBusyMs = 0.0;
+	averagedFrameCount = 0;
+	gpuTimedFrameCount = 0;
+}
+
+
+void FramePacer::WaitForValue(uint64_t value)
+{
+	if (graphicsTimeline.IsComplete(value)) {
+		return;
+	}
+
+	auto waitStart = std::chrono::steady_clock::now();
+	graphicsTimeline.Wait(value);
+	currentCpuWait += std::chrono::steady_clock::now() - waitStart;
+}
+
+
+void FramePacer::CreateFrameSemaphores()
+{
+	// Each frame should have its own acquire semaphore.
+	imageAvailableSemaphores.resize(framesInFlight);
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (uint32_t i = 0; i < framesInFlight; ++i) {
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create synchronization objects for a frame");
+		}
+	}
+
+	// Value 0 is reached from the start, a slot that wasn't used yet doesn't wait.
+	slotValues.assign(framesInFlight, 0);
+	currentFrame = 0;
+}
+
+
+void FramePacer::DestroyFrameSemaphores()
+{
+	for (VkSemaphore semaphore : imageAvailableSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	imageAvailableSemaphores.clear();
+}
+
+
+void FramePacer::CreateImageSemaphores()
+{
+	renderFinishedSemaphores.resize(imageCount);
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (size_t i = 0; i < imageCount; ++i) {
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create synchronization objects for a swapchain image");
+		}
+	}
+}
+
+
+void FramePacer::DestroyImageSemaphores()
+{
+	for (VkSemaphore semaphore : renderFinishedSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	renderFinishedSemaphores.clear();
+}
+
+
+void FramePacer::CreateQueryPool()
+{
+	timingSlotCount = static_cast<uint32_t>(imageCount);
+
+	if (timestampPeriod == 0.0 || timingSlotCount == 0) {
+		return;
+	}
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = timingSlotCount * 2;
+
+	if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create timestamp query pool");
+	}
+}
+
+
+void FramePacer::DestroyQueryPool()
+{
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+		timestampQueryPool = VK_NULL_HANDLE;
+	}
+}
+
+
+void FramePacer::CollectTimings(uint32_t imageIndex)
+{
+	if (imageIndex >= isTimingPending.size() || !isTimingPending[imageIndex]) {
+		return;
+	}
+
+	FrameTimings timings = pendingTimings[imageIndex];
+	isTimingPending[imageIndex] = false;
+
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		// The submission is known to be complete, so there is no need for VK_QUERY_RESULT_WAIT_BIT.
+		uint64_t timestamps[2] = {};
+		VkResult result = vkGetQueryPoolResults(device, timestampQueryPool, imageIndex * 2, 2, sizeof(timestamps), timestamps,
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+			timings.gpuBusyMs = ticks * timestampPeriod / 1e6;
+		}
+	}
+
+	lastTimings = timings;
+
+	timingsSum.cpuWaitMs += timings.cpuWaitMs;
+	++averagedFrameCount;
+
+	if (timings.gpuBusyMs >= 0.0) {
+		timingsSum.gpuBusyMs += timings.gpuBusyMs;
+		++gpuTimedFrameCount;
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "queue_timeline.h"
+
+
+// Timings of a single frame, reported by FramePacer.
+struct FrameTimings
+{
+	uint64_t frameNumber = 0;
+
+	// How long the CPU was blocked on the graphics timeline before it could reuse the resources of the frame.
+	// Close to zero means the CPU is the bottleneck, large values mean the GPU is.
+	double cpuWaitMs = 0.0;
+
+	// Time between the first and the last command of the frame on the GPU (from timestamp queries).
+	// Negative if the queue does not support timestamps.
+	double gpuBusyMs = -1.0;
+};
+
+
+// Paces frames through semaphores only, so the CPU can record frame N+1 while the GPU still renders frame N.
+// Owns the per-frame synchronization objects and keeps track of which swapchain image is used by which frame.
+//
+// Every frame's submission signals the next value of one timeline semaphore on the graphics queue. A frame slot and
+// a swapchain image only remember the value of the last frame that used them, instead of owning a fence each, and
+// waiting for an image that the frame slot's wait already covered costs nothing.
+// Acquire and present only take binary semaphores, those stay: one per frame slot for acquire, and one per swapchain
+// image for present, because a present's semaphore is only known to be unused again once its image is acquired.
+//
+// Usage per frame:
+// 1. BeginFrame() - waits until the resources of the current frame slot are free again.
+// 2. vkAcquireNextImageKHR with GetImageAvailableSemaphore().
+// 3. WaitForImage(imageIndex) - waits if an older frame still renders to that image.
+// 4. vkQueueSubmit waiting on GetImageAvailableSemaphore(), signaling GetRenderFinishedSemaphore() and GetFrameCompletePoint().
+// 5. EndFrame() - once the submission succeeded, moves to the next frame slot.
+class FramePacer
+{
+public:
+	// Frames in flight can be changed at runtime inside this range.
+	static const uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+	static const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, size_t imageCount);
+	void Destroy();
+
+	// Waits for the device to go idle and recreates the per-frame semaphores. Returns the count actually applied.
+	uint32_t SetFramesInFlight(uint32_t count);
+	uint32_t GetFramesInFlight() const { return framesInFlight; }
+
+	// Must be called when the number of swapchain images changes. Expects the device to be idle.
+	void SetImageCount(size_t imageCount);
+
+	void BeginFrame();
+	void WaitForImage(uint32_t imageIndex);
+	void EndFrame();
+
+	uint32_t GetCurrentFrame() const { return currentFrame; }
+	VkSemaphore GetImageAvailableSemaphore() const { return imageAvailableSemaphores[currentFrame]; }
+	// The semaphore of the image passed to WaitForImage().
+	VkSemaphore GetRenderFinishedSemaphore() const { return renderFinishedSemaphores[currentImage]; }
+
+	// Timeline value the submission of the current frame signals. Other queues wait on it for the frame's rendering.
+	TimelinePoint GetFrameCompletePoint() const { return graphicsTimeline.GetNextPoint(); }
+
+	// Record timestamps around the work of one frame. Timing slots are per swapchain image, because the results
+	// are read once WaitForImage knows the last submission to the image has completed. Must be recorded outside of a render pass.
+	void CmdBeginTiming(VkCommandBuffer commandBuffer, uint32_t timingSlot);
+	void CmdEndTiming(VkCommandBuffer commandBuffer, uint32_t timingSlot);
+	uint32_t GetTimingSlotCount() const { return timingSlotCount; }
+
+	// Timings of the most recent frame whose GPU work has completed.
+	const FrameTimings& GetLastTimings() const { return lastTimings; }
+
+	// Averages since the last call of ResetAverages().
+	FrameTimings GetAverageTimings() const;
+	uint64_t GetAveragedFrameCount() const { return averagedFrameCount; }
+	void ResetAverages();
+
+private:
+	void CreateFrameSemaphores();
+	void DestroyFrameSemaphores();
+	void CreateImageSemaphores();
+	void DestroyImageSemaphores();
+	// Blocks until the graphics timeline reaches value and adds the time to the frame's CPU wait.
+	void WaitForValue(uint64_t value);
+	void CreateQueryPool();
+	void DestroyQueryPool();
+	void CollectTimings(uint32_t imageIndex);
+
+	VkDevice device = VK_NULL_HANDLE;
+
+	uint32_t framesInFlight = 2;
+	size_t imageCount = 0;
+
+	// Frame index in terms of framesInFlight.
+	uint32_t currentFrame = 0;
+
+	// Total amount of frames submitted.
+	uint64_t frameNumber = 0;
+
+	// Image has been acquired and is ready for rendering.
+	std::vector<VkSemaphore> imageAvailableSemaphores;
+
+	// Signal that rendering has finished and presentation can happen. One per swapchain image.
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+
+	// Signaled by every frame's submission, one value per frame. Replaces a fence per frame slot.
+	QueueTimeline graphicsTimeline;
+
+	// Timeline value of the last frame submitted from each frame slot.
+	std::vector<uint64_t> slotValues;
+
+	// If framesInFlight is higher than the number of swapchain images or vkAcquireNextImageKHR returns
+	// images out-of-order, then it's possible that we may start rendering to a swapchain image that is already in flight.
+	// To avoid this, we track for each swapchain image the timeline value of the last frame that used it.
+	std::vector<uint64_t> imageValues;
+
+	// Swapchain image used by the current frame.
+	uint32_t currentImage = 0;
+
+	// Time spent in timeline waits for the current frame.
+	std::chrono::steady_clock::duration currentCpuWait{};
+
+	// Timings of the last submission to each image. They are completed with GPU time and reported
+	// as soon as that submission is known to be finished.
+	std::vector<FrameTimings> pendingTimings;
+	std::vector<bool> isTimingPending;
+
+	// Two timestamps (begin, end) per timing slot.
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+	uint32_t timingSlotCount = 0;
+
+	// Nanoseconds per timestamp tick. Zero if timestamps are not supported by the queue.
+	double timestampPeriod = 0.0;
+	uint64_t timestampMask = 0;
+
+	FrameTimings lastTimings;
+
+	FrameTimings timingsSum;
+	uint64_t averagedFrameCount = 0;
+	uint64_t gpuTimedFrameCount = 0;
+};
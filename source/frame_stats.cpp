@@ -0,0 +1,164 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+
+// Frames that set the typical frame time before hitches are detected.
+static const uint32_t HITCH_WARMUP_FRAMES = 30;
+
+// Weight of a new frame in the moving average of the typical frame time.
+static const double TYPICAL_FRAME_WEIGHT = 1.0 / 16.0;
+
+
+const char* GetFrameStatName(FrameStat stat)
+{
+	switch (stat) {
+	case FrameStat::FrameTime:
+		return "frame";
+	case FrameStat::Acquire:
+		return "acquire";
+	case FrameStat::FrameWait:
+		return "frame wait";
+	case FrameStat::Record:
+		return "record";
+	case FrameStat::Submit:
+		return "submit";
+	case FrameStat::Present:
+		return "present";
+	default:
+		return "unknown";
+	}
+}
+
+
+void FrameStatsRing::Push(FrameSample sample)
+{
+	double frameMs = sample[FrameStat::FrameTime];
+
+	sample.isHitch = typicalFrameSamples >= HITCH_WARMUP_FRAMES && frameMs > typicalFrameMs * HITCH_FACTOR;
+	if (sample.isHitch) {
+		hitchCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	else {
+		// Hitches stay out of the average, so a burst of them doesn't raise the bar for the next ones.
+		typicalFrameMs = typicalFrameSamples == 0 ? frameMs : typicalFrameMs + (frameMs - typicalFrameMs) * TYPICAL_FRAME_WEIGHT;
+		++typicalFrameSamples;
+	}
+
+	uint64_t index = writeCount.load(std::memory_order_relaxed);
+	Slot& slot = slots[index % CAPACITY];
+
+	// Readers that see the odd sequence, or a different one after copying, drop the slot.
+	slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for (uint32_t i = 0; i < FRAME_STAT_COUNT; ++i) {
+		slot.valuesMs[i].store(sample.valuesMs[i], std::memory_order_relaxed);
+	}
+	slot.isHitch.store(sample.isHitch, std::memory_order_relaxed);
+
+	slot.sequence.store(index * 2 + 2, std::memory_order_release);
+	writeCount.store(index + 1, std::memory_order_release);
+}
+
+
+std::vector<FrameSample> FrameStatsRing::GetRecent(uint32_t count) const
+{
+	uint64_t end = writeCount.load(std::memory_order_acquire);
+	uint64_t begin = end - std::min<uint64_t>({ count, end, CAPACITY });
+
+	std::vector<FrameSample> samples;
+	samples.reserve(end - begin);
+
+	for (uint64_t index = begin; index < end; ++index) {
+		const Slot& slot = slots[index % CAPACITY];
+
+		uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence != index * 2 + 2) {
+			continue;
+		}
+
+		FrameSample sample;
+		for (uint32_t i = 0; i < FRAME_STAT_COUNT; ++i) {
+			sample.valuesMs[i] = slot.valuesMs[i].load(std::memory_order_relaxed);
+		}
+		sample.isHitch = slot.isHitch.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+			continue;
+		}
+
+		samples.push_back(sample);
+	}
+
+	return samples;
+}
+
+
+FrameStatsSummary FrameStatsRing::Summarize(uint32_t count) const
+{
+	return SummarizeFrameSamples(GetRecent(count));
+}
+
+
+FrameStatPercentiles GetSortedPercentiles(const std::vector<float>& sortedValues)
+{
+	FrameStatPercentiles percentiles;
+	if (sortedValues.empty()) {
+		return percentiles;
+	}
+
+	auto percentile = [&sortedValues](double fraction) {
+		size_t rank = static_cast<size_t>(std::ceil(fraction * sortedValues.size()));
+		return static_cast<double>(sortedValues[std::max<size_t>(rank, 1) - 1]);
+	};
+
+	percentiles.p50 = percentile(0.50);
+	percentiles.p95 = percentile(0.95);
+	percentiles.p99 = percentile(0.99);
+	percentiles.max = sortedValues.back();
+
+	return percentiles;
+}
+
+
+FrameStatsSummary SummarizeFrameSamples(const std::vector<FrameSample>& samples)
+{
+	FrameStatsSummary summary;
+	summary.frameCount = static_cast<uint32_t>(samples.size());
+	if (samples.empty()) {
+		return summary;
+	}
+
+	summary.hitchCount = static_cast<uint32_t>(std::count_if(samples.begin(), samples.end(),
+		[](const FrameSample& sample) { return sample.isHitch; }));
+
+	std::vector<float> values(samples.size());
+	for (uint32_t i = 0; i < FRAME_STAT_COUNT; ++i) {
+		for (size_t j = 0; j < samples.size(); ++j) {
+			values[j] = samples[j].valuesMs[i];
+		}
+		std::sort(values.begin(), values.end());
+		summary.stats[i] = GetSortedPercentiles(values);
+	}
+
+	return summary;
+}
+
+
+void WriteFrameStatsSummary(std::ostream& stream, const FrameStatsSummary& summary)
+{
+	stream << std::fixed << std::setprecision(3)
+		<< "Frame statistics of the last " << summary.frameCount << " frames, " << summary.hitchCount << " hitches (ms):\n"
+		<< std::left << std::setw(12) << "" << std::right
+		<< std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+
+	for (uint32_t i = 0; i < FRAME_STAT_COUNT; ++i) {
+		const FrameStatPercentiles& stat = summary.stats[i];
+		stream << std::left << std::setw(12) << GetFrameStatName(static_cast<FrameStat>(i)) << std::right
+			<< std::setw(10) << stat.p50 << std::setw(10) << stat.p95 << std::setw(10) << stat.p99 << std::setw(10) << stat.max << "\n";
+	}
+}
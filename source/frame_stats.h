@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+
+// CPU durations measured for every frame.
+enum class FrameStat : uint32_t
+{
+	// From the start of the previous frame to the start of this one.
+	FrameTime,
+	Acquire,
+	// Waiting on the graphics timeline for the frame slot and the swapchain image.
+	FrameWait,
+	Record,
+	Submit,
+	Present,
+	Count
+};
+
+const uint32_t FRAME_STAT_COUNT = static_cast<uint32_t>(FrameStat::Count);
+
+const char* GetFrameStatName(FrameStat stat);
+
+
+struct FrameSample
+{
+	std::array<float, FRAME_STAT_COUNT> valuesMs{};
+
+	// Set by FrameStatsRing::Push.
+	bool isHitch = false;
+
+	float& operator[](FrameStat stat) { return valuesMs[static_cast<uint32_t>(stat)]; }
+	float operator[](FrameStat stat) const { return valuesMs[static_cast<uint32_t>(stat)]; }
+};
+
+
+struct FrameStatPercentiles
+{
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+
+struct FrameStatsSummary
+{
+	uint32_t frameCount = 0;
+	uint32_t hitchCount = 0;
+	std::array<FrameStatPercentiles, FRAME_STAT_COUNT> stats{};
+
+	const FrameStatPercentiles& operator[](FrameStat stat) const { return stats[static_cast<uint32_t>(stat)]; }
+};
+
+
+// Fixed size ring of the last CAPACITY frame samples.
+//
+// One thread pushes, any thread may read. Push never locks, allocates or waits: it writes into a preallocated slot
+// and publishes it with a per-slot sequence number. Readers copy the slots they need and drop the ones the writer
+// overwrote in the meantime.
+//
+// A frame is a hitch if it took more than HITCH_FACTOR times the typical frame time, a moving average of the frames
+// that were not hitches. Frames before the average settled are never hitches.
+class FrameStatsRing
+{
+public:
+	static const uint32_t CAPACITY = 1024;
+	static constexpr double HITCH_FACTOR = 2.0;
+
+	// Only ever from one thread at a time.
+	void Push(FrameSample sample);
+
+	// The last count samples, oldest first. Fewer if there are not as many or they were overwritten while reading.
+	std::vector<FrameSample> GetRecent(uint32_t count) const;
+
+	// Nearest rank percentiles of the last count samples.
+	FrameStatsSummary Summarize(uint32_t count) const;
+
+	uint64_t GetFrameCount() const { return writeCount.load(std::memory_order_acquire); }
+	uint64_t GetHitchCount() const { return hitchCount.load(std::memory_order_relaxed); }
+
+private:
+	// Odd while the slot is written. Even values are 2 * (frame index + 1) of the frame it holds.
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence{ 0 };
+		std::array<std::atomic<float>, FRAME_STAT_COUNT> valuesMs;
+		std::atomic<bool> isHitch{ false };
+	};
+
+	std::array<Slot, CAPACITY> slots;
+	std::atomic<uint64_t> writeCount{ 0 };
+	std::atomic<uint64_t> hitchCount{ 0 };
+
+	// Writer only.
+	double typicalFrameMs = 0.0;
+	uint32_t typicalFrameSamples = 0;
+};
+
+
+// Nearest rank percentiles of values sorted in ascending order. All zero if there are none.
+FrameStatPercentiles GetSortedPercentiles(const std::vector<float>& sortedValues);
+
+// Nearest rank percentiles of any number of samples, for runs longer than the ring.
+FrameStatsSummary SummarizeFrameSamples(const std::vector<FrameSample>& samples);
+
+
+// One line per stat: p50, p95, p99 and max in milliseconds.
+void WriteFrameStatsSummary(std::ostream& stream, const FrameStatsSummary& summary);
@@ -0,0 +1,400 @@
+#include "gpu_allocator.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+
+// One VkDeviceMemory. Either split by the buddy allocator or owned by a single resource (dedicated).
+struct GpuMemoryBlock
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr;
+
+	uint32_t memoryTypeIndex = 0;
+	GpuResourceKind kind = GpuResourceKind::Linear;
+	bool isDedicated = false;
+
+	// Free ranges per order. A range of order k is MIN_ALLOCATION_SIZE << k bytes long and aligned to its size.
+	std::vector<std::set<VkDeviceSize>> freeLists;
+
+	// Order of every allocated range, by offset.
+	std::unordered_map<VkDeviceSize, uint32_t> allocatedOrders;
+
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize reservedBytes = 0;
+};
+
+
+static VkDeviceSize OrderSize(uint32_t order)
+{
+	return GpuAllocator::MIN_ALLOCATION_SIZE << order;
+}
+
+
+// Smallest order whose ranges hold size bytes.
+static uint32_t OrderForSize(VkDeviceSize size)
+{
+	uint32_t order = 0;
+	while (OrderSize(order) < size) {
+		++order;
+	}
+	return order;
+}
+
+
+static bool TryAllocateRange(GpuMemoryBlock& block, uint32_t order, VkDeviceSize& offset)
+{
+	// Take the smallest free range that is large enough.
+	uint32_t freeOrder = order;
+	while (freeOrder < block.freeLists.size() && block.freeLists[freeOrder].empty()) {
+		++freeOrder;
+	}
+	if (freeOrder >= block.freeLists.size()) {
+		return false;
+	}
+
+	offset = *block.freeLists[freeOrder].begin();
+	block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+
+	// Split it in halves until it has the requested size. The upper halves become free.
+	while (freeOrder > order) {
+		--freeOrder;
+		block.freeLists[freeOrder].insert(offset + OrderSize(freeOrder));
+	}
+
+	block.allocatedOrders[offset] = order;
+	block.reservedBytes += OrderSize(order);
+	return true;
+}
+
+
+static void FreeRange(GpuMemoryBlock& block, VkDeviceSize offset)
+{
+	auto allocated = block.allocatedOrders.find(offset);
+	if (allocated == block.allocatedOrders.end()) {
+		throw std::runtime_error("Freeing memory that was not allocated from this block");
+	}
+
+	uint32_t order = allocated->second;
+	block.allocatedOrders.erase(allocated);
+	block.reservedBytes -= OrderSize(order);
+
+	// Merge with the buddy as long as it's free. The buddy of a range differs from it only in the bit of its size.
+	while (order + 1 < block.freeLists.size()) {
+		VkDeviceSize buddy = offset ^ OrderSize(order);
+		auto freeBuddy = block.freeLists[order].find(buddy);
+		if (freeBuddy == block.freeLists[order].end()) {
+			break;
+		}
+
+		block.freeLists[order].erase(freeBuddy);
+		offset = std::min(offset, buddy);
+		++order;
+	}
+
+	block.freeLists[order].insert(offset);
+}
+
+
+GpuAllocator::GpuAllocator() = default;
+GpuAllocator::~GpuAllocator() = default;
+
+
+void GpuAllocator::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize)
+{
+	this->device = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	// Block sizes must be powers of two for the buddy allocator.
+	blockSizes.resize(memoryProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+		VkDeviceSize limit = std::min(blockSize, memoryProperties.memoryHeaps[i].size / 8);
+
+		VkDeviceSize size = MIN_ALLOCATION_SIZE;
+		while (size * 2 <= limit) {
+			size *= 2;
+		}
+		blockSizes[i] = size;
+	}
+
+	pools.resize(memoryProperties.memoryTypeCount * 2);
+}
+
+
+void GpuAllocator::Destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (Pool& pool : pools) {
+		for (auto& block : pool.blocks) {
+			DestroyBlock(*block);
+		}
+	}
+
+	pools.clear();
+}
+
+
+uint32_t GpuAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags requiredProperties, VkMemoryPropertyFlags preferredProperties) const
+{
+	// typeFilter is a bit field of the memory types that are suitable for the resource.
+	// First try to get the preferred properties too, then settle for the required ones.
+	for (VkMemoryPropertyFlags properties : { requiredProperties | preferredProperties, requiredProperties }) {
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return i;
+			}
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type");
+}
+
+
+GpuAllocation GpuAllocator::Allocate(const VkMemoryRequirements& requirements, GpuResourceKind kind,
+	VkMemoryPropertyFlags requiredProperties, VkMemoryPropertyFlags preferredProperties)
+{
+	uint32_t memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, requiredProperties, preferredProperties);
+	VkDeviceSize blockSize = blockSizes[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+
+	std::lock_guard<std::mutex> lock(mutex);
+	Pool& pool = GetPool(memoryTypeIndex, kind);
+
+	GpuMemoryBlock* block = nullptr;
+	VkDeviceSize offset = 0;
+
+	// Ranges are aligned to their size, so a range at least as large as the alignment is always aligned.
+	VkDeviceSize rangeSize = std::max(requirements.size, requirements.alignment);
+
+	if (rangeSize > blockSize) {
+		pool.blocks.push_back(CreateBlock(memoryTypeIndex, kind, requirements.size, true));
+		block = pool.blocks.back().get();
+	}
+	else {
+		uint32_t order = OrderForSize(rangeSize);
+
+		for (auto& candidate : pool.blocks) {
+			if (!candidate->isDedicated && TryAllocateRange(*candidate, order, offset)) {
+				block = candidate.get();
+				break;
+			}
+		}
+
+		if (block == nullptr) {
+			pool.blocks.push_back(CreateBlock(memoryTypeIndex, kind, blockSize, false));
+			block = pool.blocks.back().get();
+
+			if (!TryAllocateRange(*block, order, offset)) {
+				throw std::runtime_error("Failed to sub-allocate from a new memory block");
+			}
+		}
+	}
+
+	block->usedBytes += requirements.size;
+	usedBytes += requirements.size;
+	peakUsedBytes = std::max(peakUsedBytes, usedBytes);
+
+	GpuAllocation allocation;
+	allocation.memory = block->memory;
+	allocation.offset = offset;
+	allocation.size = requirements.size;
+	allocation.mapped = block->mapped != nullptr ? static_cast<char*>(block->mapped) + offset : nullptr;
+	allocation.block = block;
+	return allocation;
+}
+
+
+void GpuAllocator::Free(GpuAllocation& allocation)
+{
+	if (allocation.block == nullptr) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	GpuMemoryBlock* block = allocation.block;
+	block->usedBytes -= allocation.size;
+	usedBytes -= allocation.size;
+
+	if (!block->isDedicated) {
+		FreeRange(*block, allocation.offset);
+	}
+
+	// Empty blocks go back to the driver, but the last sub-allocating block of a pool is kept,
+	// so freeing and allocating a single resource over and over doesn't hit vkAllocateMemory every time.
+	if (block->isDedicated || block->allocatedOrders.empty()) {
+		Pool& pool = GetPool(block->memoryTypeIndex, block->kind);
+		size_t subAllocatingCount = std::count_if(pool.blocks.begin(), pool.blocks.end(),
+			[](const auto& candidate) { return !candidate->isDedicated; });
+
+		if (block->isDedicated || subAllocatingCount > 1) {
+			auto found = std::find_if(pool.blocks.begin(), pool.blocks.end(),
+				[block](const auto& candidate) { return candidate.get() == block; });
+			DestroyBlock(*block);
+			pool.blocks.erase(found);
+		}
+	}
+
+	allocation = GpuAllocation{};
+}
+
+
+VkMemoryPropertyFlags GpuAllocator::GetMemoryProperties(const GpuAllocation& allocation) const
+{
+	// Memory properties don't change after Init, no lock needed.
+	return memoryProperties.memoryTypes[allocation.block->memoryTypeIndex].propertyFlags;
+}
+
+
+VkBuffer GpuAllocator::CreateBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags requiredProperties,
+	VkMemoryPropertyFlags preferredProperties, GpuAllocation& allocation)
+{
+	VkBuffer buffer;
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create buffer");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	allocation = Allocate(memRequirements, GpuResourceKind::Linear, requiredProperties, preferredProperties);
+	vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+
+	return buffer;
+}
+
+
+VkImage GpuAllocator::CreateImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags requiredProperties,
+	VkMemoryPropertyFlags preferredProperties, GpuAllocation& allocation)
+{
+	VkImage image;
+	if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create image");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+	GpuResourceKind kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? GpuResourceKind::Optimal : GpuResourceKind::Linear;
+	allocation = Allocate(memRequirements, kind, requiredProperties, preferredProperties);
+	vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+
+	return image;
+}
+
+
+void GpuAllocator::DestroyBuffer(VkBuffer buffer, GpuAllocation& allocation)
+{
+	vkDestroyBuffer(device, buffer, nullptr);
+	Free(allocation);
+}
+
+
+void GpuAllocator::DestroyImage(VkImage image, GpuAllocation& allocation)
+{
+	vkDestroyImage(device, image, nullptr);
+	Free(allocation);
+}
+
+
+GpuAllocatorStats GpuAllocator::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	GpuAllocatorStats stats;
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFreeRange = 0;
+
+	for (const Pool& pool : pools) {
+		for (const auto& block : pool.blocks) {
+			stats.blockBytes += block->size;
+			++stats.blockCount;
+			stats.usedBytes += block->usedBytes;
+
+			if (block->isDedicated) {
+				stats.reservedBytes += block->size;
+				++stats.allocationCount;
+				continue;
+			}
+
+			stats.reservedBytes += block->reservedBytes;
+			stats.allocationCount += static_cast<uint32_t>(block->allocatedOrders.size());
+			freeBytes += block->size - block->reservedBytes;
+
+			for (uint32_t order = static_cast<uint32_t>(block->freeLists.size()); order-- > 0;) {
+				if (!block->freeLists[order].empty()) {
+					largestFreeRange = std::max(largestFreeRange, OrderSize(order));
+					break;
+				}
+			}
+		}
+	}
+
+	if (freeBytes > 0) {
+		stats.fragmentation = 1.0 - double(largestFreeRange) / double(freeBytes);
+	}
+
+	stats.peakBlockBytes = peakBlockBytes;
+	stats.peakUsedBytes = peakUsedBytes;
+
+	return stats;
+}
+
+
+std::unique_ptr<GpuMemoryBlock> GpuAllocator::CreateBlock(uint32_t memoryTypeIndex, GpuResourceKind kind, VkDeviceSize size, bool isDedicated)
+{
+	auto block = std::make_unique<GpuMemoryBlock>();
+	block->size = size;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->kind = kind;
+	block->isDedicated = isDedicated;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate device memory block");
+	}
+
+	blockBytes += size;
+	peakBlockBytes = std::max(peakBlockBytes, blockBytes);
+
+	// Mapping is expensive on some platforms, so host visible blocks are mapped once and stay mapped.
+	if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+			vkFreeMemory(device, block->memory, nullptr);
+			throw std::runtime_error("Failed to map device memory block");
+		}
+	}
+
+	if (!isDedicated) {
+		// The whole block starts as a single free range of the highest order.
+		uint32_t maxOrder = OrderForSize(size);
+		block->freeLists.resize(maxOrder + 1);
+		block->freeLists[maxOrder].insert(0);
+	}
+
+	return block;
+}
+
+
+void GpuAllocator::DestroyBlock(GpuMemoryBlock& block)
+{
+	if (block.mapped != nullptr) {
+		vkUnmapMemory(device, block.memory);
+	}
+	vkFreeMemory(device, block.memory, nullptr);
+
+	blockBytes -= block.size;
+}
+
+
+GpuAllocator::Pool& GpuAllocator::GetPool(uint32_t memoryTypeIndex, GpuResourceKind kind)
+{
+	return pools[memoryTypeIndex * 2 + (kind == GpuResourceKind::Optimal ? 1 : 0)];
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+struct GpuMemoryBlock;
+
+
+// Buffers and images with linear layout vs. images with optimal tiling. Neighbors of different kinds must be
+// bufferImageGranularity apart, so they never share a block.
+enum class GpuResourceKind
+{
+	Linear,
+	Optimal
+};
+
+
+// A range of device memory handed out by GpuAllocator.
+struct GpuAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+
+	// Points to offset if the memory is host visible, otherwise null. Blocks stay mapped for their whole lifetime.
+	void* mapped = nullptr;
+
+	// Owner of the range, used by Free().
+	GpuMemoryBlock* block = nullptr;
+};
+
+
+struct GpuAllocatorStats
+{
+	// Memory allocated from the driver, and the number of vkAllocateMemory calls it took.
+	VkDeviceSize blockBytes = 0;
+	uint32_t blockCount = 0;
+
+	// Sizes requested by the resources.
+	VkDeviceSize usedBytes = 0;
+	uint32_t allocationCount = 0;
+
+	// Requested sizes rounded up to the buddy sizes. reservedBytes - usedBytes is lost to rounding.
+	VkDeviceSize reservedBytes = 0;
+
+	// 1 - largest free range / total free memory. Zero means all free memory is usable for one big allocation.
+	double fragmentation = 0.0;
+
+	// Highest blockBytes and usedBytes since Init.
+	VkDeviceSize peakBlockBytes = 0;
+	VkDeviceSize peakUsedBytes = 0;
+};
+
+
+// Sub-allocates resources from large VkDeviceMemory blocks, so the number of vkAllocateMemory calls stays far
+// below maxMemoryAllocationCount (as low as 4096 on some drivers) and allocating a resource doesn't go to the driver.
+//
+// Blocks are grouped by memory type and resource kind. Each block is a buddy allocator: ranges are powers of two
+// and aligned to their size, so every alignment up to the range size is satisfied for free and freed neighbors merge
+// back in O(log n). Resources larger than a block get a dedicated allocation.
+class GpuAllocator
+{
+public:
+	static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+	// Smallest range handed out. Smaller requests are rounded up to it.
+	static const VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+
+	// Defined where GpuMemoryBlock is complete.
+	GpuAllocator();
+	~GpuAllocator();
+
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+
+	// All allocations must have been freed before.
+	void Destroy();
+
+	// Picks a memory type with all of the required properties, preferably also with the preferred ones.
+	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags requiredProperties, VkMemoryPropertyFlags preferredProperties = 0) const;
+
+	GpuAllocation Allocate(const VkMemoryRequirements& requirements, GpuResourceKind kind,
+		VkMemoryPropertyFlags requiredProperties, VkMemoryPropertyFlags preferredProperties = 0);
+	void Free(GpuAllocation& allocation);
+
+	// Properties of the memory type the allocation was made from.
+	VkMemoryPropertyFlags GetMemoryProperties(const GpuAllocation& allocation) const;
+
+	// Create the resource, allocate memory for it and bind it.
+	VkBuffer CreateBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags requiredProperties,
+		VkMemoryPropertyFlags preferredProperties, GpuAllocation& allocation);
+	VkImage CreateImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags requiredProperties,
+		VkMemoryPropertyFlags preferredProperties, GpuAllocation& allocation);
+
+	void DestroyBuffer(VkBuffer buffer, GpuAllocation& allocation);
+	void DestroyImage(VkImage image, GpuAllocation& allocation);
+
+	GpuAllocatorStats GetStats() const;
+
+private:
+	struct Pool
+	{
+		std::vector<std::unique_ptr<GpuMemoryBlock>> blocks;
+	};
+
+	std::unique_ptr<GpuMemoryBlock> CreateBlock(uint32_t memoryTypeIndex, GpuResourceKind kind, VkDeviceSize size, bool isDedicated);
+	void DestroyBlock(GpuMemoryBlock& block);
+	Pool& GetPool(uint32_t memoryTypeIndex, GpuResourceKind kind);
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+
+	// Per memory heap, a block never takes more than an eighth of a small heap.
+	std::vector<VkDeviceSize> blockSizes;
+
+	// One pool per (memory type, resource kind).
+	std::vector<Pool> pools;
+
+	// Running totals of all blocks, for the peaks in GpuAllocatorStats.
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize peakBlockBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize peakUsedBytes = 0;
+
+	// Resources may be created from several threads.
+	mutable std::mutex mutex;
+};
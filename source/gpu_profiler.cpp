@@ -0,0 +1,397 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+
+#include "json.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+
+static int64_t ToNanoseconds(std::chrono::steady_clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+
+void GpuProfiler::Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex,
+	uint32_t frameSlotCount, bool calibratedTimestamps, bool tracing)
+{
+	this->device = device;
+	this->tracing = tracing;
+	epoch = std::chrono::steady_clock::now();
+
+	// The thread that initializes the profiler is the first CPU track.
+	tracksByThread[std::this_thread::get_id()] = 1;
+
+	// Timestamps are only usable if the queue family writes valid bits into them.
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyList.data());
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilyList[queueFamilyIndex].timestampValidBits : 0;
+	if (validBits > 0) {
+		timestampPeriod = deviceProperties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? UINT64_MAX : ((uint64_t(1) << validBits) - 1);
+	}
+
+	if (calibratedTimestamps && timestampPeriod > 0.0) {
+		// The host domain steady_clock is built on: QueryPerformanceCounter with MSVC, CLOCK_MONOTONIC with libstdc++ and libc++.
+#ifdef _WIN32
+		VkTimeDomainEXT steadyClockDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+		VkTimeDomainEXT steadyClockDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+		auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+			vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+
+		uint32_t domainCount = 0;
+		if (getTimeDomains != nullptr) {
+			getTimeDomains(physicalDevice, &domainCount, nullptr);
+		}
+
+		std::vector<VkTimeDomainEXT> domains(domainCount);
+		if (domainCount > 0) {
+			getTimeDomains(physicalDevice, &domainCount, domains.data());
+		}
+
+		bool hasDeviceDomain = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+		bool hasSteadyClockDomain = std::find(domains.begin(), domains.end(), steadyClockDomain) != domains.end();
+
+		if (hasDeviceDomain && hasSteadyClockDomain) {
+			hostTimeDomain = steadyClockDomain;
+			vkGetCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+				vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT"));
+		}
+	}
+
+	frameSlots.resize(frameSlotCount);
+
+	if (timestampPeriod == 0.0) {
+		return;
+	}
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = MAX_SCOPES_PER_FRAME * 2;
+
+	for (FrameSlot& slot : frameSlots) {
+		if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &slot.queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create profiler query pool");
+		}
+	}
+}
+
+
+void GpuProfiler::Destroy()
+{
+	for (FrameSlot& slot : frameSlots) {
+		if (slot.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, slot.queryPool, nullptr);
+		}
+	}
+
+	frameSlots.clear();
+	gpuSums.clear();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	events.clear();
+	tracksByThread.clear();
+}
+
+
+void GpuProfiler::BeginFrame(uint32_t frameSlot)
+{
+	currentSlot = frameSlot;
+
+	FrameSlot& slot = frameSlots[currentSlot];
+	Collect(slot);
+
+	slot.scopeNames.clear();
+	slot.frameNumber = frameNumber;
+}
+
+
+void GpuProfiler::CmdBeginFrame(VkCommandBuffer commandBuffer)
+{
+	FrameSlot& slot = frameSlots[currentSlot];
+	if (slot.queryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Queries must be reset before they are written again.
+	vkCmdResetQueryPool(commandBuffer, slot.queryPool, 0, MAX_SCOPES_PER_FRAME * 2);
+}
+
+
+uint32_t GpuProfiler::CmdBeginScope(VkCommandBuffer commandBuffer, const char* name)
+{
+	FrameSlot& slot = frameSlots[currentSlot];
+	if (slot.queryPool == VK_NULL_HANDLE || slot.scopeNames.size() == MAX_SCOPES_PER_FRAME) {
+		return INVALID_SCOPE;
+	}
+
+	uint32_t scope = static_cast<uint32_t>(slot.scopeNames.size());
+	slot.scopeNames.push_back(name);
+
+	// Written as soon as the commands before it have started.
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.queryPool, scope * 2);
+	return scope;
+}
+
+
+void GpuProfiler::CmdEndScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	FrameSlot& slot = frameSlots[currentSlot];
+	if (scope == INVALID_SCOPE || slot.queryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Written once all previous commands have completed.
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.queryPool, scope * 2 + 1);
+}
+
+
+void GpuProfiler::EndFrame()
+{
+	FrameSlot& slot = frameSlots[currentSlot];
+	slot.submitTime = std::chrono::steady_clock::now();
+	slot.isPending = true;
+
+	++frameNumber;
+}
+
+
+void GpuProfiler::CollectAll()
+{
+	for (FrameSlot& slot : frameSlots) {
+		Collect(slot);
+	}
+}
+
+
+void GpuProfiler::AddCpuScope(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	if (!tracing) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto found = tracksByThread.find(std::this_thread::get_id());
+	if (found == tracksByThread.end()) {
+		uint32_t track = static_cast<uint32_t>(tracksByThread.size()) + 1;
+		found = tracksByThread.emplace(std::this_thread::get_id(), track).first;
+	}
+
+	ProfileEvent event;
+	event.name = name;
+	event.track = found->second;
+	event.frameNumber = frameNumber;
+	event.startUs = ToMicroseconds(start);
+	event.durationUs = std::chrono::duration<double, std::micro>(end - start).count();
+	AddEvent(event);
+}
+
+
+std::vector<GpuScopeTiming> GpuProfiler::GetGpuAverages() const
+{
+	std::vector<GpuScopeTiming> averages;
+
+	for (const ScopeSum& sum : gpuSums) {
+		if (sum.count > 0) {
+			averages.push_back({ sum.name, sum.sumMs / sum.count });
+		}
+	}
+
+	return averages;
+}
+
+
+void GpuProfiler::ResetAverages()
+{
+	// The names stay, so the scopes are reported in the same order every time.
+	for (ScopeSum& sum : gpuSums) {
+		sum.sumMs = 0.0;
+		sum.count = 0;
+	}
+}
+
+
+size_t GpuProfiler::GetDroppedEventCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return droppedEventCount;
+}
+
+
+void GpuProfiler::WriteChromeTrace(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + path);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	// Metadata events name the tracks. The GPU goes first, then the CPU threads in order.
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+
+	std::map<uint32_t, std::thread::id> threadsByTrack;
+	for (const auto& [thread, track] : tracksByThread) {
+		threadsByTrack[track] = thread;
+	}
+	for (const auto& [track, thread] : threadsByTrack) {
+		std::string name = track == 1 ? "CPU main" : "CPU " + std::to_string(track);
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":";
+		WriteJsonString(file, name);
+		file << "}}";
+	}
+
+	// Complete events, with start and duration in microseconds.
+	file << std::fixed << std::setprecision(3);
+	for (const ProfileEvent& event : events) {
+		file << ",\n{\"name\":";
+		WriteJsonString(file, event.name);
+		file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs
+			<< ",\"args\":{\"frame\":" << event.frameNumber << "}}";
+	}
+
+	file << "\n]}\n";
+
+	if (!file.good()) {
+		throw std::runtime_error("Failed to write " + path);
+	}
+}
+
+
+void GpuProfiler::Collect(FrameSlot& slot)
+{
+	if (!slot.isPending) {
+		return;
+	}
+	slot.isPending = false;
+
+	if (slot.queryPool == VK_NULL_HANDLE || slot.scopeNames.empty()) {
+		return;
+	}
+
+	// The submission is known to be complete, so there is no need for VK_QUERY_RESULT_WAIT_BIT.
+	uint32_t queryCount = static_cast<uint32_t>(slot.scopeNames.size()) * 2;
+	std::vector<uint64_t> timestamps(queryCount);
+	VkResult result = vkGetQueryPoolResults(device, slot.queryPool, 0, queryCount, timestamps.size() * sizeof(uint64_t),
+		timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+	if (result != VK_SUCCESS) {
+		return;
+	}
+
+	// A tick and the steady_clock time it corresponds to. Uncalibrated, the first scope starts at submission.
+	uint64_t baseTick = timestamps[0];
+	int64_t baseNs = ToNanoseconds(slot.submitTime);
+	if (Calibrate()) {
+		baseTick = calibrationTick;
+		baseNs = calibrationNs;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (size_t i = 0; i < slot.scopeNames.size(); ++i) {
+		const char* name = slot.scopeNames[i];
+		uint64_t beginTick = timestamps[i * 2];
+		uint64_t endTick = timestamps[i * 2 + 1];
+
+		double durationNs = ((endTick - beginTick) & timestampMask) * timestampPeriod;
+
+		auto sum = std::find_if(gpuSums.begin(), gpuSums.end(), [name](const ScopeSum& s) { return std::strcmp(s.name, name) == 0; });
+		if (sum == gpuSums.end()) {
+			sum = gpuSums.insert(gpuSums.end(), ScopeSum{ name });
+		}
+		sum->sumMs += durationNs / 1e6;
+		++sum->count;
+
+		if (!tracing) {
+			continue;
+		}
+
+		// The calibration is taken after the frame, so most ticks are before it. They wrap around to the top of the valid bits.
+		uint64_t delta = (beginTick - baseTick) & timestampMask;
+		double deltaTicks = delta > timestampMask / 2 ? -static_cast<double>(timestampMask - delta + 1) : static_cast<double>(delta);
+		double beginNs = baseNs + deltaTicks * timestampPeriod;
+
+		ProfileEvent event;
+		event.name = name;
+		event.track = 0;
+		event.frameNumber = slot.frameNumber;
+		event.startUs = (beginNs - ToNanoseconds(epoch)) / 1e3;
+		event.durationUs = durationNs / 1e3;
+		AddEvent(event);
+	}
+}
+
+
+bool GpuProfiler::Calibrate()
+{
+	if (vkGetCalibratedTimestamps == nullptr) {
+		return false;
+	}
+
+	VkCalibratedTimestampInfoEXT timestampInfos[2]{};
+	timestampInfos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	timestampInfos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+	timestampInfos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	timestampInfos[1].timeDomain = hostTimeDomain;
+
+	uint64_t timestamps[2] = {};
+	uint64_t maxDeviation = 0;
+	if (vkGetCalibratedTimestamps(device, 2, timestampInfos, timestamps, &maxDeviation) != VK_SUCCESS) {
+		return false;
+	}
+
+	calibrationTick = timestamps[0];
+
+#ifdef _WIN32
+	// Performance counter ticks, the same steady_clock counts in.
+	LARGE_INTEGER frequency{};
+	QueryPerformanceFrequency(&frequency);
+	calibrationNs = static_cast<int64_t>(timestamps[1] * (1e9 / frequency.QuadPart));
+#else
+	calibrationNs = static_cast<int64_t>(timestamps[1]);
+#endif
+
+	return true;
+}
+
+
+double GpuProfiler::ToMicroseconds(std::chrono::steady_clock::time_point time) const
+{
+	return std::chrono::duration<double, std::micro>(time - epoch).count();
+}
+
+
+void GpuProfiler::AddEvent(const ProfileEvent& event)
+{
+	if (events.size() >= MAX_TRACE_EVENTS) {
+		++droppedEventCount;
+		return;
+	}
+
+	events.push_back(event);
+}
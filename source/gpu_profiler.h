@@ -0,0 +1,167 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+// A finished CPU or GPU scope, in microseconds since GpuProfiler::Init.
+struct ProfileEvent
+{
+	const char* name = nullptr;
+
+	// 0 is the GPU queue. CPU threads are numbered from 1, in the order they first recorded a scope.
+	uint32_t track = 0;
+
+	uint64_t frameNumber = 0;
+	double startUs = 0.0;
+	double durationUs = 0.0;
+};
+
+
+// Average GPU time of the scopes with one name since the last GpuProfiler::ResetAverages().
+struct GpuScopeTiming
+{
+	const char* name = nullptr;
+	double averageMs = 0.0;
+};
+
+
+// Measures named scopes on the GPU with timestamp queries and on the CPU with steady_clock, on one timeline.
+//
+// GPU scopes are pairs of vkCmdWriteTimestamp in the command buffer of a frame. Every frame slot has its own query pool,
+// read back when the slot comes around again: its last frame has been waited for by then, so the results are there without
+// stalling. Ticks are converted with timestampPeriod. With VK_EXT_calibrated_timestamps the GPU scopes are placed
+// exactly on the CPU timeline. Without it the GPU is assumed to start a frame the moment it was submitted, which is
+// only a lower bound, the real start may be later.
+//
+// Scope names are not copied, they must be string literals or outlive the profiler.
+// With tracing every event is kept for WriteChromeTrace(), up to MAX_TRACE_EVENTS. Without it only the GPU averages are.
+class GpuProfiler
+{
+public:
+	static const uint32_t MAX_SCOPES_PER_FRAME = 32;
+	static const size_t MAX_TRACE_EVENTS = 1 << 20;
+	static const uint32_t INVALID_SCOPE = UINT32_MAX;
+
+	// calibratedTimestamps: VK_EXT_calibrated_timestamps is enabled on the device.
+	void Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex,
+		uint32_t frameSlotCount, bool calibratedTimestamps, bool tracing);
+	void Destroy();
+
+	// After the last frame of the frame slot has been waited for. Collects the scopes the slot recorded the last time.
+	void BeginFrame(uint32_t frameSlot);
+
+	// First command of the frame, outside of a render pass. Resets the queries of the slot.
+	void CmdBeginFrame(VkCommandBuffer commandBuffer);
+
+	// Returns the scope to end, INVALID_SCOPE if the frame has no queries left. Scopes may nest and may be inside
+	// render passes, but must be ended in the command buffer they were begun in.
+	uint32_t CmdBeginScope(VkCommandBuffer commandBuffer, const char* name);
+	void CmdEndScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	// Right after the frame was submitted.
+	void EndFrame();
+
+	// Collects the scopes of all frame slots. The device must be idle.
+	void CollectAll();
+
+	// Thread safe. Ignored unless tracing.
+	void AddCpuScope(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+	std::vector<GpuScopeTiming> GetGpuAverages() const;
+	void ResetAverages();
+
+	bool IsGpuTimingSupported() const { return timestampPeriod > 0.0; }
+	bool IsCalibrated() const { return vkGetCalibratedTimestamps != nullptr; }
+	bool IsTracing() const { return tracing; }
+	size_t GetDroppedEventCount() const;
+
+	// Chrome trace event format, can be opened in chrome://tracing or ui.perfetto.dev.
+	void WriteChromeTrace(const std::string& path) const;
+
+private:
+	struct FrameSlot
+	{
+		// Two queries per scope, begin and end.
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		std::vector<const char*> scopeNames;
+
+		uint64_t frameNumber = 0;
+		std::chrono::steady_clock::time_point submitTime;
+		bool isPending = false;
+	};
+
+	struct ScopeSum
+	{
+		const char* name = nullptr;
+		double sumMs = 0.0;
+		uint64_t count = 0;
+	};
+
+	void Collect(FrameSlot& slot);
+	bool Calibrate();
+	double ToMicroseconds(std::chrono::steady_clock::time_point time) const;
+	// Expects the mutex to be held.
+	void AddEvent(const ProfileEvent& event);
+
+	VkDevice device = VK_NULL_HANDLE;
+
+	std::vector<FrameSlot> frameSlots;
+	uint32_t currentSlot = 0;
+	uint64_t frameNumber = 0;
+
+	// Nanoseconds per timestamp tick. Zero if the queue doesn't support timestamps.
+	double timestampPeriod = 0.0;
+	uint64_t timestampMask = 0;
+
+	// Null without VK_EXT_calibrated_timestamps, or if the device and steady_clock don't share a calibrateable domain.
+	PFN_vkGetCalibratedTimestampsEXT vkGetCalibratedTimestamps = nullptr;
+	VkTimeDomainEXT hostTimeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+
+	// A GPU tick and the steady_clock time at the same moment, renewed with every collected frame against drift.
+	uint64_t calibrationTick = 0;
+	int64_t calibrationNs = 0;
+
+	// Every time is relative to this.
+	std::chrono::steady_clock::time_point epoch;
+
+	std::vector<ScopeSum> gpuSums;
+
+	bool tracing = false;
+
+	mutable std::mutex mutex;
+	std::vector<ProfileEvent> events;
+	std::unordered_map<std::thread::id, uint32_t> tracksByThread;
+	size_t droppedEventCount = 0;
+};
+
+
+// Adds a CPU scope from construction to destruction.
+class CpuProfileScope
+{
+public:
+	CpuProfileScope(GpuProfiler& profiler, const char* name)
+		: profiler(profiler), name(name), start(std::chrono::steady_clock::now())
+	{
+	}
+
+	~CpuProfileScope()
+	{
+		profiler.AddCpuScope(name, start, std::chrono::steady_clock::now());
+	}
+
+	CpuProfileScope(const CpuProfileScope&) = delete;
+	CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+private:
+	GpuProfiler& profiler;
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+// FNV-1a, 64 bit. Fast and good enough to detect corrupted data and to key lookup tables.
+// Pass the result of a previous call as hash to continue hashing where it left off.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+
+// Accumulates values into one hash. Values are hashed by their bytes, so structs must not contain padding
+// or pointers. Hash the fields one by one instead.
+class Hasher
+{
+public:
+	template<typename T>
+	void Add(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be hashed by their bytes");
+		hash = HashBytes(&value, sizeof(value), hash);
+	}
+
+	template<typename T>
+	void Add(const std::vector<T>& values)
+	{
+		Add(values.size());
+		for (const T& value : values) {
+			Add(value);
+		}
+	}
+
+	void Add(const std::string& value)
+	{
+		Add(value.size());
+		hash = HashBytes(value.data(), value.size(), hash);
+	}
+
+	uint64_t Get() const { return hash; }
+
+private:
+	uint64_t hash = HashBytes(nullptr, 0);
+};
@@ -0,0 +1,111 @@
+#include "job_system.h"
+
+#include <exception>
+
+
+void JobSystem::Init(uint32_t workerCount)
+{
+	isStopping = false;
+
+	for (uint32_t i = 0; i < workerCount; ++i) {
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+
+void JobSystem::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		isStopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	workers.clear();
+}
+
+
+void JobSystem::Submit(std::function<void(uint32_t workerIndex)> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		tasks.push_back(std::move(task));
+	}
+	taskAvailable.notify_one();
+}
+
+
+void JobSystem::Dispatch(uint32_t jobCount, const std::function<void(uint32_t jobIndex, uint32_t workerIndex)>& job)
+{
+	if (workers.empty()) {
+		for (uint32_t i = 0; i < jobCount; ++i) {
+			job(i, 0);
+		}
+		return;
+	}
+
+	// Lives on this stack frame. That is safe, because the function only returns once every job has finished with it.
+	struct Batch
+	{
+		std::mutex mutex;
+		std::condition_variable done;
+		uint32_t remainingJobs = 0;
+		std::exception_ptr error;
+	} batch;
+
+	batch.remainingJobs = jobCount;
+
+	for (uint32_t i = 0; i < jobCount; ++i) {
+		Submit([&batch, &job, i](uint32_t workerIndex) {
+			std::exception_ptr error;
+			try {
+				job(i, workerIndex);
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+
+			// Notify while holding the lock, otherwise the batch could be gone before notify_all returns.
+			std::lock_guard<std::mutex> lock(batch.mutex);
+			if (error && !batch.error) {
+				batch.error = error;
+			}
+			if (--batch.remainingJobs == 0) {
+				batch.done.notify_all();
+			}
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(batch.mutex);
+	batch.done.wait(lock, [&batch] { return batch.remainingJobs == 0; });
+
+	if (batch.error) {
+		std::rethrow_exception(batch.error);
+	}
+}
+
+
+void JobSystem::WorkerLoop(uint32_t workerIndex)
+{
+	while (true) {
+		std::function<void(uint32_t)> task;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			taskAvailable.wait(lock, [this] { return isStopping || !tasks.empty(); });
+
+			// Stop only once the queue is drained, so no submitted task is lost.
+			if (tasks.empty()) {
+				return;
+			}
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+
+		task(workerIndex);
+	}
+}
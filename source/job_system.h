@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed pool of worker threads that run tasks from a shared queue.
+// Every task gets the index of the worker that runs it, so it can use per-thread resources (like command pools)
+// without locking. Worker indices are in the range [0, GetWorkerCount()).
+class JobSystem
+{
+public:
+	// Zero workers is valid, Dispatch then runs all jobs on the calling thread.
+	void Init(uint32_t workerCount);
+
+	// Runs the tasks left in the queue and joins the workers.
+	void Destroy();
+
+	uint32_t GetWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	// Queues a task and returns right away.
+	void Submit(std::function<void(uint32_t workerIndex)> task);
+
+	// Runs job(jobIndex, workerIndex) for every jobIndex in [0, jobCount) and waits until all of them are done.
+	// The first exception thrown by a job is rethrown here.
+	void Dispatch(uint32_t jobCount, const std::function<void(uint32_t jobIndex, uint32_t workerIndex)>& job);
+
+private:
+	void WorkerLoop(uint32_t workerIndex);
+
+	std::vector<std::thread> workers;
+
+	std::mutex queueMutex;
+	std::condition_variable taskAvailable;
+	std::deque<std::function<void(uint32_t)>> tasks;
+	bool isStopping = false;
+};
@@ -0,0 +1,37 @@
+#include "json.h"
+
+
+void WriteJsonString(std::ostream& stream, std::string_view text)
+{
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+
+	stream << '"';
+	for (char c : text) {
+		switch (c) {
+		case '"':
+			stream << "\\\"";
+			break;
+		case '\\':
+			stream << "\\\\";
+			break;
+		case '\n':
+			stream << "\\n";
+			break;
+		case '\r':
+			stream << "\\r";
+			break;
+		case '\t':
+			stream << "\\t";
+			break;
+		default:
+			// JSON strings can't contain the other control characters either.
+			if (static_cast<unsigned char>(c) < 0x20) {
+				stream << "\\u00" << HEX_DIGITS[(c >> 4) & 0xf] << HEX_DIGITS[c & 0xf];
+			}
+			else {
+				stream << c;
+			}
+		}
+	}
+	stream << '"';
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <ostream>
+#include <string_view>
+
+
+// Writes text as a quoted JSON string. Quotes, backslashes and control characters are escaped, other bytes are
+// written as they are, so UTF-8 text stays valid.
+void WriteJsonString(std::ostream& stream, std::string_view text);
@@ -0,0 +1,19 @@
+#include "multisampling.h"
+
+
+VkSampleCountFlagBits SelectSampleCount(VkPhysicalDevice physicalDevice, uint32_t requestedSamples)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	// Both attachments of the subpass must have the same count. Every device supports 1 and 4.
+	VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+
+	// Sample count flags are the counts themselves, so the first supported bit at or below the request wins.
+	for (uint32_t samples = requestedSamples; samples > 1; samples >>= 1) {
+		if (supported & samples) {
+			return static_cast<VkSampleCountFlagBits>(samples);
+		}
+	}
+	return VK_SAMPLE_COUNT_1_BIT;
+}
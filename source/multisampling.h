@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+
+// The highest sample count up to requestedSamples that the device supports for both the color and the depth
+// attachments of a framebuffer. requestedSamples is a power of two, 1 turns multisampling off.
+VkSampleCountFlagBits SelectSampleCount(VkPhysicalDevice physicalDevice, uint32_t requestedSamples);
@@ -0,0 +1,219 @@
+#include "pipeline_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "hash.h"
+
+
+// Written in front of the driver's blob. The driver's own header (VkPipelineCacheHeaderVersionOne)
+// has no driver version, but a driver update usually invalidates the cache as well.
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t fileVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+static const uint32_t PIPELINE_CACHE_FILE_MAGIC = 0x43505456; // "VTPC"
+static const uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+
+void PipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path)
+{
+	this->device = device;
+	this->path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	std::vector<char> blob = LoadValidatedBlob();
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = blob.size();
+	cacheInfo.pInitialData = blob.empty() ? nullptr : blob.data();
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline cache");
+	}
+
+	isWarm = !blob.empty();
+	loadedSize = blob.size();
+}
+
+
+void PipelineCache::Save()
+{
+	if (path.empty() || pipelineCache == VK_NULL_HANDLE) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(workerCachesMutex);
+		if (!workerCaches.empty()) {
+			vkMergePipelineCaches(device, pipelineCache, static_cast<uint32_t>(workerCaches.size()), workerCaches.data());
+		}
+	}
+
+	// First call returns the size, second call the data.
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+		return;
+	}
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+		std::cerr << "Failed to read pipeline cache data" << std::endl;
+		return;
+	}
+	data.resize(dataSize);
+
+	PipelineCacheFileHeader header{};
+	header.magic = PIPELINE_CACHE_FILE_MAGIC;
+	header.fileVersion = PIPELINE_CACHE_FILE_VERSION;
+	header.vendorID = deviceProperties.vendorID;
+	header.deviceID = deviceProperties.deviceID;
+	header.driverVersion = deviceProperties.driverVersion;
+	std::memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = data.size();
+	header.dataHash = HashBytes(data.data(), data.size());
+
+	// Write next to the target and rename over it. Rename replaces the old file in one step.
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "Failed to open " << tempPath << " for writing" << std::endl;
+			return;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), data.size());
+
+		if (!file.good()) {
+			std::cerr << "Failed to write " << tempPath << std::endl;
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error) {
+		std::cerr << "Failed to replace " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(tempPath, error);
+	}
+}
+
+
+void PipelineCache::Destroy()
+{
+	for (VkPipelineCache workerCache : workerCaches) {
+		vkDestroyPipelineCache(device, workerCache, nullptr);
+	}
+	workerCaches.clear();
+
+	if (pipelineCache != VK_NULL_HANDLE) {
+		vkDestroyPipelineCache(device, pipelineCache, nullptr);
+		pipelineCache = VK_NULL_HANDLE;
+	}
+}
+
+
+VkPipelineCache PipelineCache::CreateWorkerCache()
+{
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	VkPipelineCache workerCache;
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &workerCache) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create worker pipeline cache");
+	}
+
+	std::lock_guard<std::mutex> lock(workerCachesMutex);
+	workerCaches.push_back(workerCache);
+
+	return workerCache;
+}
+
+
+std::vector<char> PipelineCache::LoadValidatedBlob()
+{
+	if (path.empty()) {
+		return {};
+	}
+
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		return {};
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize < sizeof(PipelineCacheFileHeader)) {
+		std::cout << "Pipeline cache " << path << " is truncated, starting cold" << std::endl;
+		return {};
+	}
+
+	PipelineCacheFileHeader header;
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	std::vector<char> blob(fileSize - sizeof(header));
+	file.read(blob.data(), blob.size());
+
+	std::string reason;
+	if (header.magic != PIPELINE_CACHE_FILE_MAGIC || header.fileVersion != PIPELINE_CACHE_FILE_VERSION) {
+		reason = "unknown file format";
+	}
+	else if (header.vendorID != deviceProperties.vendorID || header.deviceID != deviceProperties.deviceID) {
+		reason = "created on another device";
+	}
+	else if (header.driverVersion != deviceProperties.driverVersion) {
+		reason = "created with another driver version";
+	}
+	else if (std::memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		reason = "pipeline cache UUID does not match";
+	}
+	else if (header.dataSize != blob.size() || header.dataHash != HashBytes(blob.data(), blob.size())) {
+		reason = "data is corrupted";
+	}
+	else {
+		IsBlobCompatible(blob, reason);
+	}
+
+	if (!reason.empty()) {
+		std::cout << "Pipeline cache " << path << " discarded (" << reason << "), starting cold" << std::endl;
+		return {};
+	}
+
+	return blob;
+}
+
+
+bool PipelineCache::IsBlobCompatible(const std::vector<char>& blob, std::string& reason) const
+{
+	// The driver validates its own header too, but checking it here gives a readable reason.
+	VkPipelineCacheHeaderVersionOne driverHeader;
+	if (blob.size() < sizeof(driverHeader)) {
+		reason = "driver header is truncated";
+		return false;
+	}
+	std::memcpy(&driverHeader, blob.data(), sizeof(driverHeader));
+
+	if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		driverHeader.vendorID != deviceProperties.vendorID ||
+		driverHeader.deviceID != deviceProperties.deviceID ||
+		std::memcmp(driverHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+
+		reason = "driver header does not match the device";
+		return false;
+	}
+
+	return true;
+}
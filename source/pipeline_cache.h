@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// VkPipelineCache that survives application restarts.
+// The driver compiles SPIR-V into GPU code when a pipeline is created. The cache stores the result, so the second launch
+// skips the compilation. The blob is only valid for the same GPU and driver, that's why it's stored behind a header
+// with the vendor, device, driver version and pipelineCacheUUID. A blob from another device/driver is discarded.
+class PipelineCache
+{
+public:
+	// Loads the blob from path if it's valid for this device. An empty path disables loading and saving.
+	void Init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+
+	// Merges the worker caches and writes the blob back. The file is replaced atomically,
+	// so a crash in the middle of writing never leaves a truncated cache behind.
+	void Save();
+
+	void Destroy();
+
+	VkPipelineCache Get() const { return pipelineCache; }
+
+	// Separate cache for a thread that creates pipelines in parallel. It avoids contention on the main cache
+	// and is merged into it on Save(). Owned by PipelineCache.
+	VkPipelineCache CreateWorkerCache();
+
+	// True if a valid blob was loaded from disk.
+	bool IsWarm() const { return isWarm; }
+	size_t GetLoadedSize() const { return loadedSize; }
+
+private:
+	std::vector<char> LoadValidatedBlob();
+	bool IsBlobCompatible(const std::vector<char>& blob, std::string& reason) const;
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties deviceProperties{};
+
+	std::string path;
+
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	// Worker caches may be created from several threads.
+	std::mutex workerCachesMutex;
+	std::vector<VkPipelineCache> workerCaches;
+
+
+	bool isWarm = false;
+	size_t loadedSize = 0;
+};
@@ -0,0 +1,353 @@
+#include "pipeline_library.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "dynamic_state.h"
+#include "hash.h"
+
+
+uint64_t HashRenderPassCompatibility(const VkRenderPassCreateInfo& renderPassInfo)
+{
+	Hasher hasher;
+
+	hasher.Add(renderPassInfo.attachmentCount);
+	for (uint32_t i = 0; i < renderPassInfo.attachmentCount; ++i) {
+		hasher.Add(renderPassInfo.pAttachments[i].format);
+		hasher.Add(renderPassInfo.pAttachments[i].samples);
+	}
+
+	auto addReferences = [&hasher](uint32_t count, const VkAttachmentReference* references) {
+		hasher.Add(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			hasher.Add(references[i].attachment);
+		}
+	};
+
+	hasher.Add(renderPassInfo.subpassCount);
+	for (uint32_t i = 0; i < renderPassInfo.subpassCount; ++i) {
+		const VkSubpassDescription& subpass = renderPassInfo.pSubpasses[i];
+
+		hasher.Add(subpass.pipelineBindPoint);
+		addReferences(subpass.inputAttachmentCount, subpass.pInputAttachments);
+		addReferences(subpass.colorAttachmentCount, subpass.pColorAttachments);
+		addReferences(subpass.pResolveAttachments != nullptr ? subpass.colorAttachmentCount : 0, subpass.pResolveAttachments);
+		addReferences(subpass.pDepthStencilAttachment != nullptr ? 1 : 0, subpass.pDepthStencilAttachment);
+	}
+
+	return hasher.Get();
+}
+
+
+uint64_t HashGraphicsPipelineDesc(const GraphicsPipelineDesc& desc)
+{
+	// Field by field: the create info structs contain padding and pointers.
+	Hasher hasher;
+
+	hasher.Add(desc.stages.size());
+	for (const PipelineShaderStage& stage : desc.stages) {
+		hasher.Add(stage.stage);
+		hasher.Add(stage.codeHash);
+		hasher.Add(stage.entryPoint);
+
+		// Offsets follow from the order of the entries, the ids and values are enough.
+		for (const VkSpecializationMapEntry& entry : stage.specialization.GetMapEntries()) {
+			hasher.Add(entry.constantID);
+		}
+		hasher.Add(stage.specialization.GetData());
+	}
+
+	hasher.Add(desc.vertexInput.bindings);
+	hasher.Add(desc.vertexInput.attributes);
+
+	hasher.Add(desc.inputAssembly.topology);
+	hasher.Add(desc.inputAssembly.primitiveRestartEnable);
+
+	// Line width and depth bias factors are dynamic state.
+	hasher.Add(desc.rasterization.depthClampEnable);
+	hasher.Add(desc.rasterization.rasterizerDiscardEnable);
+	hasher.Add(desc.rasterization.polygonMode);
+	hasher.Add(desc.rasterization.cullMode);
+	hasher.Add(desc.rasterization.frontFace);
+	hasher.Add(desc.rasterization.depthBiasEnable);
+
+	hasher.Add(desc.multisample.rasterizationSamples);
+	hasher.Add(desc.multisample.sampleShadingEnable);
+	hasher.Add(desc.multisample.minSampleShading);
+	hasher.Add(desc.multisample.alphaToCoverageEnable);
+	hasher.Add(desc.multisample.alphaToOneEnable);
+
+	hasher.Add(desc.depthStencil.depthTestEnable);
+	hasher.Add(desc.depthStencil.depthWriteEnable);
+	hasher.Add(desc.depthStencil.depthCompareOp);
+	hasher.Add(desc.depthStencil.depthBoundsTestEnable);
+	hasher.Add(desc.depthStencil.stencilTestEnable);
+	hasher.Add(desc.depthStencil.front);
+	hasher.Add(desc.depthStencil.back);
+	hasher.Add(desc.depthStencil.minDepthBounds);
+	hasher.Add(desc.depthStencil.maxDepthBounds);
+
+	hasher.Add(desc.blendAttachments);
+	hasher.Add(desc.colorBlend.logicOpEnable);
+	hasher.Add(desc.colorBlend.logicOp);
+
+	hasher.Add(desc.layout);
+	hasher.Add(desc.renderPassHash);
+	hasher.Add(desc.subpass);
+
+	return hasher.Get();
+}
+
+
+void PipelineLibrary::Init(VkDevice device, PipelineCache& pipelineCache, ShaderRegistry& shaderRegistry, uint32_t compileThreadCount)
+{
+	this->device = device;
+	this->pipelineCache = &pipelineCache;
+	this->shaderRegistry = &shaderRegistry;
+
+	for (uint32_t i = 0; i < compileThreadCount; ++i) {
+		workerCaches.push_back(pipelineCache.CreateWorkerCache());
+	}
+
+	compileJobs.Init(compileThreadCount);
+}
+
+
+void PipelineLibrary::Destroy()
+{
+	// Compilations still queued run to completion, they reference the entries.
+	compileJobs.Destroy();
+	workerCaches.clear();
+
+	for (auto& entry : entries) {
+		if (entry->pipeline != VK_NULL_HANDLE) {
+			vkDestroyPipeline(device, entry->pipeline, nullptr);
+		}
+
+		for (const PipelineShaderStage& stage : entry->desc.stages) {
+			shaderRegistry->Release(stage.codeHash);
+		}
+	}
+
+	entries.clear();
+	idsByHash.clear();
+	stats = {};
+}
+
+
+uint32_t PipelineLibrary::Request(const GraphicsPipelineDesc& desc, uint32_t placeholder)
+{
+	uint64_t hash = HashGraphicsPipelineDesc(desc);
+
+	Entry* entry = nullptr;
+	uint32_t id = INVALID_ID;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++stats.requestCount;
+
+		auto found = idsByHash.find(hash);
+		if (found != idsByHash.end()) {
+			++stats.dedupCount;
+			return found->second;
+		}
+
+		// Placeholders must exist before the pipelines that use them, so placeholder chains never form a cycle.
+		if (placeholder != INVALID_ID && placeholder >= entries.size()) {
+			throw std::runtime_error("Unknown placeholder pipeline");
+		}
+
+		id = static_cast<uint32_t>(entries.size());
+		entries.push_back(std::make_unique<Entry>());
+		entry = entries.back().get();
+		entry->desc = desc;
+		entry->placeholder = placeholder;
+
+		// The modules must outlive the compilation, and are kept as long as the pipeline for simplicity.
+		for (const PipelineShaderStage& stage : desc.stages) {
+			shaderRegistry->AddReference(stage.codeHash);
+		}
+
+		idsByHash[hash] = id;
+		++stats.pendingCount;
+	}
+
+	if (workerCaches.empty()) {
+		Compile(*entry, pipelineCache->Get());
+	}
+	else {
+		compileJobs.Submit([this, entry](uint32_t workerIndex) {
+			Compile(*entry, workerCaches[workerIndex]);
+		});
+	}
+
+	return id;
+}
+
+
+void PipelineLibrary::Wait(uint32_t id)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	entryCompiled.wait(lock, [this, id] { return entries[id]->state != State::Pending; });
+
+	if (entries[id]->state == State::Failed) {
+		throw std::runtime_error("Failed to create graphics pipeline");
+	}
+}
+
+
+VkPipeline PipelineLibrary::Get(uint32_t id) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return GetLocked(id);
+}
+
+
+bool PipelineLibrary::IsReady(uint32_t id) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries[id]->state == State::Ready;
+}
+
+
+PipelineLibraryStats PipelineLibrary::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+
+VkPipeline PipelineLibrary::GetLocked(uint32_t id) const
+{
+	while (id != INVALID_ID) {
+		const Entry& entry = *entries[id];
+		if (entry.state == State::Ready) {
+			return entry.pipeline;
+		}
+
+		id = entry.placeholder;
+	}
+
+	return VK_NULL_HANDLE;
+}
+
+
+void PipelineLibrary::Compile(Entry& entry, VkPipelineCache cache)
+{
+	// The description is not modified after Request(), so it's read without the lock.
+	const GraphicsPipelineDesc& desc = entry.desc;
+
+	std::vector<VkPipelineShaderStageCreateInfo> stages(desc.stages.size());
+	std::vector<VkSpecializationInfo> specializations(desc.stages.size());
+	for (size_t i = 0; i < desc.stages.size(); ++i) {
+		stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stages[i].stage = desc.stages[i].stage;
+		stages[i].module = desc.stages[i].module;
+		stages[i].pName = desc.stages[i].entryPoint.c_str();
+
+		// Constants without a value keep the default from the shader.
+		if (!desc.stages[i].specialization.IsEmpty()) {
+			specializations[i] = desc.stages[i].specialization.GetInfo();
+			stages[i].pSpecializationInfo = &specializations[i];
+		}
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertexInput{};
+	vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInput.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexInput.bindings.size());
+	vertexInput.pVertexBindingDescriptions = desc.vertexInput.bindings.data();
+	vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexInput.attributes.size());
+	vertexInput.pVertexAttributeDescriptions = desc.vertexInput.attributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = desc.inputAssembly;
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.pNext = nullptr;
+
+	// Viewport and scissor are dynamic, only their count is part of the pipeline.
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterization = desc.rasterization;
+	rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterization.pNext = nullptr;
+
+	VkPipelineMultisampleStateCreateInfo multisample = desc.multisample;
+	multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample.pNext = nullptr;
+	multisample.pSampleMask = nullptr;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil = desc.depthStencil;
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.pNext = nullptr;
+
+	VkPipelineColorBlendStateCreateInfo colorBlend = desc.colorBlend;
+	colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlend.pNext = nullptr;
+	colorBlend.attachmentCount = static_cast<uint32_t>(desc.blendAttachments.size());
+	colorBlend.pAttachments = desc.blendAttachments.data();
+
+	const std::vector<VkDynamicState>& dynamicStates = GetDynamicStates();
+
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+	pipelineInfo.pStages = stages.data();
+	pipelineInfo.pVertexInputState = &vertexInput;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterization;
+	pipelineInfo.pMultisampleState = &multisample;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlend;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = desc.renderPass;
+	pipelineInfo.subpass = desc.subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	auto compileStart = std::chrono::steady_clock::now();
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+
+	double compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		--stats.pendingCount;
+
+		if (result == VK_SUCCESS) {
+			entry.pipeline = pipeline;
+			entry.state = State::Ready;
+
+			++stats.compiledCount;
+			stats.totalCompileMs += compileMs;
+			stats.maxCompileMs = std::max(stats.maxCompileMs, compileMs);
+
+			uint32_t bucket = 0;
+			for (double bucketEndMs = 1.0; compileMs >= bucketEndMs && bucket + 1 < PipelineLibraryStats::HISTOGRAM_BUCKET_COUNT; bucketEndMs *= 2.0) {
+				++bucket;
+			}
+			++stats.compileHistogram[bucket];
+		}
+		else {
+			entry.state = State::Failed;
+			++stats.failedCount;
+		}
+	}
+	entryCompiled.notify_all();
+
+	// Compile threads can't throw to anyone. Draws keep using the placeholder, Wait() throws.
+	if (result != VK_SUCCESS) {
+		std::cerr << "Failed to create graphics pipeline (VkResult " << result << ")" << std::endl;
+	}
+}
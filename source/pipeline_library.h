@@ -0,0 +1,166 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "job_system.h"
+#include "pipeline_cache.h"
+#include "shader_registry.h"
+#include "specialization_constants.h"
+#include "vertex.h"
+
+
+// One programmable stage of a graphics pipeline.
+struct PipelineShaderStage
+{
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// From the ShaderRegistry passed to PipelineLibrary::Init. The library keeps a reference for as long as it
+	// keeps the pipeline. Modules are identified by the hash of their code, not by their handle.
+	VkShaderModule module = VK_NULL_HANDLE;
+	uint64_t codeHash = 0;
+
+	std::string entryPoint = "main";
+
+	// Part of the hash, every permutation of the same module is a pipeline of its own.
+	SpecializationConstants specialization;
+};
+
+
+// Everything a graphics pipeline is created from, stored by value, so it can be hashed and compiled on another thread.
+// Pointers inside the create info structs (pNext, pSampleMask...) are ignored.
+// Viewport, scissor and the rest of dynamic_state.h are dynamic state in every pipeline and not part of the description.
+struct GraphicsPipelineDesc
+{
+	std::vector<PipelineShaderStage> stages;
+	VertexInputDescription vertexInput;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	VkPipelineRasterizationStateCreateInfo rasterization{};
+	VkPipelineMultisampleStateCreateInfo multisample{};
+	// Ignored if the subpass has no depth stencil attachment.
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+
+	// One per color attachment of the subpass. logicOpEnable and logicOp are taken from colorBlend.
+	std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+	VkPipelineColorBlendStateCreateInfo colorBlend{};
+
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	// A pipeline works with every render pass compatible with the one it was created with.
+	// renderPassHash identifies that compatibility class, see HashRenderPassCompatibility().
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint64_t renderPassHash = 0;
+	uint32_t subpass = 0;
+};
+
+
+// Hash of everything that decides render pass compatibility: attachment formats and sample counts, and which attachments
+// the subpasses reference. Load/store ops and layouts don't matter for compatibility, so they are left out.
+uint64_t HashRenderPassCompatibility(const VkRenderPassCreateInfo& renderPassInfo);
+
+uint64_t HashGraphicsPipelineDesc(const GraphicsPipelineDesc& desc);
+
+
+struct PipelineLibraryStats
+{
+	// Compile times in power of two buckets: [0, 1) ms, [1, 2) ms, [2, 4) ms ... the last one is open ended.
+	static const uint32_t HISTOGRAM_BUCKET_COUNT = 12;
+
+	uint32_t requestCount = 0;
+
+	// Requests answered by a pipeline that already existed or was already compiling.
+	uint32_t dedupCount = 0;
+
+	uint32_t compiledCount = 0;
+	uint32_t pendingCount = 0;
+	uint32_t failedCount = 0;
+
+	double totalCompileMs = 0.0;
+	double maxCompileMs = 0.0;
+	std::array<uint32_t, HISTOGRAM_BUCKET_COUNT> compileHistogram{};
+};
+
+
+// Creates graphics pipelines on a pool of compile threads and keeps them for the lifetime of the library.
+//
+// Every request is keyed by the hash of its full description, so identical requests share one pipeline and one
+// compilation, even if the first one is still compiling. Until a pipeline is ready, Get() returns the pipeline
+// of its placeholder, usually a simple pipeline compiled up front. Draws never wait for the compiler, they are
+// drawn with the placeholder (or skipped if there is none) for a few frames instead.
+//
+// Every compile thread uses its own VkPipelineCache, merged into the persistent cache on PipelineCache::Save().
+class PipelineLibrary
+{
+public:
+	static const uint32_t INVALID_ID = UINT32_MAX;
+
+	// Zero compile threads compiles every request on the calling thread.
+	void Init(VkDevice device, PipelineCache& pipelineCache, ShaderRegistry& shaderRegistry, uint32_t compileThreadCount);
+
+	// Waits for the compilations in progress, destroys all pipelines and releases their shader modules.
+	void Destroy();
+
+	// Returns the id of the pipeline for desc and starts compiling it if it doesn't exist yet.
+	// placeholder is used by Get() until the pipeline is ready. It must be compatible with the same render pass and layout.
+	uint32_t Request(const GraphicsPipelineDesc& desc, uint32_t placeholder = INVALID_ID);
+
+	// Blocks until the pipeline is compiled. Throws if the compilation failed.
+	void Wait(uint32_t id);
+
+	// The pipeline if it's ready, otherwise the one of its placeholder, otherwise VK_NULL_HANDLE.
+	// Thread safe, may be called while recording on worker threads.
+	VkPipeline Get(uint32_t id) const;
+
+	bool IsReady(uint32_t id) const;
+
+	uint32_t GetCompileThreadCount() const { return compileJobs.GetWorkerCount(); }
+
+	PipelineLibraryStats GetStats() const;
+
+private:
+	enum class State
+	{
+		Pending,
+		Ready,
+		Failed
+	};
+
+	struct Entry
+	{
+		GraphicsPipelineDesc desc;
+		uint32_t placeholder = INVALID_ID;
+
+		State state = State::Pending;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+	};
+
+	void Compile(Entry& entry, VkPipelineCache cache);
+	VkPipeline GetLocked(uint32_t id) const;
+
+	VkDevice device = VK_NULL_HANDLE;
+	PipelineCache* pipelineCache = nullptr;
+	ShaderRegistry* shaderRegistry = nullptr;
+
+	JobSystem compileJobs;
+
+	// One per compile thread, owned by pipelineCache.
+	std::vector<VkPipelineCache> workerCaches;
+
+	mutable std::mutex mutex;
+	std::condition_variable entryCompiled;
+
+	// Entries never move, compile threads keep pointers to them.
+	std::vector<std::unique_ptr<Entry>> entries;
+	std::unordered_map<uint64_t, uint32_t> idsByHash;
+
+	PipelineLibraryStats stats;
+};
@@ -0,0 +1,173 @@
+#include "present_policy.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+const char* GetPresentPolicyName(PresentPolicy policy)
+{
+	switch (policy) {
+	case PresentPolicy::Latency:
+		return "latency";
+	case PresentPolicy::Throughput:
+		return "throughput";
+	case PresentPolicy::Power:
+		return "power";
+	default:
+		return "unknown";
+	}
+}
+
+
+PresentConfig SelectPresentConfig(PresentPolicy policy, const VkSurfaceCapabilitiesKHR& capabilities,
+	const std::vector<VkPresentModeKHR>& availableModes)
+{
+	auto isAvailable = [&availableModes](VkPresentModeKHR mode) {
+		return std::find(availableModes.begin(), availableModes.end(), mode) != availableModes.end();
+	};
+
+	PresentConfig config;
+	uint32_t imageCount = capabilities.minImageCount;
+
+	switch (policy) {
+	case PresentPolicy::Latency:
+		// Mailbox always shows the newest frame without tearing. It needs a third image, so one can be rendered while
+		// one is shown and one is queued, otherwise it blocks like FIFO. Immediate tears, but doesn't queue at all.
+		if (isAvailable(VK_PRESENT_MODE_MAILBOX_KHR)) {
+			config.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+			imageCount = std::max(imageCount, 3u);
+		}
+		else if (isAvailable(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+			config.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+		}
+		// Every frame in flight is one more frame of input waiting to be shown.
+		config.framesInFlight = 1;
+		break;
+
+	case PresentPolicy::Throughput:
+		if (isAvailable(VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+			config.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+		}
+		imageCount += 2;
+		config.framesInFlight = 3;
+		break;
+
+	case PresentPolicy::Power:
+	default:
+		// The driver may have to finish internal work before an image of a minimal swapchain can be acquired again.
+		imageCount += 1;
+		config.framesInFlight = 2;
+		break;
+	}
+
+	// If maxImageCount == 0, then there is no maximum.
+	if (capabilities.maxImageCount > 0) {
+		imageCount = std::min(imageCount, capabilities.maxImageCount);
+	}
+	config.imageCount = imageCount;
+
+	return config;
+}
+
+
+void PresentLatencyTracker::Init(VkDevice device, PFN_vkWaitForPresentKHR waitForPresent)
+{
+	this->device = device;
+	this->waitForPresent = waitForPresent;
+
+	for (PolicySamples& policySamples : samples) {
+		policySamples.valuesMs.reserve(MAX_SAMPLES);
+	}
+}
+
+
+void PresentLatencyTracker::OnPresent(VkSwapchainKHR swapchain, PresentPolicy policy, std::chrono::steady_clock::time_point inputTime)
+{
+	uint64_t presentId = nextPresentId++;
+
+	if (waitForPresent == nullptr) {
+		AddSample(policy, inputTime);
+		return;
+	}
+
+	this->swapchain = swapchain;
+
+	PendingPresent present;
+	present.presentId = presentId;
+	present.policy = policy;
+	present.inputTime = inputTime;
+	pendingPresents.push_back(present);
+
+	if (pendingPresents.size() > MAX_PENDING_PRESENTS) {
+		pendingPresents.pop_front();
+	}
+}
+
+
+void PresentLatencyTracker::Poll()
+{
+	while (!pendingPresents.empty()) {
+		// A zero timeout only checks, it never blocks.
+		VkResult result = waitForPresent(device, swapchain, pendingPresents.front().presentId, 0);
+
+		if (result == VK_TIMEOUT) {
+			return;
+		}
+
+		// Out of date or lost, the swapchain is recreated and these presents never finish.
+		if (result != VK_SUCCESS) {
+			pendingPresents.clear();
+			return;
+		}
+
+		AddSample(pendingPresents.front().policy, pendingPresents.front().inputTime);
+		pendingPresents.pop_front();
+	}
+}
+
+
+void PresentLatencyTracker::OnSwapchainDestroyed()
+{
+	pendingPresents.clear();
+	swapchain = VK_NULL_HANDLE;
+}
+
+
+void PresentLatencyTracker::ResetSamples()
+{
+	for (PolicySamples& policySamples : samples) {
+		policySamples.valuesMs.clear();
+		policySamples.nextIndex = 0;
+		policySamples.count = 0;
+	}
+}
+
+
+uint64_t PresentLatencyTracker::GetSampleCount(PresentPolicy policy) const
+{
+	return samples[static_cast<uint32_t>(policy)].count;
+}
+
+
+FrameStatPercentiles PresentLatencyTracker::GetPercentiles(PresentPolicy policy) const
+{
+	std::vector<float> values = samples[static_cast<uint32_t>(policy)].valuesMs;
+	std::sort(values.begin(), values.end());
+	return GetSortedPercentiles(values);
+}
+
+
+void PresentLatencyTracker::AddSample(PresentPolicy policy, std::chrono::steady_clock::time_point inputTime)
+{
+	float valueMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - inputTime).count();
+
+	PolicySamples& policySamples = samples[static_cast<uint32_t>(policy)];
+	if (policySamples.valuesMs.size() < MAX_SAMPLES) {
+		policySamples.valuesMs.push_back(valueMs);
+	}
+	else {
+		policySamples.valuesMs[policySamples.nextIndex] = valueMs;
+	}
+	policySamples.nextIndex = (policySamples.nextIndex + 1) % MAX_SAMPLES;
+	++policySamples.count;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "frame_stats.h"
+
+
+// What the swapchain and the frame pacing are tuned for.
+enum class PresentPolicy : uint32_t
+{
+	// MAILBOX or IMMEDIATE with the fewest images and one frame in flight. Input shows up on screen as soon as possible.
+	Latency,
+	// FIFO_RELAXED with a deep image queue and three frames in flight, so neither the CPU nor the GPU waits for the other.
+	// A late frame is shown right away instead of a whole refresh later.
+	Throughput,
+	// FIFO with one image more than the minimum. Rendering is capped at the refresh rate and the GPU idles in between.
+	Power,
+	Count
+};
+
+const uint32_t PRESENT_POLICY_COUNT = static_cast<uint32_t>(PresentPolicy::Count);
+
+const char* GetPresentPolicyName(PresentPolicy policy);
+
+
+// Swapchain and frame pacing settings of a policy on one surface.
+struct PresentConfig
+{
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	uint32_t imageCount = 0;
+	uint32_t framesInFlight = 0;
+};
+
+
+// Falls back to FIFO, which every surface supports, if the modes of the policy are not available.
+// The image count is clamped to the limits of the surface.
+PresentConfig SelectPresentConfig(PresentPolicy policy, const VkSurfaceCapabilitiesKHR& capabilities,
+	const std::vector<VkPresentModeKHR>& availableModes);
+
+
+// Time from sampling input for a frame until the frame was presented, kept per policy for comparing them.
+//
+// With VK_KHR_present_wait a frame counts as presented when vkWaitForPresentKHR says so. It's polled without
+// blocking once per frame, so a sample is late by up to one frame. A frame replaced in the MAILBOX queue counts as
+// presented with the frame that replaced it. Without present wait the samples end when vkQueuePresentKHR returns
+// and miss the time the image waits in the swapchain queue.
+class PresentLatencyTracker
+{
+public:
+	// Per policy, the oldest are replaced.
+	static const uint32_t MAX_SAMPLES = 4096;
+
+	// Presents not seen yet beyond this are dropped, for example while the window is minimized.
+	static const size_t MAX_PENDING_PRESENTS = 64;
+
+	// waitForPresent: vkWaitForPresentKHR, null if VK_KHR_present_id and VK_KHR_present_wait are not enabled.
+	void Init(VkDevice device, PFN_vkWaitForPresentKHR waitForPresent);
+
+	// For VkPresentIdKHR of the next present, only chained if IsWaitingForPresent().
+	uint64_t GetNextPresentId() const { return nextPresentId; }
+
+	// Right after vkQueuePresentKHR.
+	void OnPresent(VkSwapchainKHR swapchain, PresentPolicy policy, std::chrono::steady_clock::time_point inputTime);
+
+	// Records the frames presented since the last call.
+	void Poll();
+
+	// Before the swapchain the last presents went to is destroyed. They are dropped.
+	void OnSwapchainDestroyed();
+
+	void ResetSamples();
+
+	bool IsWaitingForPresent() const { return waitForPresent != nullptr; }
+	uint64_t GetSampleCount(PresentPolicy policy) const;
+
+	// Nearest rank percentiles of the last MAX_SAMPLES samples of the policy.
+	FrameStatPercentiles GetPercentiles(PresentPolicy policy) const;
+
+private:
+	struct PendingPresent
+	{
+		uint64_t presentId = 0;
+		PresentPolicy policy = PresentPolicy::Latency;
+		std::chrono::steady_clock::time_point inputTime;
+	};
+
+	struct PolicySamples
+	{
+		std::vector<float> valuesMs;
+		size_t nextIndex = 0;
+		uint64_t count = 0;
+	};
+
+	void AddSample(PresentPolicy policy, std::chrono::steady_clock::time_point inputTime);
+
+	VkDevice device = VK_NULL_HANDLE;
+	PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	// Present ids only have to increase per swapchain, one counter for all of them does.
+	uint64_t nextPresentId = 1;
+	std::deque<PendingPresent> pendingPresents;
+
+	std::array<PolicySamples, PRESENT_POLICY_COUNT> samples;
+};
@@ -0,0 +1,145 @@
+#include "queue_timeline.h"
+
+#include <stdexcept>
+
+
+void QueueTimeline::Init(VkDevice device)
+{
+	this->device = device;
+
+	// A timeline semaphore has a 64 bit counter instead of a signaled flag. The host can both wait for
+	// and query it, and it never has to be reset.
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create timeline semaphore");
+	}
+
+	lastSubmittedValue = 0;
+	completedValue = 0;
+}
+
+
+void QueueTimeline::Destroy()
+{
+	if (semaphore == VK_NULL_HANDLE) {
+		return;
+	}
+
+	Wait(lastSubmittedValue);
+
+	vkDestroySemaphore(device, semaphore, nullptr);
+	semaphore = VK_NULL_HANDLE;
+}
+
+
+uint64_t QueueTimeline::Advance()
+{
+	return ++lastSubmittedValue;
+}
+
+
+bool QueueTimeline::IsComplete(uint64_t value)
+{
+	if (value <= completedValue) {
+		return true;
+	}
+
+	vkGetSemaphoreCounterValue(device, semaphore, &completedValue);
+	return value <= completedValue;
+}
+
+
+bool QueueTimeline::Wait(uint64_t value)
+{
+	if (IsComplete(value)) {
+		return false;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+
+	if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to wait for timeline semaphore");
+	}
+
+	completedValue = value;
+	return true;
+}
+
+
+void SubmitBatch::Wait(const TimelinePoint& point, VkPipelineStageFlags stageMask)
+{
+	if (point.value == 0) {
+		return;
+	}
+
+	waitSemaphores.push_back(point.semaphore);
+	waitValues.push_back(point.value);
+	waitStages.push_back(stageMask);
+}
+
+
+void SubmitBatch::WaitBinary(VkSemaphore semaphore, VkPipelineStageFlags stageMask)
+{
+	waitSemaphores.push_back(semaphore);
+	// Ignored for binary semaphores.
+	waitValues.push_back(0);
+	waitStages.push_back(stageMask);
+}
+
+
+void SubmitBatch::AddCommandBuffer(VkCommandBuffer commandBuffer)
+{
+	commandBuffers.push_back(commandBuffer);
+}
+
+
+void SubmitBatch::Signal(const TimelinePoint& point)
+{
+	signalSemaphores.push_back(point.semaphore);
+	signalValues.push_back(point.value);
+}
+
+
+void SubmitBatch::SignalBinary(VkSemaphore semaphore)
+{
+	signalSemaphores.push_back(semaphore);
+	signalValues.push_back(0);
+}
+
+
+VkResult SubmitBatch::Submit(VkQueue queue) const
+{
+	// One value per semaphore, in the same order.
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	submitInfo.pCommandBuffers = commandBuffers.data();
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+	// No fence, the timeline values tell when the work is complete.
+	return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+
+// A value on a timeline semaphore. The work that signals it is complete once the semaphore's counter reaches it.
+// A zero value is reached from the start, it means there is nothing to wait for.
+struct TimelinePoint
+{
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t value = 0;
+};
+
+
+// The timeline semaphore of one queue. Every submission to the queue signals the next value, so the counter tells
+// how far the queue has come, and any submission is waited for by its value: on the host with Wait(), on another
+// queue by waiting on GetPoint(value). One semaphore replaces a fence per submission.
+//
+// The last completed value is cached. Waiting for a value that is known to be reached costs no driver call, which
+// makes most of the waits of a frame free.
+//
+// Not thread safe, used from the main thread only.
+class QueueTimeline
+{
+public:
+	void Init(VkDevice device);
+
+	// Waits for the last submitted value first.
+	void Destroy();
+
+	// The point the next submission signals. Advance() once that submission has succeeded.
+	TimelinePoint GetNextPoint() const { return { semaphore, lastSubmittedValue + 1 }; }
+	uint64_t Advance();
+
+	uint64_t GetLastSubmittedValue() const { return lastSubmittedValue; }
+	TimelinePoint GetPoint(uint64_t value) const { return { semaphore, value }; }
+	VkSemaphore GetSemaphore() const { return semaphore; }
+
+	// Without blocking.
+	bool IsComplete(uint64_t value);
+
+	// Blocks until the counter reaches value. Returns false right away if it already has, true if it had to wait.
+	bool Wait(uint64_t value);
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+
+	uint64_t lastSubmittedValue = 0;
+	uint64_t completedValue = 0;
+};
+
+
+// The waits, command buffers and signals of one vkQueueSubmit. Timeline points and binary semaphores (for acquire
+// and present, which only take binary ones) can be mixed, the binary ones get a dummy value in the timeline arrays.
+class SubmitBatch
+{
+public:
+	// Work at stageMask and later waits until the point is reached. Points with a zero value are skipped.
+	void Wait(const TimelinePoint& point, VkPipelineStageFlags stageMask);
+	void WaitBinary(VkSemaphore semaphore, VkPipelineStageFlags stageMask);
+
+	void AddCommandBuffer(VkCommandBuffer commandBuffer);
+
+	void Signal(const TimelinePoint& point);
+	void SignalBinary(VkSemaphore semaphore);
+
+	VkResult Submit(VkQueue queue) const;
+
+private:
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<uint64_t> waitValues;
+	std::vector<VkPipelineStageFlags> waitStages;
+
+	std::vector<VkCommandBuffer> commandBuffers;
+
+	std::vector<VkSemaphore> signalSemaphores;
+	std::vector<uint64_t> signalValues;
+};
@@ -0,0 +1,1162 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "hash.h"
+#include "pipeline_library.h"
+#include "render_pass_builder.h"
+
+
+static const uint32_t NO_PASS = UINT32_MAX;
+
+
+// Layout, stages and accesses of one use of an image.
+struct UsageInfo
+{
+	VkImageLayout layout;
+	VkPipelineStageFlags stageMask;
+	VkAccessFlags accessMask;
+	VkImageUsageFlags imageUsage;
+	bool isAttachment;
+	bool isWrite;
+	// Needs what was in the image before, unless it's cleared.
+	bool readsContents;
+};
+
+
+static bool IsDepthFormat(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+static bool HasStencil(VkFormat format)
+{
+	return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+		format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+
+static VkImageAspectFlags GetAspectMask(VkFormat format)
+{
+	VkImageAspectFlags aspectMask = 0;
+	if (IsDepthFormat(format)) {
+		aspectMask |= VK_IMAGE_ASPECT_DEPTH_BIT;
+	}
+	if (HasStencil(format)) {
+		aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	return aspectMask != 0 ? aspectMask : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+
+static UsageInfo GetUsageInfo(RenderGraphUsage usage, VkFormat format)
+{
+	// Depth images are read in the read-only depth layout, color images in the shader read layout.
+	VkImageLayout readOnlyLayout = GetAspectMask(format) == VK_IMAGE_ASPECT_COLOR_BIT ?
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	switch (usage) {
+	case RenderGraphUsage::ColorAttachment:
+		// Blending reads the attachment.
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			true, true, true };
+	case RenderGraphUsage::DepthStencilAttachment:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true, true, true };
+	case RenderGraphUsage::ResolveAttachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true, true, false };
+	case RenderGraphUsage::InputAttachment:
+		return { readOnlyLayout, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+			VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, true, false, true };
+	case RenderGraphUsage::FragmentSampled:
+		return { readOnlyLayout, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_USAGE_SAMPLED_BIT, false, false, true };
+	case RenderGraphUsage::TransferSource:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false, false, true };
+	case RenderGraphUsage::TransferDestination:
+	default:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT, false, true, false };
+	}
+}
+
+
+// Hash of everything in the create info, unlike HashRenderPassCompatibility(). Render passes with equal hashes
+// are interchangeable.
+static uint64_t HashRenderPassDescription(const VkRenderPassCreateInfo& createInfo)
+{
+	Hasher hasher;
+
+	// The description structs only have 32 bit members, no padding.
+	hasher.Add(createInfo.attachmentCount);
+	for (uint32_t i = 0; i < createInfo.attachmentCount; ++i) {
+		hasher.Add(createInfo.pAttachments[i]);
+	}
+
+	auto addReferences = [&hasher](uint32_t count, const VkAttachmentReference* references) {
+		hasher.Add(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			hasher.Add(references[i]);
+		}
+	};
+
+	hasher.Add(createInfo.subpassCount);
+	for (uint32_t i = 0; i < createInfo.subpassCount; ++i) {
+		const VkSubpassDescription& subpass = createInfo.pSubpasses[i];
+
+		addReferences(subpass.inputAttachmentCount, subpass.pInputAttachments);
+		addReferences(subpass.colorAttachmentCount, subpass.pColorAttachments);
+		addReferences(subpass.pResolveAttachments != nullptr ? subpass.colorAttachmentCount : 0, subpass.pResolveAttachments);
+		addReferences(subpass.pDepthStencilAttachment != nullptr ? 1 : 0, subpass.pDepthStencilAttachment);
+	}
+
+	hasher.Add(createInfo.dependencyCount);
+	for (uint32_t i = 0; i < createInfo.dependencyCount; ++i) {
+		hasher.Add(createInfo.pDependencies[i]);
+	}
+
+	return hasher.Get();
+}
+
+
+void RenderGraph::Init(VkDevice device, GpuAllocator& allocator)
+{
+	this->device = device;
+	this->allocator = &allocator;
+}
+
+
+void RenderGraph::Destroy()
+{
+	Reset();
+
+	for (const auto& entry : renderPasses) {
+		vkDestroyRenderPass(device, entry.second, nullptr);
+	}
+	renderPasses.clear();
+}
+
+
+void RenderGraph::Reset()
+{
+	for (const auto& entry : framebuffers) {
+		vkDestroyFramebuffer(device, entry.second, nullptr);
+	}
+	framebuffers.clear();
+
+	DestroyTransientImages();
+
+	passes.clear();
+	images.clear();
+	steps.clear();
+	finalStep = Step{};
+	stats = RenderGraphStats{};
+	isCompiled = false;
+}
+
+
+RenderGraphImage RenderGraph::ImportImage(const std::string& name, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples,
+	const RenderGraphImageState& initialState, const RenderGraphImageState& finalState)
+{
+	Image image;
+	image.name = name;
+	image.format = format;
+	image.extent = extent;
+	image.samples = samples;
+	image.isImported = true;
+	image.initialState = initialState;
+	image.finalState = finalState;
+
+	images.push_back(image);
+	return static_cast<RenderGraphImage>(images.size() - 1);
+}
+
+
+RenderGraphImage RenderGraph::CreateImage(const std::string& name, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples)
+{
+	Image image;
+	image.name = name;
+	image.format = format;
+	image.extent = extent;
+	image.samples = samples;
+
+	images.push_back(image);
+	return static_cast<RenderGraphImage>(images.size() - 1);
+}
+
+
+uint32_t RenderGraph::AddPass(const std::string& name, RenderGraphPassKind kind, RenderGraphRecordFunction record)
+{
+	Pass pass;
+	pass.name = name;
+	pass.kind = kind;
+	pass.record = record;
+
+	passes.push_back(pass);
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+
+void RenderGraph::UseImage(uint32_t pass, RenderGraphImage image, RenderGraphUsage usage)
+{
+	bool isAttachment = GetUsageInfo(usage, images[image].format).isAttachment;
+	bool isTransfer = usage == RenderGraphUsage::TransferSource || usage == RenderGraphUsage::TransferDestination;
+
+	if (passes[pass].kind == RenderGraphPassKind::Graphics && isTransfer) {
+		throw std::runtime_error("Graphics pass " + passes[pass].name + " can't use " + images[image].name + " for transfers");
+	}
+	if (passes[pass].kind == RenderGraphPassKind::Commands && !isTransfer) {
+		throw std::runtime_error("Command pass " + passes[pass].name + " can only use " + images[image].name + " for transfers");
+	}
+	for (const ImageUse& use : passes[pass].uses) {
+		if (use.image == image) {
+			throw std::runtime_error("Pass " + passes[pass].name + " uses " + images[image].name + " twice");
+		}
+	}
+	if (usage == RenderGraphUsage::DepthStencilAttachment) {
+		for (const ImageUse& use : passes[pass].uses) {
+			if (use.usage == RenderGraphUsage::DepthStencilAttachment) {
+				throw std::runtime_error("Pass " + passes[pass].name + " has more than one depth attachment");
+			}
+		}
+	}
+	if (isAttachment && !passes[pass].uses.empty()) {
+		for (const ImageUse& use : passes[pass].uses) {
+			const Image& other = images[use.image];
+			if (GetUsageInfo(use.usage, other.format).isAttachment &&
+				(other.extent.width != images[image].extent.width || other.extent.height != images[image].extent.height)) {
+				throw std::runtime_error("The attachments of pass " + passes[pass].name + " differ in size");
+			}
+		}
+	}
+
+	ImageUse use;
+	use.image = image;
+	use.usage = usage;
+	passes[pass].uses.push_back(use);
+}
+
+
+void RenderGraph::ClearImage(uint32_t pass, RenderGraphImage image, RenderGraphUsage usage, const VkClearValue& clearValue)
+{
+	if (usage != RenderGraphUsage::ColorAttachment && usage != RenderGraphUsage::DepthStencilAttachment) {
+		throw std::runtime_error("Only color and depth attachments can be cleared, not " + images[image].name);
+	}
+
+	UseImage(pass, image, usage);
+	passes[pass].uses.back().isCleared = true;
+	passes[pass].uses.back().clearValue = clearValue;
+}
+
+
+void RenderGraph::SetSideEffects(uint32_t pass)
+{
+	passes[pass].hasSideEffects = true;
+}
+
+
+void RenderGraph::SetSubpassContents(uint32_t pass, VkSubpassContents contents)
+{
+	passes[pass].contents = contents;
+}
+
+
+void RenderGraph::Compile()
+{
+	if (isCompiled) {
+		throw std::runtime_error("The render graph is already compiled, Reset() it to describe it again");
+	}
+
+	ValidatePasses();
+	CullPasses();
+	SchedulePasses();
+	CreateTransientImages();
+	DeriveSynchronization();
+
+	stats.passCount = static_cast<uint32_t>(passes.size());
+	for (const Pass& pass : passes) {
+		stats.culledPassCount += pass.isLive ? 0 : 1;
+	}
+	for (const Step& step : steps) {
+		stats.renderPassCount += step.isRenderPass ? 1 : 0;
+		stats.barrierCount += static_cast<uint32_t>(step.barriers.size());
+	}
+	stats.barrierCount += static_cast<uint32_t>(finalStep.barriers.size());
+
+	isCompiled = true;
+}
+
+
+void RenderGraph::BindImage(RenderGraphImage image, VkImage handle, VkImageView view)
+{
+	if (!images[image].isImported) {
+		throw std::runtime_error("Only imported images can be bound, not " + images[image].name);
+	}
+
+	images[image].handle = handle;
+	images[image].view = view;
+}
+
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer)
+{
+	if (!isCompiled) {
+		throw std::runtime_error("The render graph must be compiled before it's executed");
+	}
+
+	for (uint32_t stepIndex = 0; stepIndex < steps.size(); ++stepIndex) {
+		const Step& step = steps[stepIndex];
+
+		RecordBarriers(commandBuffer, step);
+
+		if (!step.isRenderPass) {
+			const Pass& pass = passes[step.passes[0]];
+			if (pass.record) {
+				pass.record(commandBuffer, RenderGraphPassContext{});
+			}
+			continue;
+		}
+
+		RenderGraphPassContext context;
+		context.renderPass = step.renderPass;
+		context.framebuffer = AcquireFramebuffer(stepIndex);
+		context.extent = step.extent;
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = step.renderPass;
+		renderPassInfo.framebuffer = context.framebuffer;
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = step.extent;
+		// One per attachment, only read for the cleared ones.
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(step.clearValues.size());
+		renderPassInfo.pClearValues = step.clearValues.data();
+
+		for (uint32_t subpass = 0; subpass < step.passes.size(); ++subpass) {
+			const Pass& pass = passes[step.passes[subpass]];
+
+			if (subpass == 0) {
+				vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.contents);
+			}
+			else {
+				vkCmdNextSubpass(commandBuffer, pass.contents);
+			}
+
+			context.subpass = subpass;
+			if (pass.record) {
+				pass.record(commandBuffer, context);
+			}
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	RecordBarriers(commandBuffer, finalStep);
+}
+
+
+VkRenderPass RenderGraph::GetRenderPass(uint32_t pass) const
+{
+	if (!passes[pass].isLive || passes[pass].kind != RenderGraphPassKind::Graphics) {
+		return VK_NULL_HANDLE;
+	}
+	return steps[passes[pass].step].renderPass;
+}
+
+
+uint64_t RenderGraph::GetRenderPassHash(uint32_t pass) const
+{
+	if (!passes[pass].isLive || passes[pass].kind != RenderGraphPassKind::Graphics) {
+		return 0;
+	}
+	return steps[passes[pass].step].renderPassHash;
+}
+
+
+uint32_t RenderGraph::GetSubpass(uint32_t pass) const
+{
+	return passes[pass].subpass;
+}
+
+
+std::string RenderGraph::GetSummary() const
+{
+	std::ostringstream summary;
+
+	for (size_t i = 0; i < steps.size(); ++i) {
+		const Step& step = steps[i];
+		summary << (i == 0 ? "" : " -> ") << (step.isRenderPass ? "[" : "");
+		for (size_t j = 0; j < step.passes.size(); ++j) {
+			summary << (j == 0 ? "" : " + ") << passes[step.passes[j]].name;
+		}
+		summary << (step.isRenderPass ? "]" : "");
+	}
+
+	if (stats.culledPassCount > 0) {
+		summary << " | culled:";
+		for (const Pass& pass : passes) {
+			if (!pass.isLive) {
+				summary << " " << pass.name;
+			}
+		}
+	}
+
+	summary << " | " << stats.renderPassCount << " render passes, " << stats.barrierCount << " barriers";
+
+	if (stats.transientImageCount > 0) {
+		summary << ", " << stats.transientImageCount << " transient images in " << stats.transientAllocationCount
+			<< " allocations: " << stats.transientBytes / 1024 << " KiB (" << stats.unaliasedTransientBytes / 1024
+			<< " KiB without aliasing, " << stats.lazilyAllocatedBytes / 1024 << " KiB lazily allocated)";
+	}
+
+	return summary.str();
+}
+
+
+void RenderGraph::ValidatePasses() const
+{
+	for (const Pass& pass : passes) {
+		if (pass.kind == RenderGraphPassKind::Graphics && GetPassExtent(pass).width == 0) {
+			throw std::runtime_error("Graphics pass " + pass.name + " has no attachments");
+		}
+
+		uint32_t colorCount = 0;
+		uint32_t resolveCount = 0;
+		// Color and depth attachments of a subpass must all have the same sample count, resolve targets a single sample.
+		VkSampleCountFlagBits samples = static_cast<VkSampleCountFlagBits>(0);
+		for (const ImageUse& use : pass.uses) {
+			colorCount += use.usage == RenderGraphUsage::ColorAttachment ? 1 : 0;
+			resolveCount += use.usage == RenderGraphUsage::ResolveAttachment ? 1 : 0;
+
+			VkSampleCountFlagBits imageSamples = images[use.image].samples;
+			if (use.usage == RenderGraphUsage::ColorAttachment || use.usage == RenderGraphUsage::DepthStencilAttachment) {
+				if (samples != 0 && samples != imageSamples) {
+					throw std::runtime_error("Attachments of pass " + pass.name + " have different sample counts");
+				}
+				samples = imageSamples;
+			}
+			if (use.usage == RenderGraphUsage::ResolveAttachment && imageSamples != VK_SAMPLE_COUNT_1_BIT) {
+				throw std::runtime_error("Resolve attachment " + images[use.image].name + " of pass " + pass.name + " is multisampled");
+			}
+		}
+		if (resolveCount > 0 && resolveCount != colorCount) {
+			throw std::runtime_error("Pass " + pass.name + " needs one resolve attachment per color attachment");
+		}
+		if (resolveCount > 0 && samples == VK_SAMPLE_COUNT_1_BIT) {
+			throw std::runtime_error("Pass " + pass.name + " resolves color attachments with a single sample");
+		}
+	}
+}
+
+
+void RenderGraph::CullPasses()
+{
+	// Walks backwards from the results. An image is needed while a live pass later on reads what's in it.
+	// Imported images are needed at the end, by whatever comes after the graph.
+	std::vector<bool> isNeeded(images.size());
+	for (size_t i = 0; i < images.size(); ++i) {
+		isNeeded[i] = images[i].isImported;
+	}
+
+	for (size_t i = passes.size(); i-- > 0;) {
+		Pass& pass = passes[i];
+
+		pass.isLive = pass.hasSideEffects;
+		for (const ImageUse& use : pass.uses) {
+			if (GetUsageInfo(use.usage, images[use.image].format).isWrite && isNeeded[use.image]) {
+				pass.isLive = true;
+			}
+		}
+
+		if (!pass.isLive) {
+			continue;
+		}
+
+		// A write that replaces the contents makes the earlier contents unneeded, a read makes them needed.
+		for (const ImageUse& use : pass.uses) {
+			UsageInfo info = GetUsageInfo(use.usage, images[use.image].format);
+			isNeeded[use.image] = info.readsContents && !use.isCleared;
+		}
+	}
+}
+
+
+void RenderGraph::SchedulePasses()
+{
+	// Dependencies between live passes in declaration order: reads wait for the last write, writes wait for the last
+	// write and for the reads since.
+	std::vector<std::vector<uint32_t>> successors(passes.size());
+	std::vector<uint32_t> predecessorCounts(passes.size(), 0);
+
+	std::vector<uint32_t> lastWriters(images.size(), NO_PASS);
+	std::vector<std::vector<uint32_t>> readers(images.size());
+
+	auto addDependency = [&](uint32_t from, uint32_t to) {
+		if (from != NO_PASS && from != to) {
+			successors[from].push_back(to);
+			++predecessorCounts[to];
+		}
+	};
+
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		if (!passes[i].isLive) {
+			continue;
+		}
+
+		for (const ImageUse& use : passes[i].uses) {
+			UsageInfo info = GetUsageInfo(use.usage, images[use.image].format);
+
+			addDependency(lastWriters[use.image], i);
+
+			if (info.isWrite) {
+				for (uint32_t reader : readers[use.image]) {
+					addDependency(reader, i);
+				}
+				readers[use.image].clear();
+				lastWriters[use.image] = i;
+			}
+			else {
+				readers[use.image].push_back(i);
+			}
+		}
+	}
+
+	std::vector<uint32_t> ready;
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		if (passes[i].isLive && predecessorCounts[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+
+	steps.clear();
+	while (!ready.empty()) {
+		// Declaration order among the ready passes, except that a pass that fits into the current render pass goes first.
+		std::sort(ready.begin(), ready.end());
+
+		size_t pick = 0;
+		if (!steps.empty()) {
+			for (size_t i = 0; i < ready.size(); ++i) {
+				if (CanMergeIntoStep(steps.back(), ready[i])) {
+					pick = i;
+					break;
+				}
+			}
+		}
+
+		uint32_t passIndex = ready[pick];
+		ready.erase(ready.begin() + pick);
+
+		Pass& pass = passes[passIndex];
+		if (steps.empty() || !CanMergeIntoStep(steps.back(), passIndex)) {
+			Step step;
+			step.isRenderPass = pass.kind == RenderGraphPassKind::Graphics;
+			steps.push_back(step);
+		}
+
+		pass.step = static_cast<uint32_t>(steps.size() - 1);
+		pass.subpass = static_cast<uint32_t>(steps.back().passes.size());
+		steps.back().passes.push_back(passIndex);
+
+		for (uint32_t successor : successors[passIndex]) {
+			if (--predecessorCounts[successor] == 0) {
+				ready.push_back(successor);
+			}
+		}
+	}
+}
+
+
+bool RenderGraph::CanMergeIntoStep(const Step& step, uint32_t passIndex) const
+{
+	const Pass& pass = passes[passIndex];
+	if (!step.isRenderPass || pass.kind != RenderGraphPassKind::Graphics) {
+		return false;
+	}
+
+	// All attachments of a render pass share the framebuffer size.
+	VkExtent2D extent = GetPassExtent(pass);
+	VkExtent2D stepExtent = GetPassExtent(passes[step.passes[0]]);
+	if (extent.width != stepExtent.width || extent.height != stepExtent.height) {
+		return false;
+	}
+
+	for (const ImageUse& use : pass.uses) {
+		UsageInfo info = GetUsageInfo(use.usage, images[use.image].format);
+
+		for (uint32_t other : step.passes) {
+			for (const ImageUse& otherUse : passes[other].uses) {
+				if (otherUse.image != use.image) {
+					continue;
+				}
+
+				// Sampling reads any pixel, so the writes of the render pass must have completed. And an image can't be
+				// attachment and sampled image in the same render pass without a feedback loop.
+				if (!info.isAttachment || !GetUsageInfo(otherUse.usage, images[use.image].format).isAttachment) {
+					return false;
+				}
+				// The load op only applies at the first use of an attachment in a render pass.
+				if (use.isCleared) {
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+
+void RenderGraph::CreateTransientImages()
+{
+	std::vector<bool> isAttachmentOnly(images.size(), true);
+	std::vector<UsageInfo> lastUses(images.size(), GetUsageInfo(RenderGraphUsage::ColorAttachment, VK_FORMAT_UNDEFINED));
+
+	for (uint32_t stepIndex = 0; stepIndex < steps.size(); ++stepIndex) {
+		for (uint32_t passIndex : steps[stepIndex].passes) {
+			for (const ImageUse& use : passes[passIndex].uses) {
+				Image& image = images[use.image];
+				UsageInfo info = GetUsageInfo(use.usage, image.format);
+
+				image.firstStep = std::min(image.firstStep, stepIndex);
+				image.lastStep = std::max(image.lastStep, stepIndex);
+				image.usage |= info.imageUsage;
+				isAttachmentOnly[use.image] = isAttachmentOnly[use.image] && info.isAttachment;
+				lastUses[use.image] = info;
+			}
+		}
+	}
+
+	std::vector<RenderGraphImage> transientImages;
+	for (RenderGraphImage i = 0; i < images.size(); ++i) {
+		Image& image = images[i];
+		// Images no live pass uses are not created at all.
+		if (image.isImported || image.firstStep == UINT32_MAX) {
+			continue;
+		}
+
+		// Contents that never leave a render pass don't need memory behind them on tile based GPUs.
+		if (isAttachmentOnly[i] && image.firstStep == image.lastStep) {
+			image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = image.format;
+		imageInfo.extent = { image.extent.width, image.extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = image.samples;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = image.usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(device, &imageInfo, nullptr, &image.handle) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create render graph image " + image.name);
+		}
+		vkGetImageMemoryRequirements(device, image.handle, &image.memoryRequirements);
+
+		transientImages.push_back(i);
+		++stats.transientImageCount;
+		stats.unaliasedTransientBytes += image.memoryRequirements.size;
+	}
+
+	// Largest first, so the smaller images fill the slots the large ones made.
+	std::stable_sort(transientImages.begin(), transientImages.end(), [this](RenderGraphImage a, RenderGraphImage b) {
+		return images[a].memoryRequirements.size > images[b].memoryRequirements.size;
+	});
+
+	for (RenderGraphImage i : transientImages) {
+		Image& image = images[i];
+
+		for (uint32_t slotIndex = 0; slotIndex < aliasSlots.size() && image.aliasSlot == UINT32_MAX; ++slotIndex) {
+			AliasSlot& slot = aliasSlots[slotIndex];
+			if ((slot.requirements.memoryTypeBits & image.memoryRequirements.memoryTypeBits) == 0) {
+				continue;
+			}
+			// Only transient attachments may live in lazily allocated memory, they don't share it with the others.
+			if ((slot.usage ^ image.usage) & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+				continue;
+			}
+
+			bool overlaps = false;
+			for (RenderGraphImage other : slot.images) {
+				if (image.firstStep <= images[other].lastStep && images[other].firstStep <= image.lastStep) {
+					overlaps = true;
+					break;
+				}
+			}
+			if (overlaps) {
+				continue;
+			}
+
+			slot.requirements.size = std::max(slot.requirements.size, image.memoryRequirements.size);
+			slot.requirements.alignment = std::max(slot.requirements.alignment, image.memoryRequirements.alignment);
+			slot.requirements.memoryTypeBits &= image.memoryRequirements.memoryTypeBits;
+			slot.images.push_back(i);
+			image.aliasSlot = slotIndex;
+		}
+
+		if (image.aliasSlot == UINT32_MAX) {
+			AliasSlot slot;
+			slot.usage = image.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			slot.requirements = image.memoryRequirements;
+			slot.images.push_back(i);
+			aliasSlots.push_back(slot);
+			image.aliasSlot = static_cast<uint32_t>(aliasSlots.size() - 1);
+		}
+	}
+
+	for (AliasSlot& slot : aliasSlots) {
+		VkMemoryPropertyFlags preferredProperties = (slot.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) ?
+			VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0;
+		slot.allocation = allocator->Allocate(slot.requirements, GpuResourceKind::Optimal, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			preferredProperties);
+
+		stats.transientBytes += slot.requirements.size;
+		if (allocator->GetMemoryProperties(slot.allocation) & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+			stats.lazilyAllocatedBytes += slot.requirements.size;
+		}
+
+		// In the order they use the memory. Each image's first use has to wait for the last use of the one before,
+		// and the first one for the last one of the previous frame.
+		std::sort(slot.images.begin(), slot.images.end(), [this](RenderGraphImage a, RenderGraphImage b) {
+			return images[a].firstStep < images[b].firstStep;
+		});
+
+		for (size_t j = 0; j < slot.images.size(); ++j) {
+			Image& image = images[slot.images[j]];
+			const UsageInfo& previousUse = lastUses[slot.images[(j + slot.images.size() - 1) % slot.images.size()]];
+			image.aliasedState = { VK_IMAGE_LAYOUT_UNDEFINED, previousUse.stageMask, previousUse.accessMask };
+
+			if (vkBindImageMemory(device, image.handle, slot.allocation.memory, slot.allocation.offset) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to bind memory of render graph image " + image.name);
+			}
+
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = image.handle;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = image.format;
+			viewInfo.subresourceRange.aspectMask = GetAspectMask(image.format);
+			viewInfo.subresourceRange.baseMipLevel = 0;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+			viewInfo.subresourceRange.layerCount = 1;
+
+			if (vkCreateImageView(device, &viewInfo, nullptr, &image.view) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create view of render graph image " + image.name);
+			}
+		}
+	}
+
+	stats.transientAllocationCount = static_cast<uint32_t>(aliasSlots.size());
+}
+
+
+void RenderGraph::DeriveSynchronization()
+{
+	std::vector<Track> tracks(images.size());
+	for (size_t i = 0; i < images.size(); ++i) {
+		const Image& image = images[i];
+		if (image.isImported) {
+			tracks[i].state = image.initialState;
+			tracks[i].hasContents = image.initialState.layout != VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		else {
+			tracks[i].state = image.aliasedState;
+		}
+	}
+
+	for (uint32_t stepIndex = 0; stepIndex < steps.size(); ++stepIndex) {
+		Step& step = steps[stepIndex];
+
+		if (step.isRenderPass) {
+			BuildRenderPass(stepIndex, tracks);
+		}
+		else {
+			for (const ImageUse& use : passes[step.passes[0]].uses) {
+				AddBarrier(step, use, tracks[use.image]);
+			}
+		}
+	}
+
+	// Whatever comes after the graph expects the imported images in their final state.
+	for (size_t i = 0; i < images.size(); ++i) {
+		const Image& image = images[i];
+		const Track& track = tracks[i];
+		if (!image.isImported || track.isSynced) {
+			continue;
+		}
+
+		bool isAfterWrite = (track.state.accessMask & WRITE_ACCESSES) != 0 && image.finalState.accessMask != 0;
+		if (track.state.layout == image.finalState.layout && !isAfterWrite) {
+			continue;
+		}
+
+		Barrier barrier;
+		barrier.image = static_cast<RenderGraphImage>(i);
+		barrier.oldLayout = track.hasContents ? track.state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = image.finalState.layout;
+		barrier.srcAccessMask = track.state.accessMask & WRITE_ACCESSES;
+		barrier.dstAccessMask = image.finalState.accessMask;
+		finalStep.barriers.push_back(barrier);
+		finalStep.srcStageMask |= track.state.stageMask;
+		finalStep.dstStageMask |= image.finalState.stageMask;
+	}
+}
+
+
+void RenderGraph::BuildRenderPass(uint32_t stepIndex, std::vector<Track>& tracks)
+{
+	Step& step = steps[stepIndex];
+	step.extent = GetPassExtent(passes[step.passes[0]]);
+
+	RenderPassBuilder builder;
+
+	// Sampled images are transitioned before the render pass begins.
+	for (uint32_t passIndex : step.passes) {
+		for (const ImageUse& use : passes[passIndex].uses) {
+			if (!GetUsageInfo(use.usage, images[use.image].format).isAttachment) {
+				AddBarrier(step, use, tracks[use.image]);
+			}
+		}
+	}
+
+	// Attachments in the order of their first use, with the subpass and the use that touched them last.
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<uint32_t> lastSubpasses;
+	std::vector<UsageInfo> lastUses;
+	std::unordered_map<RenderGraphImage, uint32_t> attachmentIndices;
+
+	struct SubpassReferences
+	{
+		std::vector<VkAttachmentReference> colors;
+		std::vector<VkAttachmentReference> resolves;
+		std::vector<VkAttachmentReference> inputs;
+		VkAttachmentReference depthStencil{};
+		bool hasDepthStencil = false;
+	};
+	std::vector<SubpassReferences> subpasses(step.passes.size());
+
+	for (uint32_t subpass = 0; subpass < step.passes.size(); ++subpass) {
+		for (const ImageUse& use : passes[step.passes[subpass]].uses) {
+			const Image& image = images[use.image];
+			UsageInfo info = GetUsageInfo(use.usage, image.format);
+			if (!info.isAttachment) {
+				continue;
+			}
+
+			auto found = attachmentIndices.find(use.image);
+			uint32_t index = 0;
+
+			if (found == attachmentIndices.end()) {
+				Track& track = tracks[use.image];
+				bool isLoaded = info.readsContents && !use.isCleared && track.hasContents;
+
+				VkAttachmentDescription attachment{};
+				attachment.format = image.format;
+				attachment.samples = image.samples;
+				attachment.loadOp = use.isCleared ? VK_ATTACHMENT_LOAD_OP_CLEAR : (isLoaded ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+				attachment.stencilLoadOp = HasStencil(image.format) ? attachment.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+				// Without contents to keep, the old layout doesn't matter and the transition may discard them.
+				attachment.initialLayout = isLoaded ? track.state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+				index = static_cast<uint32_t>(attachments.size());
+				attachments.push_back(attachment);
+				lastSubpasses.push_back(subpass);
+				lastUses.push_back(info);
+				attachmentIndices[use.image] = index;
+
+				step.attachments.push_back(use.image);
+				step.clearValues.push_back(use.clearValue);
+
+				// The load op and the layout transition wait for the last use before the render pass.
+				builder.AddDependency(VK_SUBPASS_EXTERNAL, subpass, track.state.stageMask, track.state.accessMask,
+					info.stageMask, info.accessMask);
+			}
+			else {
+				index = found->second;
+
+				if (lastSubpasses[index] != subpass) {
+					// Attachments are only read at the pixel they were written at, so the dependency is per region.
+					builder.AddDependency(lastSubpasses[index], subpass, lastUses[index].stageMask, lastUses[index].accessMask,
+						info.stageMask, info.accessMask, VK_DEPENDENCY_BY_REGION_BIT);
+				}
+
+				lastSubpasses[index] = subpass;
+				lastUses[index] = info;
+			}
+
+			VkAttachmentReference reference{};
+			reference.attachment = index;
+			reference.layout = info.layout;
+
+			SubpassReferences& references = subpasses[subpass];
+			switch (use.usage) {
+			case RenderGraphUsage::ColorAttachment:
+				references.colors.push_back(reference);
+				break;
+			case RenderGraphUsage::ResolveAttachment:
+				references.resolves.push_back(reference);
+				break;
+			case RenderGraphUsage::InputAttachment:
+				references.inputs.push_back(reference);
+				break;
+			default:
+				references.depthStencil = reference;
+				references.hasDepthStencil = true;
+				break;
+			}
+		}
+	}
+
+	// Store what's used later, and leave each attachment in the layout of its next use.
+	for (uint32_t index = 0; index < attachments.size(); ++index) {
+		RenderGraphImage imageIndex = step.attachments[index];
+		const Image& image = images[imageIndex];
+		Track& track = tracks[imageIndex];
+		VkAttachmentDescription& attachment = attachments[index];
+		const UsageInfo& lastUse = lastUses[index];
+
+		uint32_t nextStep = 0;
+		const ImageUse* nextUse = FindNextUse(imageIndex, stepIndex, &nextStep);
+
+		bool isStored = nextUse != nullptr ?
+			GetUsageInfo(nextUse->usage, image.format).readsContents && !nextUse->isCleared : image.isImported;
+		attachment.storeOp = isStored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.stencilStoreOp = HasStencil(image.format) ? attachment.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		track.hasContents = isStored;
+
+		if (nextUse != nullptr && !steps[nextStep].isRenderPass) {
+			// A command pass comes next. The render pass transitions the image for it, its dependency replaces the barrier.
+			UsageInfo next = GetUsageInfo(nextUse->usage, image.format);
+			attachment.finalLayout = next.layout;
+			builder.AddDependency(lastSubpasses[index], VK_SUBPASS_EXTERNAL, lastUse.stageMask, lastUse.accessMask,
+				next.stageMask, next.accessMask);
+
+			track.state = { next.layout, next.stageMask, 0 };
+			track.isSynced = true;
+		}
+		else if (nextUse == nullptr && image.isImported) {
+			// Last use in the frame. Presentation needs no dependency, its semaphore waits for all commands.
+			attachment.finalLayout = image.finalState.layout;
+			if (image.finalState.accessMask != 0) {
+				builder.AddDependency(lastSubpasses[index], VK_SUBPASS_EXTERNAL, lastUse.stageMask, lastUse.accessMask,
+					image.finalState.stageMask, image.finalState.accessMask);
+			}
+
+			track.state = { image.finalState.layout, lastUse.stageMask, 0 };
+			track.isSynced = true;
+		}
+		else {
+			// Another render pass or a sampled read is next, it synchronizes with the state left here.
+			attachment.finalLayout = lastUse.layout;
+			track.state = { lastUse.layout, lastUse.stageMask, lastUse.accessMask };
+		}
+	}
+
+	for (const VkAttachmentDescription& attachment : attachments) {
+		builder.AddAttachment(attachment);
+	}
+	for (const SubpassReferences& references : subpasses) {
+		builder.AddSubpass(references.colors, references.hasDepthStencil ? &references.depthStencil : nullptr,
+			references.resolves, references.inputs);
+	}
+
+	const VkRenderPassCreateInfo& createInfo = builder.GetCreateInfo();
+	step.renderPass = AcquireRenderPass(createInfo);
+	step.renderPassHash = HashRenderPassCompatibility(createInfo);
+}
+
+
+void RenderGraph::AddBarrier(Step& step, const ImageUse& use, Track& track)
+{
+	UsageInfo info = GetUsageInfo(use.usage, images[use.image].format);
+
+	bool isSynced = track.isSynced;
+	bool isLayoutChange = track.state.layout != info.layout;
+	bool isAfterWrite = (track.state.accessMask & WRITE_ACCESSES) != 0;
+
+	// Reads after reads in the same layout need nothing.
+	if (!isSynced && (isLayoutChange || isAfterWrite || info.isWrite)) {
+		Barrier barrier;
+		barrier.image = use.image;
+		barrier.oldLayout = track.hasContents ? track.state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = info.layout;
+		barrier.srcAccessMask = track.state.accessMask & WRITE_ACCESSES;
+		barrier.dstAccessMask = info.accessMask;
+		step.barriers.push_back(barrier);
+		step.srcStageMask |= track.state.stageMask;
+		step.dstStageMask |= info.stageMask;
+	}
+
+	track.state = { info.layout, info.stageMask, info.accessMask };
+	track.hasContents = track.hasContents || info.isWrite;
+	track.isSynced = false;
+}
+
+
+const RenderGraph::ImageUse* RenderGraph::FindNextUse(RenderGraphImage image, uint32_t stepIndex, uint32_t* nextStep) const
+{
+	for (uint32_t i = stepIndex + 1; i < steps.size(); ++i) {
+		for (uint32_t passIndex : steps[i].passes) {
+			for (const ImageUse& use : passes[passIndex].uses) {
+				if (use.image == image) {
+					*nextStep = i;
+					return &use;
+				}
+			}
+		}
+	}
+	return nullptr;
+}
+
+
+VkExtent2D RenderGraph::GetPassExtent(const Pass& pass) const
+{
+	for (const ImageUse& use : pass.uses) {
+		if (GetUsageInfo(use.usage, images[use.image].format).isAttachment) {
+			return images[use.image].extent;
+		}
+	}
+	return { 0, 0 };
+}
+
+
+VkRenderPass RenderGraph::AcquireRenderPass(const VkRenderPassCreateInfo& createInfo)
+{
+	uint64_t hash = HashRenderPassDescription(createInfo);
+
+	auto found = renderPasses.find(hash);
+	if (found != renderPasses.end()) {
+		return found->second;
+	}
+
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	if (vkCreateRenderPass(device, &createInfo, nullptr, &renderPass) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create render pass");
+	}
+
+	renderPasses[hash] = renderPass;
+	return renderPass;
+}
+
+
+VkFramebuffer RenderGraph::AcquireFramebuffer(uint32_t stepIndex)
+{
+	const Step& step = steps[stepIndex];
+
+	std::vector<VkImageView> views;
+	Hasher hasher;
+	hasher.Add(stepIndex);
+	for (RenderGraphImage image : step.attachments) {
+		if (images[image].view == VK_NULL_HANDLE) {
+			throw std::runtime_error("Render graph image " + images[image].name + " is not bound");
+		}
+		views.push_back(images[image].view);
+		hasher.Add(images[image].view);
+	}
+
+	auto found = framebuffers.find(hasher.Get());
+	if (found != framebuffers.end()) {
+		return found->second;
+	}
+
+	VkFramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = step.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+	framebufferInfo.pAttachments = views.data();
+	framebufferInfo.width = step.extent.width;
+	framebufferInfo.height = step.extent.height;
+	framebufferInfo.layers = 1;
+
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create framebuffer");
+	}
+
+	framebuffers[hasher.Get()] = framebuffer;
+	return framebuffer;
+}
+
+
+void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const Step& step) const
+{
+	if (step.barriers.empty()) {
+		return;
+	}
+
+	// All transitions of the step in a single call, so the driver can wait once for all of them.
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	for (const Barrier& barrier : step.barriers) {
+		const Image& image = images[barrier.image];
+		if (image.handle == VK_NULL_HANDLE) {
+			throw std::runtime_error("Render graph image " + image.name + " is not bound");
+		}
+
+		VkImageMemoryBarrier imageBarrier{};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = barrier.srcAccessMask;
+		imageBarrier.dstAccessMask = barrier.dstAccessMask;
+		imageBarrier.oldLayout = barrier.oldLayout;
+		imageBarrier.newLayout = barrier.newLayout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = image.handle;
+		imageBarrier.subresourceRange.aspectMask = GetAspectMask(image.format);
+		imageBarrier.subresourceRange.baseMipLevel = 0;
+		imageBarrier.subresourceRange.levelCount = 1;
+		imageBarrier.subresourceRange.baseArrayLayer = 0;
+		imageBarrier.subresourceRange.layerCount = 1;
+		imageBarriers.push_back(imageBarrier);
+	}
+
+	vkCmdPipelineBarrier(commandBuffer,
+		step.srcStageMask != 0 ? step.srcStageMask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		step.dstStageMask != 0 ? step.dstStageMask : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+
+void RenderGraph::DestroyTransientImages()
+{
+	for (Image& image : images) {
+		if (image.isImported) {
+			continue;
+		}
+		if (image.view != VK_NULL_HANDLE) {
+			vkDestroyImageView(device, image.view, nullptr);
+			image.view = VK_NULL_HANDLE;
+		}
+		if (image.handle != VK_NULL_HANDLE) {
+			vkDestroyImage(device, image.handle, nullptr);
+			image.handle = VK_NULL_HANDLE;
+		}
+	}
+
+	for (AliasSlot& slot : aliasSlots) {
+		allocator->Free(slot.allocation);
+	}
+	aliasSlots.clear();
+}
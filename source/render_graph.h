@@ -0,0 +1,290 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gpu_allocator.h"
+
+
+// Index of an image in a RenderGraph.
+using RenderGraphImage = uint32_t;
+
+
+// How a pass uses an image. Decides the layout, the stages and the accesses of the use.
+enum class RenderGraphUsage
+{
+	// Attachments, graphics passes only. Color and depth attachments keep the contents of earlier passes
+	// unless the pass clears them.
+	ColorAttachment,
+	DepthStencilAttachment,
+	// Target of the multisample resolve of the color attachment at the same position in the pass.
+	ResolveAttachment,
+	// Read by the fragment shader at the same pixel it's writing.
+	InputAttachment,
+
+	// Read with a sampler by the fragment shader of a graphics pass.
+	FragmentSampled,
+
+	// Command passes only.
+	TransferSource,
+	TransferDestination,
+};
+
+
+enum class RenderGraphPassKind
+{
+	// Records inside a render pass instance. Consecutive graphics passes become subpasses of one render pass
+	// when nothing between them needs their attachments outside of it.
+	Graphics,
+	// Records outside of render passes: copies, dispatches.
+	Commands,
+};
+
+
+// Layout of an image, and the stages and accesses of its last or next use.
+struct RenderGraphImageState
+{
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	VkAccessFlags accessMask = 0;
+};
+
+
+// What a pass records with. Graphics passes get their render pass, subpass and framebuffer, for secondary command
+// buffers. Command passes get null handles.
+struct RenderGraphPassContext
+{
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+	VkExtent2D extent{};
+};
+
+using RenderGraphRecordFunction = std::function<void(VkCommandBuffer commandBuffer, const RenderGraphPassContext& context)>;
+
+
+struct RenderGraphStats
+{
+	uint32_t passCount = 0;
+	uint32_t culledPassCount = 0;
+	uint32_t renderPassCount = 0;
+	uint32_t barrierCount = 0;
+
+	uint32_t transientImageCount = 0;
+	uint32_t transientAllocationCount = 0;
+	// Memory of the transient images, and what it would be if none of them shared memory.
+	VkDeviceSize transientBytes = 0;
+	VkDeviceSize unaliasedTransientBytes = 0;
+	// The part of transientBytes in lazily allocated memory.
+	VkDeviceSize lazilyAllocatedBytes = 0;
+};
+
+
+// Describes a frame as passes and the images they use, and derives everything in between.
+//
+// Passes are declared in the order they would run in. Compile():
+// - Culls passes whose results nothing uses. Results are imported images, which outlive the frame, and passes with
+//   side effects, like copies into buffers the graph doesn't know about.
+// - Orders the rest by their dependencies, keeping graphics passes that can share a render pass next to each other.
+// - Merges consecutive graphics passes into subpasses of one render pass, unless a pass samples what another one wrote.
+//   Tile based GPUs then keep the attachments on chip between the passes.
+// - Picks load and store ops. Attachments are only loaded if earlier contents are used and only stored if something
+//   reads them later, the rest of the bandwidth is saved.
+// - Derives the layout transitions and the synchronization: subpass dependencies inside and at the edges of render
+//   passes, and one batched pipeline barrier before command passes that need one.
+// - Creates the transient images with the usage flags their passes need. Images that are never alive at the same
+//   time share memory. Images that only live inside one render pass are created with
+//   VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT and put into lazily allocated memory where the device has it. Tile based
+//   GPUs keep them on chip and never back that memory with pages.
+//
+// Render passes are kept across Reset() and reused by any later compile with the same description, so pipelines
+// created for them stay valid as long as the graph.
+//
+// Not thread safe. Passes record on the thread that calls Execute().
+class RenderGraph
+{
+public:
+	void Init(VkDevice device, GpuAllocator& allocator);
+
+	// Expects the GPU to be done with the graph's images and render passes.
+	void Destroy();
+
+	// Drops the passes, the images and the framebuffers, to describe the graph again. Expects the GPU to be done
+	// with them.
+	void Reset();
+
+	// An image owned by someone else, bound with BindImage() before every Execute(). initialState is what the commands
+	// before the graph leave behind, its layout may be VK_IMAGE_LAYOUT_UNDEFINED if the contents don't matter.
+	// finalState is what the commands after the graph expect.
+	RenderGraphImage ImportImage(const std::string& name, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples,
+		const RenderGraphImageState& initialState, const RenderGraphImageState& finalState);
+
+	// An image created by Compile(). Its contents are undefined at the start of every frame.
+	RenderGraphImage CreateImage(const std::string& name, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples);
+
+	uint32_t AddPass(const std::string& name, RenderGraphPassKind kind, RenderGraphRecordFunction record);
+
+	void UseImage(uint32_t pass, RenderGraphImage image, RenderGraphUsage usage);
+
+	// Like UseImage(), for color and depth attachments that are cleared at the start of the pass instead of loaded.
+	void ClearImage(uint32_t pass, RenderGraphImage image, RenderGraphUsage usage, const VkClearValue& clearValue);
+
+	// The pass does more than writing images of the graph, it's never culled.
+	void SetSideEffects(uint32_t pass);
+
+	// Graphics passes only. VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS if the pass executes secondary command buffers.
+	void SetSubpassContents(uint32_t pass, VkSubpassContents contents);
+
+	void Compile();
+
+	void BindImage(RenderGraphImage image, VkImage handle, VkImageView view);
+
+	// Records the passes that survived culling into commandBuffer, with their barriers and render passes.
+	void Execute(VkCommandBuffer commandBuffer);
+
+	// After Compile(). Null and 0 for culled and command passes.
+	VkRenderPass GetRenderPass(uint32_t pass) const;
+	uint64_t GetRenderPassHash(uint32_t pass) const;
+	uint32_t GetSubpass(uint32_t pass) const;
+
+	const RenderGraphStats& GetStats() const { return stats; }
+
+	// Execution order and merges, e.g. "[scene + tonemap] -> readback".
+	std::string GetSummary() const;
+
+private:
+	struct ImageUse
+	{
+		RenderGraphImage image = 0;
+		RenderGraphUsage usage = RenderGraphUsage::ColorAttachment;
+		bool isCleared = false;
+		VkClearValue clearValue{};
+	};
+
+	struct Pass
+	{
+		std::string name;
+		RenderGraphPassKind kind = RenderGraphPassKind::Graphics;
+		RenderGraphRecordFunction record;
+		std::vector<ImageUse> uses;
+		bool hasSideEffects = false;
+		VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+
+		// Set by Compile().
+		bool isLive = false;
+		uint32_t step = 0;
+		uint32_t subpass = 0;
+	};
+
+	struct Image
+	{
+		std::string name;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent{};
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+		bool isImported = false;
+		RenderGraphImageState initialState;
+		RenderGraphImageState finalState;
+
+		VkImage handle = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+
+		// Transient images, set by Compile(). Steps are indices into steps, the image is alive from the first to the last.
+		VkImageUsageFlags usage = 0;
+		VkMemoryRequirements memoryRequirements{};
+		uint32_t firstStep = UINT32_MAX;
+		uint32_t lastStep = 0;
+		uint32_t aliasSlot = UINT32_MAX;
+		// State left by whatever used the image's memory before, in this frame or the previous one.
+		RenderGraphImageState aliasedState;
+	};
+
+	struct Barrier
+	{
+		RenderGraphImage image = 0;
+		VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkAccessFlags srcAccessMask = 0;
+		VkAccessFlags dstAccessMask = 0;
+	};
+
+	// A render pass with one or more graphics passes as subpasses, or a single command pass. Barriers are recorded before it.
+	struct Step
+	{
+		std::vector<uint32_t> passes;
+		bool isRenderPass = false;
+
+		std::vector<Barrier> barriers;
+		VkPipelineStageFlags srcStageMask = 0;
+		VkPipelineStageFlags dstStageMask = 0;
+
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		uint64_t renderPassHash = 0;
+		std::vector<RenderGraphImage> attachments;
+		std::vector<VkClearValue> clearValues;
+		VkExtent2D extent{};
+	};
+
+	// An image while Compile() walks through the steps.
+	struct Track
+	{
+		RenderGraphImageState state;
+		bool hasContents = false;
+		// The previous step already synchronized the image with its next use.
+		bool isSynced = false;
+	};
+
+	// Memory shared by transient images whose lifetimes don't overlap.
+	struct AliasSlot
+	{
+		std::vector<RenderGraphImage> images;
+		// VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT if the images are transient attachments.
+		VkImageUsageFlags usage = 0;
+		VkMemoryRequirements requirements{};
+		GpuAllocation allocation;
+	};
+
+	// Compile() stages.
+	void ValidatePasses() const;
+	void CullPasses();
+	void SchedulePasses();
+	bool CanMergeIntoStep(const Step& step, uint32_t pass) const;
+	void CreateTransientImages();
+	void DeriveSynchronization();
+	void BuildRenderPass(uint32_t stepIndex, std::vector<Track>& tracks);
+	void AddBarrier(Step& step, const ImageUse& use, Track& track);
+	// The first use of image by a pass after the step, or null if there is none.
+	const ImageUse* FindNextUse(RenderGraphImage image, uint32_t stepIndex, uint32_t* nextStep) const;
+
+	VkExtent2D GetPassExtent(const Pass& pass) const;
+	VkRenderPass AcquireRenderPass(const VkRenderPassCreateInfo& createInfo);
+	VkFramebuffer AcquireFramebuffer(uint32_t stepIndex);
+	void RecordBarriers(VkCommandBuffer commandBuffer, const Step& step) const;
+	void DestroyTransientImages();
+
+	VkDevice device = VK_NULL_HANDLE;
+	GpuAllocator* allocator = nullptr;
+
+	std::vector<Pass> passes;
+	std::vector<Image> images;
+
+	std::vector<Step> steps;
+	// Transitions of imported images into their final state, after the last step.
+	Step finalStep;
+
+	std::vector<AliasSlot> aliasSlots;
+
+	// By the hash of the whole create info, see AcquireRenderPass().
+	std::unordered_map<uint64_t, VkRenderPass> renderPasses;
+	// By the hash of the step and its attachment views.
+	std::unordered_map<uint64_t, VkFramebuffer> framebuffers;
+
+	RenderGraphStats stats;
+	bool isCompiled = false;
+};
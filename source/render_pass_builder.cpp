@@ -0,0 +1,175 @@
+#include "render_pass_builder.h"
+
+#include <stdexcept>
+
+
+static const VkPipelineStageFlags SHADER_STAGES = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+	VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+	VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+static const VkPipelineStageFlags GRAPHICS_STAGES = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+	VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+	VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
+	VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+	VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+
+// The stages that can perform an access, from the table of supported access types in the specification.
+static VkPipelineStageFlags GetAccessStages(VkAccessFlagBits access)
+{
+	switch (access) {
+	case VK_ACCESS_INDIRECT_COMMAND_READ_BIT:
+		return VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	case VK_ACCESS_INDEX_READ_BIT:
+	case VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT:
+		return VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	case VK_ACCESS_UNIFORM_READ_BIT:
+	case VK_ACCESS_SHADER_READ_BIT:
+	case VK_ACCESS_SHADER_WRITE_BIT:
+		return SHADER_STAGES;
+	case VK_ACCESS_INPUT_ATTACHMENT_READ_BIT:
+		return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	case VK_ACCESS_COLOR_ATTACHMENT_READ_BIT:
+	case VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT:
+		return VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	case VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT:
+	case VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT:
+		return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	case VK_ACCESS_TRANSFER_READ_BIT:
+	case VK_ACCESS_TRANSFER_WRITE_BIT:
+		return VK_PIPELINE_STAGE_TRANSFER_BIT;
+	case VK_ACCESS_HOST_READ_BIT:
+	case VK_ACCESS_HOST_WRITE_BIT:
+		return VK_PIPELINE_STAGE_HOST_BIT;
+	default:
+		// VK_ACCESS_MEMORY_READ/WRITE_BIT and accesses of extensions this table doesn't know are kept.
+		return VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	}
+}
+
+
+VkAccessFlags GetStageAccesses(VkPipelineStageFlags stageMask, VkAccessFlags accessMask)
+{
+	if (stageMask & VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) {
+		return accessMask;
+	}
+	if (stageMask & VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT) {
+		stageMask |= GRAPHICS_STAGES;
+	}
+
+	VkAccessFlags supported = 0;
+	for (uint32_t bit = 0; bit < 32; ++bit) {
+		VkAccessFlagBits access = static_cast<VkAccessFlagBits>(1u << bit);
+		if (!(accessMask & access)) {
+			continue;
+		}
+
+		VkPipelineStageFlags accessStages = GetAccessStages(access);
+		if ((accessStages & stageMask) || accessStages == VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) {
+			supported |= access;
+		}
+	}
+	return supported;
+}
+
+
+uint32_t RenderPassBuilder::AddAttachment(const VkAttachmentDescription& attachment)
+{
+	attachments.push_back(attachment);
+	return static_cast<uint32_t>(attachments.size() - 1);
+}
+
+
+uint32_t RenderPassBuilder::AddSubpass(const std::vector<VkAttachmentReference>& colorAttachments,
+	const VkAttachmentReference* depthStencilAttachment, const std::vector<VkAttachmentReference>& resolveAttachments,
+	const std::vector<VkAttachmentReference>& inputAttachments)
+{
+	if (!resolveAttachments.empty() && resolveAttachments.size() != colorAttachments.size()) {
+		throw std::runtime_error("A subpass needs one resolve attachment per color attachment");
+	}
+
+	Subpass subpass;
+	subpass.colorAttachments = colorAttachments;
+	subpass.resolveAttachments = resolveAttachments;
+	subpass.inputAttachments = inputAttachments;
+	if (depthStencilAttachment != nullptr) {
+		subpass.depthStencilAttachment = *depthStencilAttachment;
+		subpass.hasDepthStencil = true;
+	}
+
+	subpasses.push_back(subpass);
+	return static_cast<uint32_t>(subpasses.size() - 1);
+}
+
+
+void RenderPassBuilder::AddDependency(uint32_t srcSubpass, uint32_t dstSubpass, VkPipelineStageFlags srcStageMask,
+	VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask, VkDependencyFlags dependencyFlags)
+{
+	VkSubpassDependency dependency{};
+	dependency.srcSubpass = srcSubpass;
+	dependency.dstSubpass = dstSubpass;
+	// Stage masks must not be empty. Top and bottom of pipe wait for nothing and block nothing.
+	dependency.srcStageMask = srcStageMask != 0 ? srcStageMask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	dependency.dstStageMask = dstStageMask != 0 ? dstStageMask : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	dependency.srcAccessMask = GetStageAccesses(dependency.srcStageMask, srcAccessMask & WRITE_ACCESSES);
+	dependency.dstAccessMask = GetStageAccesses(dependency.dstStageMask, dstAccessMask);
+	dependency.dependencyFlags = dependencyFlags;
+
+	for (VkSubpassDependency& existing : dependencies) {
+		if (existing.srcSubpass == dependency.srcSubpass && existing.dstSubpass == dependency.dstSubpass &&
+			existing.dependencyFlags == dependency.dependencyFlags) {
+
+			existing.srcStageMask |= dependency.srcStageMask;
+			existing.dstStageMask |= dependency.dstStageMask;
+			existing.srcAccessMask |= dependency.srcAccessMask;
+			existing.dstAccessMask |= dependency.dstAccessMask;
+			return;
+		}
+	}
+
+	dependencies.push_back(dependency);
+}
+
+
+const VkRenderPassCreateInfo& RenderPassBuilder::GetCreateInfo()
+{
+	subpassDescriptions.resize(subpasses.size());
+	for (size_t i = 0; i < subpasses.size(); ++i) {
+		const Subpass& subpass = subpasses[i];
+
+		VkSubpassDescription description{};
+		description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		description.inputAttachmentCount = static_cast<uint32_t>(subpass.inputAttachments.size());
+		description.pInputAttachments = subpass.inputAttachments.data();
+		description.colorAttachmentCount = static_cast<uint32_t>(subpass.colorAttachments.size());
+		description.pColorAttachments = subpass.colorAttachments.data();
+		description.pResolveAttachments = subpass.resolveAttachments.empty() ? nullptr : subpass.resolveAttachments.data();
+		description.pDepthStencilAttachment = subpass.hasDepthStencil ? &subpass.depthStencilAttachment : nullptr;
+		subpassDescriptions[i] = description;
+	}
+
+	createInfo = VkRenderPassCreateInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	createInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	createInfo.pAttachments = attachments.data();
+	createInfo.subpassCount = static_cast<uint32_t>(subpassDescriptions.size());
+	createInfo.pSubpasses = subpassDescriptions.data();
+	createInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	createInfo.pDependencies = dependencies.data();
+
+	return createInfo;
+}
+
+
+VkRenderPass RenderPassBuilder::Create(VkDevice device)
+{
+	if (subpasses.empty()) {
+		throw std::runtime_error("A render pass needs at least one subpass");
+	}
+
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	if (vkCreateRenderPass(device, &GetCreateInfo(), nullptr, &renderPass) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create render pass");
+	}
+	return renderPass;
+}
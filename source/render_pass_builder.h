@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+
+// Describes a render pass as data: attachments, subpasses and the dependencies between them. The VkRenderPass is only
+// created by Create(), once the description is complete, so nothing added to it can be left out of the render pass.
+//
+// Dependencies are reduced to what they have to do as they are added:
+// - Access flags that none of the dependency's stages perform are dropped.
+// - Read accesses are dropped from the source side. Only writes have to be made available, a source read only
+//   needs the execution dependency the stage mask already gives.
+// - Dependencies between the same pair of subpasses with the same flags are merged into one.
+// The driver turns every dependency into a barrier, so fewer and narrower dependencies mean fewer and cheaper barriers.
+class RenderPassBuilder
+{
+public:
+	// Returns the index to reference the attachment with.
+	uint32_t AddAttachment(const VkAttachmentDescription& attachment);
+
+	// resolveAttachments is empty or has one entry per color attachment. Returns the index of the subpass.
+	uint32_t AddSubpass(const std::vector<VkAttachmentReference>& colorAttachments,
+		const VkAttachmentReference* depthStencilAttachment = nullptr,
+		const std::vector<VkAttachmentReference>& resolveAttachments = {},
+		const std::vector<VkAttachmentReference>& inputAttachments = {});
+
+	// srcSubpass or dstSubpass may be VK_SUBPASS_EXTERNAL for the commands before or after the render pass.
+	void AddDependency(uint32_t srcSubpass, uint32_t dstSubpass, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask,
+		VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask, VkDependencyFlags dependencyFlags = 0);
+
+	const std::vector<VkSubpassDependency>& GetDependencies() const { return dependencies; }
+
+	// Points into the builder, valid until it's changed or destroyed. For HashRenderPassCompatibility().
+	const VkRenderPassCreateInfo& GetCreateInfo();
+
+	VkRenderPass Create(VkDevice device);
+
+private:
+	struct Subpass
+	{
+		std::vector<VkAttachmentReference> colorAttachments;
+		std::vector<VkAttachmentReference> resolveAttachments;
+		std::vector<VkAttachmentReference> inputAttachments;
+		VkAttachmentReference depthStencilAttachment{};
+		bool hasDepthStencil = false;
+	};
+
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<Subpass> subpasses;
+	std::vector<VkSubpassDependency> dependencies;
+
+	std::vector<VkSubpassDescription> subpassDescriptions;
+	VkRenderPassCreateInfo createInfo{};
+};
+
+
+// Accesses that write memory. Only they have to be made available by the source side of a dependency.
+const VkAccessFlags WRITE_ACCESSES = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+	VK_ACCESS_MEMORY_WRITE_BIT;
+
+
+// The access flags of accessMask that a stage of stageMask can perform.
+VkAccessFlags GetStageAccesses(VkPipelineStageFlags stageMask, VkAccessFlags accessMask);
@@ -0,0 +1,164 @@
+#include "shader_compiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include "hash.h"
+
+
+// Part of every cache key. Bump it when the compile options change, so old results are not used anymore.
+static const uint32_t SHADER_CACHE_VERSION = 1;
+
+
+static shaderc_shader_kind GetShaderKind(VkShaderStageFlagBits stage)
+{
+	switch (stage) {
+	case VK_SHADER_STAGE_VERTEX_BIT:
+		return shaderc_vertex_shader;
+	case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+		return shaderc_tess_control_shader;
+	case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+		return shaderc_tess_evaluation_shader;
+	case VK_SHADER_STAGE_GEOMETRY_BIT:
+		return shaderc_geometry_shader;
+	case VK_SHADER_STAGE_FRAGMENT_BIT:
+		return shaderc_fragment_shader;
+	case VK_SHADER_STAGE_COMPUTE_BIT:
+		return shaderc_compute_shader;
+	default:
+		throw std::runtime_error("Unsupported shader stage");
+	}
+}
+
+
+void ShaderCompiler::Init(const std::string& cacheDirectory)
+{
+	this->cacheDirectory = cacheDirectory;
+	std::filesystem::create_directories(this->cacheDirectory);
+
+	compiler = shaderc_compiler_initialize();
+	if (compiler == nullptr) {
+		throw std::runtime_error("Failed to initialize shader compiler");
+	}
+}
+
+
+void ShaderCompiler::Destroy()
+{
+	if (compiler != nullptr) {
+		shaderc_compiler_release(compiler);
+		compiler = nullptr;
+	}
+
+	sourceWriteTimes.clear();
+}
+
+
+std::string ShaderCompiler::Compile(const std::string& sourcePath, VkShaderStageFlagBits stage, const std::vector<ShaderDefine>& defines)
+{
+	// Taken before reading, so an edit made while compiling is still reported by PollChangedSources().
+	std::error_code error;
+	sourceWriteTimes[sourcePath] = std::filesystem::last_write_time(sourcePath, error);
+
+	std::ifstream file(sourcePath, std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open " + sourcePath);
+	}
+	std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	Hasher hasher;
+	hasher.Add(SHADER_CACHE_VERSION);
+	hasher.Add(source);
+	hasher.Add(stage);
+	hasher.Add(defines.size());
+	for (const ShaderDefine& define : defines) {
+		hasher.Add(define.name);
+		hasher.Add(define.value);
+	}
+
+	std::ostringstream fileName;
+	fileName << std::hex << std::setw(16) << std::setfill('0') << hasher.Get() << ".spv";
+	std::filesystem::path cachePath = cacheDirectory / fileName.str();
+
+	if (std::filesystem::exists(cachePath)) {
+		++cacheHitCount;
+		return cachePath.string();
+	}
+
+	shaderc_compile_options_t options = shaderc_compile_options_initialize();
+	shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+	shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+	for (const ShaderDefine& define : defines) {
+		shaderc_compile_options_add_macro_definition(options, define.name.data(), define.name.size(), define.value.data(), define.value.size());
+	}
+
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(compiler, source.data(), source.size(), GetShaderKind(stage),
+		sourcePath.c_str(), "main", options);
+	shaderc_compile_options_release(options);
+
+	// Errors and warnings come as one text, formatted like glslc's output.
+	std::string messages = shaderc_result_get_error_message(result);
+
+	if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success) {
+		shaderc_result_release(result);
+		throw std::runtime_error("Failed to compile " + sourcePath + ":\n" + messages);
+	}
+
+	if (shaderc_result_get_num_warnings(result) > 0) {
+		std::cerr << messages;
+	}
+
+	try {
+		WriteCacheFile(cachePath, shaderc_result_get_bytes(result), shaderc_result_get_length(result));
+	}
+	catch (...) {
+		shaderc_result_release(result);
+		throw;
+	}
+
+	shaderc_result_release(result);
+	++compiledCount;
+
+	return cachePath.string();
+}
+
+
+std::vector<std::string> ShaderCompiler::PollChangedSources()
+{
+	std::vector<std::string> changedSources;
+
+	for (auto& [sourcePath, writeTime] : sourceWriteTimes) {
+		// A file that can't be queried right now is probably being saved, it's checked again on the next poll.
+		std::error_code error;
+		auto currentWriteTime = std::filesystem::last_write_time(sourcePath, error);
+
+		if (!error && currentWriteTime != writeTime) {
+			writeTime = currentWriteTime;
+			changedSources.push_back(sourcePath);
+		}
+	}
+
+	return changedSources;
+}
+
+
+void ShaderCompiler::WriteCacheFile(const std::filesystem::path& path, const char* data, size_t size)
+{
+	// Write next to the target and rename over it, so a crash never leaves a truncated module behind.
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		file.write(data, size);
+
+		if (!file.good()) {
+			throw std::runtime_error("Failed to write " + tempPath.string());
+		}
+	}
+
+	std::filesystem::rename(tempPath, path);
+}
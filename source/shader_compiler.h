@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <shaderc/shaderc.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Preprocessor define passed to the shader compiler, like -DNAME=VALUE.
+struct ShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+
+// Compiles GLSL to SPIR-V in process with shaderc (part of the Vulkan SDK).
+//
+// Results are cached on disk, named by the hash of the source, the stage and the defines. Unchanged shaders are
+// never compiled twice, not even across launches, and every distinct result has its own file, so ShaderRegistry
+// never confuses an old module with a new one.
+//
+// The compiler remembers the modification time of every source it compiled. PollChangedSources() finds the ones
+// edited since, for hot reloading. Includes are not supported, a change in an included file would go unnoticed.
+class ShaderCompiler
+{
+public:
+	void Init(const std::string& cacheDirectory);
+	void Destroy();
+
+	// Returns the path of the SPIR-V file for the source. Throws with the compiler's messages if compilation fails.
+	std::string Compile(const std::string& sourcePath, VkShaderStageFlagBits stage, const std::vector<ShaderDefine>& defines = {});
+
+	// Sources that were modified since they were last compiled. Each change is reported once.
+	std::vector<std::string> PollChangedSources();
+
+	uint32_t GetCompiledCount() const { return compiledCount; }
+	uint32_t GetCacheHitCount() const { return cacheHitCount; }
+
+private:
+	void WriteCacheFile(const std::filesystem::path& path, const char* data, size_t size);
+
+	shaderc_compiler_t compiler = nullptr;
+	std::filesystem::path cacheDirectory;
+
+	std::unordered_map<std::string, std::filesystem::file_time_type> sourceWriteTimes;
+
+	uint32_t compiledCount = 0;
+	uint32_t cacheHitCount = 0;
+};
@@ -0,0 +1,242 @@
+#include "shader_registry.h"
+
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "hash.h"
+
+
+// First word of every SPIR-V module.
+static const uint32_t SPIRV_MAGIC = 0x07230203;
+
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope.
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Failed to open " + path);
+		}
+
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx(file, &fileSize);
+		size = static_cast<size_t>(fileSize.QuadPart);
+
+		// Empty files can't be mapped. The caller rejects them anyway.
+		if (size == 0) {
+			return;
+		}
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr) {
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+#else
+		descriptor = open(path.c_str(), O_RDONLY);
+		if (descriptor < 0) {
+			throw std::runtime_error("Failed to open " + path);
+		}
+
+		struct stat fileStat{};
+		fstat(descriptor, &fileStat);
+		size = static_cast<size_t>(fileStat.st_size);
+
+		if (size == 0) {
+			return;
+		}
+
+		void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		data = mapped != MAP_FAILED ? mapped : nullptr;
+#endif
+
+		if (data == nullptr) {
+			Close();
+			throw std::runtime_error("Failed to map " + path);
+		}
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const void* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	void Close()
+	{
+#ifdef _WIN32
+		if (data != nullptr) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping != nullptr) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data != nullptr) {
+			munmap(data, size);
+		}
+		if (descriptor >= 0) {
+			close(descriptor);
+		}
+		descriptor = -1;
+#endif
+		data = nullptr;
+	}
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int descriptor = -1;
+#endif
+	void* data = nullptr;
+	size_t size = 0;
+};
+
+
+void ShaderRegistry::Init(VkDevice device)
+{
+	this->device = device;
+}
+
+
+void ShaderRegistry::Destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& [codeHash, entry] : entries) {
+		vkDestroyShaderModule(device, entry.module, nullptr);
+	}
+
+	entries.clear();
+	hashesByPath.clear();
+}
+
+
+ShaderModule ShaderRegistry::Acquire(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	ShaderModule shader;
+
+	auto foundPath = hashesByPath.find(path);
+	if (foundPath != hashesByPath.end()) {
+		shader.codeHash = foundPath->second;
+	}
+	else {
+		MappedFile file(path);
+		ValidateSpirv(path, file.GetData(), file.GetSize());
+		shader.codeHash = HashBytes(file.GetData(), file.GetSize());
+
+		// Another file with the same code may already have a module.
+		if (entries.find(shader.codeHash) == entries.end()) {
+			Entry entry;
+			entry.module = CreateModule(file.GetData(), file.GetSize());
+			entries.emplace(shader.codeHash, entry);
+		}
+
+		hashesByPath[path] = shader.codeHash;
+	}
+
+	Entry& entry = entries.at(shader.codeHash);
+	++entry.referenceCount;
+
+	shader.module = entry.module;
+	return shader;
+}
+
+
+void ShaderRegistry::AddReference(uint64_t codeHash)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	++entries.at(codeHash).referenceCount;
+}
+
+
+void ShaderRegistry::Release(uint64_t codeHash)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto found = entries.find(codeHash);
+	if (found == entries.end() || --found->second.referenceCount > 0) {
+		return;
+	}
+
+	vkDestroyShaderModule(device, found->second.module, nullptr);
+	entries.erase(found);
+
+	// The next Acquire of these paths loads the file again.
+	for (auto it = hashesByPath.begin(); it != hashesByPath.end();) {
+		it = it->second == codeHash ? hashesByPath.erase(it) : std::next(it);
+	}
+}
+
+
+uint32_t ShaderRegistry::GetModuleCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return static_cast<uint32_t>(entries.size());
+}
+
+
+void ShaderRegistry::ValidateSpirv(const std::string& path, const void* data, size_t size)
+{
+	// SPIR-V is a stream of 32 bit words starting with the magic number.
+	if (size < sizeof(uint32_t) || size % sizeof(uint32_t) != 0) {
+		throw std::runtime_error(path + " is not SPIR-V: size is not a multiple of 4 bytes");
+	}
+
+	// pCode must be 4 byte aligned. Mappings start on a page boundary, so this only fails on a broken platform.
+	if (reinterpret_cast<uintptr_t>(data) % alignof(uint32_t) != 0) {
+		throw std::runtime_error(path + " is not 4 byte aligned in memory");
+	}
+
+	// A byte swapped magic means the module was written with the other endianness, which Vulkan doesn't accept.
+	uint32_t magic = static_cast<const uint32_t*>(data)[0];
+	if (magic != SPIRV_MAGIC) {
+		throw std::runtime_error(path + " is not SPIR-V: wrong magic number");
+	}
+}
+
+
+VkShaderModule ShaderRegistry::CreateModule(const void* code, size_t size)
+{
+	// The driver copies the code, the file can be unmapped right after.
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = size;
+	createInfo.pCode = static_cast<const uint32_t*>(code);
+
+	VkShaderModule module;
+	if (vkCreateShaderModule(device, &createInfo, nullptr, &module) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create shader module");
+	}
+
+	return module;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+// A shader module owned by ShaderRegistry.
+struct ShaderModule
+{
+	VkShaderModule module = VK_NULL_HANDLE;
+
+	// Hash of the SPIR-V, identifies the module in the registry.
+	uint64_t codeHash = 0;
+};
+
+
+// Loads SPIR-V files and shares one VkShaderModule per distinct code between all users.
+//
+// Files are memory-mapped instead of read into a buffer: the driver copies the code in vkCreateShaderModule anyway,
+// so there is no reason for another copy. The mapping is page aligned, which also gives the 4 byte alignment pCode
+// requires. A file is only read the first time its path is acquired, and two files with the same code share one module.
+//
+// Modules are reference counted and destroyed when the last reference is released. Thread safe.
+class ShaderRegistry
+{
+public:
+	void Init(VkDevice device);
+
+	// Destroys all modules, referenced or not.
+	void Destroy();
+
+	// Returns the module for the file and adds a reference to it. Throws if the file is not valid SPIR-V.
+	ShaderModule Acquire(const std::string& path);
+
+	// For users that got a module from someone else, like pipelines sharing the modules of their description.
+	void AddReference(uint64_t codeHash);
+	void Release(uint64_t codeHash);
+
+	uint32_t GetModuleCount() const;
+
+private:
+	struct Entry
+	{
+		VkShaderModule module = VK_NULL_HANDLE;
+		uint32_t referenceCount = 0;
+	};
+
+	static void ValidateSpirv(const std::string& path, const void* data, size_t size);
+	VkShaderModule CreateModule(const void* code, size_t size);
+
+	VkDevice device = VK_NULL_HANDLE;
+
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, Entry> entries;
+	std::unordered_map<std::string, uint64_t> hashesByPath;
+};
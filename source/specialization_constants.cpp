@@ -0,0 +1,67 @@
+#include "specialization_constants.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+void SpecializationConstants::Set(uint32_t constantId, bool value)
+{
+	SetWord(constantId, value ? VK_TRUE : VK_FALSE);
+}
+
+
+void SpecializationConstants::Set(uint32_t constantId, int32_t value)
+{
+	SetWord(constantId, static_cast<uint32_t>(value));
+}
+
+
+void SpecializationConstants::Set(uint32_t constantId, uint32_t value)
+{
+	SetWord(constantId, value);
+}
+
+
+void SpecializationConstants::Set(uint32_t constantId, float value)
+{
+	uint32_t word;
+	std::memcpy(&word, &value, sizeof(word));
+	SetWord(constantId, word);
+}
+
+
+VkSpecializationInfo SpecializationConstants::GetInfo() const
+{
+	VkSpecializationInfo info{};
+	info.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+	info.pMapEntries = mapEntries.data();
+	info.dataSize = data.size() * sizeof(uint32_t);
+	info.pData = data.data();
+
+	return info;
+}
+
+
+void SpecializationConstants::SetWord(uint32_t constantId, uint32_t word)
+{
+	auto found = std::lower_bound(mapEntries.begin(), mapEntries.end(), constantId,
+		[](const VkSpecializationMapEntry& entry, uint32_t id) { return entry.constantID < id; });
+	size_t index = found - mapEntries.begin();
+
+	if (found != mapEntries.end() && found->constantID == constantId) {
+		data[index] = word;
+		return;
+	}
+
+	VkSpecializationMapEntry entry{};
+	entry.constantID = constantId;
+	entry.size = sizeof(uint32_t);
+
+	mapEntries.insert(found, entry);
+	data.insert(data.begin() + index, word);
+
+	// Entries after the new one moved by a word.
+	for (size_t i = index; i < mapEntries.size(); ++i) {
+		mapEntries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+
+// Values for the specialization constants of one shader stage, declared in GLSL as layout(constant_id = N) const.
+//
+// The values are set when the pipeline is created, so the driver compiles the shader with them as literals: branches
+// on them disappear and loops over them can be unrolled. One SPIR-V module serves every permutation, the pipeline
+// library creates one pipeline per distinct set of values.
+//
+// Every constant takes 4 bytes, the size of bool (as VkBool32), int, uint and float. 64 bit constants are not supported.
+class SpecializationConstants
+{
+public:
+	// Replaces the value if the constant was set before. The type must match the declaration in the shader.
+	void Set(uint32_t constantId, bool value);
+	void Set(uint32_t constantId, int32_t value);
+	void Set(uint32_t constantId, uint32_t value);
+	void Set(uint32_t constantId, float value);
+
+	bool IsEmpty() const { return mapEntries.empty(); }
+
+	// Sorted by constant id, the same values give the same entries and data no matter in which order they were set.
+	const std::vector<VkSpecializationMapEntry>& GetMapEntries() const { return mapEntries; }
+	const std::vector<uint32_t>& GetData() const { return data; }
+
+	// Points into this object, valid until the next Set().
+	VkSpecializationInfo GetInfo() const;
+
+private:
+	void SetWord(uint32_t constantId, uint32_t word);
+
+	std::vector<VkSpecializationMapEntry> mapEntries;
+
+	// One word per map entry, in the same order.
+	std::vector<uint32_t> data;
+};
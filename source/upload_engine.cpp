@@ -0,0 +1,389 @@
+#include "upload_engine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+// Offsets into the staging ring are aligned to this. Covers vkCmdCopyBufferToImage, which needs multiples of 4
+// and of the texel size, for all formats up to 16 bytes per texel.
+static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+
+void UploadEngine::Init(VkDevice device, GpuAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily,
+	VkDeviceSize stagingSize)
+{
+	this->device = device;
+	this->allocator = &allocator;
+	this->transferQueue = transferQueue;
+	this->transferFamily = transferFamily;
+	this->graphicsFamily = graphicsFamily;
+	this->stagingSize = stagingSize;
+
+	// Command buffers are recycled one by one as their batches complete.
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = transferFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create upload command pool");
+	}
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = stagingSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// Coherent, so the CPU writes are visible to the GPU without vkFlushMappedMemoryRanges.
+	stagingBuffer = allocator.CreateBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		0, stagingAllocation);
+
+	// Every batch signals the next value, so one semaphore tells which batches are complete.
+	timeline.Init(device);
+}
+
+
+void UploadEngine::Destroy()
+{
+	while (!submittedBatches.empty()) {
+		ReclaimCompletedBatches(true);
+	}
+
+	timeline.Destroy();
+	allocator->DestroyBuffer(stagingBuffer, stagingAllocation);
+
+	// Command buffers are freed together with the pool.
+	vkDestroyCommandPool(device, commandPool, nullptr);
+	freeCommandBuffers.clear();
+}
+
+
+void UploadEngine::UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+	VkDeviceSize stagingOffset = AllocateStaging(size);
+	std::memcpy(static_cast<char*>(stagingAllocation.mapped) + stagingOffset, data, size);
+
+	BufferCopy copy{};
+	copy.buffer = buffer;
+	copy.region.srcOffset = stagingOffset;
+	copy.region.dstOffset = offset;
+	copy.region.size = size;
+	copy.dstStageMask = dstStageMask;
+	copy.dstAccessMask = dstAccessMask;
+	pendingBufferCopies.push_back(copy);
+
+	uploadedBytes += size;
+}
+
+
+void UploadEngine::UploadImage(VkImage image, VkExtent3D extent, const void* data, VkDeviceSize size, VkImageLayout finalLayout,
+	VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+	VkDeviceSize stagingOffset = AllocateStaging(size);
+	std::memcpy(static_cast<char*>(stagingAllocation.mapped) + stagingOffset, data, size);
+
+	ImageCopy copy{};
+	copy.image = image;
+	copy.region.bufferOffset = stagingOffset;
+	// Zero means tightly packed.
+	copy.region.bufferRowLength = 0;
+	copy.region.bufferImageHeight = 0;
+	copy.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.region.imageSubresource.mipLevel = 0;
+	copy.region.imageSubresource.baseArrayLayer = 0;
+	copy.region.imageSubresource.layerCount = 1;
+	copy.region.imageOffset = { 0, 0, 0 };
+	copy.region.imageExtent = extent;
+	copy.finalLayout = finalLayout;
+	copy.dstStageMask = dstStageMask;
+	copy.dstAccessMask = dstAccessMask;
+	pendingImageCopies.push_back(copy);
+
+	uploadedBytes += size;
+}
+
+
+uint64_t UploadEngine::Flush()
+{
+	if (pendingBufferCopies.empty() && pendingImageCopies.empty()) {
+		return timeline.GetLastSubmittedValue();
+	}
+
+	VkCommandBuffer commandBuffer = GetCommandBuffer();
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin recording upload command buffer");
+	}
+
+	VkImageSubresourceRange colorRange{};
+	colorRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	colorRange.levelCount = 1;
+	colorRange.layerCount = 1;
+
+	// Images must be in a layout that allows copying into them. Their old contents don't matter.
+	std::vector<VkImageMemoryBarrier> toTransferBarriers;
+	for (const ImageCopy& copy : pendingImageCopies) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.image;
+		barrier.subresourceRange = colorRange;
+		toTransferBarriers.push_back(barrier);
+	}
+	if (!toTransferBarriers.empty()) {
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransferBarriers.size()), toTransferBarriers.data());
+	}
+
+	// Many small uploads to the same buffer become one vkCmdCopyBuffer with several regions.
+	std::vector<BufferCopy> sortedCopies = pendingBufferCopies;
+	std::stable_sort(sortedCopies.begin(), sortedCopies.end(),
+		[](const BufferCopy& a, const BufferCopy& b) { return a.buffer < b.buffer; });
+
+	std::vector<VkBufferCopy> regions;
+	for (size_t i = 0; i < sortedCopies.size(); ++i) {
+		regions.push_back(sortedCopies[i].region);
+
+		if (i + 1 == sortedCopies.size() || sortedCopies[i + 1].buffer != sortedCopies[i].buffer) {
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, sortedCopies[i].buffer, static_cast<uint32_t>(regions.size()), regions.data());
+			regions.clear();
+		}
+	}
+
+	for (const ImageCopy& copy : pendingImageCopies) {
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+	}
+
+	// With a dedicated transfer family this is the release half of the ownership transfer, the graphics queue acquires
+	// the resources in RecordAcquire(). Otherwise it's an ordinary barrier, and later submissions to the same queue
+	// are ordered behind it.
+	bool isOwnershipTransfer = IsDedicatedTransferQueue();
+	VkPipelineStageFlags dstStageMask = isOwnershipTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : 0;
+
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	for (const BufferCopy& copy : pendingBufferCopies) {
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		// Access masks are ignored by a release, the acquire makes the writes visible.
+		barrier.dstAccessMask = isOwnershipTransfer ? 0 : copy.dstAccessMask;
+		barrier.srcQueueFamilyIndex = isOwnershipTransfer ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = isOwnershipTransfer ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = copy.buffer;
+		barrier.offset = copy.region.dstOffset;
+		barrier.size = copy.region.size;
+		bufferBarriers.push_back(barrier);
+
+		if (!isOwnershipTransfer) {
+			dstStageMask |= copy.dstStageMask;
+		}
+	}
+
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	for (const ImageCopy& copy : pendingImageCopies) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = isOwnershipTransfer ? 0 : copy.dstAccessMask;
+		// Release and acquire must specify the same layout transition.
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = copy.finalLayout;
+		barrier.srcQueueFamilyIndex = isOwnershipTransfer ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = isOwnershipTransfer ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.image;
+		barrier.subresourceRange = colorRange;
+		imageBarriers.push_back(barrier);
+
+		if (!isOwnershipTransfer) {
+			dstStageMask |= copy.dstStageMask;
+		}
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0,
+		0, nullptr,
+		static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record upload command buffer");
+	}
+
+	SubmitBatch submit;
+	submit.AddCommandBuffer(commandBuffer);
+	submit.Signal(timeline.GetNextPoint());
+
+	if (submit.Submit(transferQueue) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit upload command buffer");
+	}
+
+	uint64_t signalValue = timeline.Advance();
+
+	submittedBatches.push_back({ signalValue, pendingStagingBytes, commandBuffer });
+	++batchCount;
+
+	unacquiredBuffers.insert(unacquiredBuffers.end(), pendingBufferCopies.begin(), pendingBufferCopies.end());
+	unacquiredImages.insert(unacquiredImages.end(), pendingImageCopies.begin(), pendingImageCopies.end());
+	unacquiredValue = signalValue;
+
+	pendingBufferCopies.clear();
+	pendingImageCopies.clear();
+	pendingStagingBytes = 0;
+
+	return signalValue;
+}
+
+
+TimelinePoint UploadEngine::RecordAcquire(VkCommandBuffer graphicsCommandBuffer, VkPipelineStageFlags& waitStageMask)
+{
+	waitStageMask = 0;
+	if (unacquiredValue == 0) {
+		return TimelinePoint{};
+	}
+
+	for (const BufferCopy& copy : unacquiredBuffers) {
+		waitStageMask |= copy.dstStageMask;
+	}
+	for (const ImageCopy& copy : unacquiredImages) {
+		waitStageMask |= copy.dstStageMask;
+	}
+
+	if (IsDedicatedTransferQueue()) {
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		for (const BufferCopy& copy : unacquiredBuffers) {
+			VkBufferMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = copy.dstAccessMask;
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			barrier.buffer = copy.buffer;
+			barrier.offset = copy.region.dstOffset;
+			barrier.size = copy.region.size;
+			bufferBarriers.push_back(barrier);
+		}
+
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		for (const ImageCopy& copy : unacquiredImages) {
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = copy.dstAccessMask;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = copy.finalLayout;
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			barrier.image = copy.image;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.layerCount = 1;
+			imageBarriers.push_back(barrier);
+		}
+
+		// The semaphore wait at waitStageMask comes first, the barrier continues the dependency chain from the same stages.
+		vkCmdPipelineBarrier(graphicsCommandBuffer, waitStageMask, waitStageMask, 0,
+			0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	TimelinePoint waitPoint = timeline.GetPoint(unacquiredValue);
+
+	unacquiredBuffers.clear();
+	unacquiredImages.clear();
+	unacquiredValue = 0;
+
+	return waitPoint;
+}
+
+
+VkDeviceSize UploadEngine::AllocateStaging(VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+	if (alignedSize > stagingSize) {
+		throw std::runtime_error("Upload is larger than the staging ring");
+	}
+
+	while (true) {
+		ReclaimCompletedBatches(false);
+
+		// Nothing in use, start over at the beginning so the whole ring is available.
+		if (stagingUsed == 0) {
+			stagingHead = 0;
+		}
+
+		// An allocation never wraps around the end of the ring. The bytes skipped at the end count as used.
+		VkDeviceSize padding = stagingHead + alignedSize > stagingSize ? stagingSize - stagingHead : 0;
+
+		if (padding + alignedSize <= stagingSize - stagingUsed) {
+			VkDeviceSize offset = (stagingHead + padding) % stagingSize;
+
+			stagingHead = offset + alignedSize;
+			stagingUsed += padding + alignedSize;
+			pendingStagingBytes += padding + alignedSize;
+
+			return offset;
+		}
+
+		// The ring is full. Older batches release their space when they complete, the queued copies only after a flush.
+		if (submittedBatches.empty()) {
+			Flush();
+		}
+		ReclaimCompletedBatches(true);
+	}
+}
+
+
+void UploadEngine::ReclaimCompletedBatches(bool waitForOldest)
+{
+	if (submittedBatches.empty()) {
+		return;
+	}
+
+	if (waitForOldest) {
+		timeline.Wait(submittedBatches.front().value);
+	}
+
+	// Batches complete in submission order, so the space they used is always at the tail of the ring.
+	while (!submittedBatches.empty() && timeline.IsComplete(submittedBatches.front().value)) {
+		stagingUsed -= submittedBatches.front().stagingBytes;
+		freeCommandBuffers.push_back(submittedBatches.front().commandBuffer);
+		submittedBatches.pop_front();
+	}
+}
+
+
+VkCommandBuffer UploadEngine::GetCommandBuffer()
+{
+	if (!freeCommandBuffers.empty()) {
+		VkCommandBuffer commandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+
+		vkResetCommandBuffer(commandBuffer, 0);
+		return commandBuffer;
+	}
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate upload command buffer");
+	}
+
+	return commandBuffer;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "gpu_allocator.h"
+#include "queue_timeline.h"
+
+
+// Streams data into device local buffers and images on a transfer queue, so uploads don't compete with rendering
+// on the graphics queue. A dedicated transfer family is usually backed by the copy (DMA) engines of the GPU.
+//
+// Data is copied into a persistently mapped staging ring right away. Flush() records all queued copies into one
+// command buffer, submits it and signals a timeline semaphore. Staging space is reused once the GPU has passed the
+// timeline value of the batch that used it.
+//
+// Resources with VK_SHARING_MODE_EXCLUSIVE belong to one queue family at a time. If the transfer family differs
+// from the graphics family, every upload ends with a release barrier on the transfer queue and needs the matching
+// acquire barrier on the graphics queue, recorded by RecordAcquire().
+//
+// Not thread safe, used from the main thread only.
+class UploadEngine
+{
+public:
+	static const VkDeviceSize DEFAULT_STAGING_SIZE = 16ull * 1024 * 1024;
+
+	// transferQueue may be the graphics queue if there is no dedicated transfer family.
+	void Init(VkDevice device, GpuAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily,
+		VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+
+	// Waits for all submitted uploads.
+	void Destroy();
+
+	// dstStageMask and dstAccessMask describe how the graphics queue uses the resource afterwards.
+	void UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+
+	// Fills mip level 0, layer 0 of a color image with tightly packed texels and leaves it in finalLayout.
+	void UploadImage(VkImage image, VkExtent3D extent, const void* data, VkDeviceSize size, VkImageLayout finalLayout,
+		VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+
+	// Submits all queued copies as a single batch. Returns the timeline value signaled when the batch is complete.
+	uint64_t Flush();
+
+	// Records the acquire barriers of all flushed uploads that were not acquired yet. The graphics submission must
+	// wait for the returned point at waitStageMask. Its value is 0 if there is nothing to wait for.
+	TimelinePoint RecordAcquire(VkCommandBuffer graphicsCommandBuffer, VkPipelineStageFlags& waitStageMask);
+
+	bool IsDedicatedTransferQueue() const { return transferFamily != graphicsFamily; }
+
+	uint64_t GetBatchCount() const { return batchCount; }
+	uint64_t GetUploadedBytes() const { return uploadedBytes; }
+
+private:
+	struct BufferCopy
+	{
+		VkBuffer buffer;
+		VkBufferCopy region;
+		VkPipelineStageFlags dstStageMask;
+		VkAccessFlags dstAccessMask;
+	};
+
+	struct ImageCopy
+	{
+		VkImage image;
+		VkBufferImageCopy region;
+		VkImageLayout finalLayout;
+		VkPipelineStageFlags dstStageMask;
+		VkAccessFlags dstAccessMask;
+	};
+
+	// A submitted batch. Its staging bytes and command buffer are free again once the timeline reaches value.
+	struct Batch
+	{
+		uint64_t value;
+		VkDeviceSize stagingBytes;
+		VkCommandBuffer commandBuffer;
+	};
+
+	// Reserves size bytes of the staging ring. May flush and wait for older batches to make room.
+	VkDeviceSize AllocateStaging(VkDeviceSize size);
+	void ReclaimCompletedBatches(bool waitForOldest);
+
+	VkCommandBuffer GetCommandBuffer();
+
+	VkDevice device = VK_NULL_HANDLE;
+	GpuAllocator* allocator = nullptr;
+
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+
+	// Ring buffer: new data is written at stagingHead, stagingUsed bytes before it are still in use.
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	GpuAllocation stagingAllocation;
+	VkDeviceSize stagingSize = 0;
+	VkDeviceSize stagingHead = 0;
+	VkDeviceSize stagingUsed = 0;
+
+	// Copies queued since the last Flush() and the staging bytes they occupy.
+	std::vector<BufferCopy> pendingBufferCopies;
+	std::vector<ImageCopy> pendingImageCopies;
+	VkDeviceSize pendingStagingBytes = 0;
+
+	std::deque<Batch> submittedBatches;
+
+	// Flushed uploads waiting for RecordAcquire(), and the timeline value of the newest of them.
+	std::vector<BufferCopy> unacquiredBuffers;
+	std::vector<ImageCopy> unacquiredImages;
+	uint64_t unacquiredValue = 0;
+
+	QueueTimeline timeline;
+
+	uint64_t batchCount = 0;
+	uint64_t uploadedBytes = 0;
+};
@@ -0,0 +1,112 @@
+#include "vertex.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+
+VertexInputDescription GetVertexInputDescription(VertexStreamLayout layout)
+{
+	VertexInputDescription description;
+
+	// A binding describes at which rate to load data from memory throughout the vertices.
+	// VK_VERTEX_INPUT_RATE_VERTEX moves to the next data entry after each vertex, VK_VERTEX_INPUT_RATE_INSTANCE after each instance.
+	// An attribute describes how to extract a vertex attribute from a chunk of vertex data originating from a binding.
+	if (layout == VertexStreamLayout::Interleaved) {
+		description.bindings.push_back({ 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX });
+
+		description.attributes.push_back({ 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position) });
+		description.attributes.push_back({ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) });
+	}
+	else {
+		description.bindings.push_back({ 0, sizeof(glm::vec2), VK_VERTEX_INPUT_RATE_VERTEX });
+		description.bindings.push_back({ 1, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX });
+
+		description.attributes.push_back({ 0, 0, VK_FORMAT_R32G32_SFLOAT, 0 });
+		description.attributes.push_back({ 1, 1, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+	}
+
+	return description;
+}
+
+
+std::vector<std::vector<uint8_t>> PackVertexStreams(const std::vector<Vertex>& vertices, VertexStreamLayout layout)
+{
+	if (layout == VertexStreamLayout::Interleaved) {
+		std::vector<uint8_t> stream(vertices.size() * sizeof(Vertex));
+		std::memcpy(stream.data(), vertices.data(), stream.size());
+		return { stream };
+	}
+
+	std::vector<uint8_t> positions(vertices.size() * sizeof(glm::vec2));
+	std::vector<uint8_t> colors(vertices.size() * sizeof(glm::vec3));
+
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		std::memcpy(&positions[i * sizeof(glm::vec2)], &vertices[i].position, sizeof(glm::vec2));
+		std::memcpy(&colors[i * sizeof(glm::vec3)], &vertices[i].color, sizeof(glm::vec3));
+	}
+
+	return { positions, colors };
+}
+
+
+void GetTriangleGridSize(uint32_t triangleCount, uint32_t& columns, uint32_t& rows)
+{
+	columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(triangleCount))));
+	rows = (triangleCount + columns - 1) / columns;
+}
+
+
+void BuildTriangleGrid(uint32_t triangleCount, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	uint32_t columns = 0;
+	uint32_t rows = 0;
+	GetTriangleGridSize(triangleCount, columns, rows);
+
+	// Cells of the square from -0.5 to 0.5, the original triangle fills a whole cell.
+	float cellWidth = 1.0f / columns;
+	float cellHeight = 1.0f / rows;
+
+	vertices.clear();
+	indices.clear();
+	vertices.reserve(triangleCount * 3);
+	indices.reserve(triangleCount * 3);
+
+	for (uint32_t i = 0; i < triangleCount; ++i) {
+		float left = -0.5f + (i % columns) * cellWidth;
+		float top = -0.5f + (i / columns) * cellHeight;
+
+		uint32_t first = static_cast<uint32_t>(vertices.size());
+		vertices.push_back({ { left + cellWidth * 0.5f, top }, { 1.0f, 0.0f, 0.0f } });
+		vertices.push_back({ { left + cellWidth, top + cellHeight }, { 0.0f, 1.0f, 0.0f } });
+		vertices.push_back({ { left, top + cellHeight }, { 0.0f, 0.0f, 1.0f } });
+
+		indices.push_back(first);
+		indices.push_back(first + 1);
+		indices.push_back(first + 2);
+	}
+}
+
+
+std::vector<uint8_t> PackIndices(const std::vector<uint32_t>& indices, VkIndexType indexType)
+{
+	if (indexType == VK_INDEX_TYPE_UINT32) {
+		std::vector<uint8_t> packed(indices.size() * sizeof(uint32_t));
+		std::memcpy(packed.data(), indices.data(), packed.size());
+		return packed;
+	}
+
+	std::vector<uint8_t> packed(indices.size() * sizeof(uint16_t));
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (indices[i] > UINT16_MAX) {
+			throw std::runtime_error("Index does not fit into 16 bit");
+		}
+
+		uint16_t index = static_cast<uint16_t>(indices[i]);
+		std::memcpy(&packed[i * sizeof(uint16_t)], &index, sizeof(uint16_t));
+	}
+
+	return packed;
+}
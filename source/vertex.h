@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+
+// Vertex attributes as they are laid out in memory. Locations match the inputs of shader.vert.
+struct Vertex
+{
+	// location = 0
+	glm::vec2 position;
+
+	// location = 1
+	glm::vec3 color;
+};
+
+
+// How the attributes are stored in vertex buffers.
+// 1. Interleaved: one buffer, one binding, the attributes of a vertex are next to each other. Best for the cache
+//    when every pass reads all attributes.
+// 2. Split: one buffer and binding per attribute. Passes that only need positions (e.g. depth or shadows)
+//    then fetch less memory.
+enum class VertexStreamLayout
+{
+	Interleaved,
+	Split
+};
+
+
+// Everything VkPipelineVertexInputStateCreateInfo points to.
+struct VertexInputDescription
+{
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+
+VertexInputDescription GetVertexInputDescription(VertexStreamLayout layout);
+
+
+// Vertex data in the byte layout of the given stream layout, one entry per binding.
+std::vector<std::vector<uint8_t>> PackVertexStreams(const std::vector<Vertex>& vertices, VertexStreamLayout layout);
+
+
+// Columns and rows of the grid BuildTriangleGrid lays triangleCount triangles out in.
+void GetTriangleGridSize(uint32_t triangleCount, uint32_t& columns, uint32_t& rows);
+
+
+// triangleCount triangles side by side in a grid over the area of the original triangle, three vertices each.
+// A single triangle is the original triangle itself.
+void BuildTriangleGrid(uint32_t triangleCount, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+
+// Indices narrowed to 16 bit if indexType is VK_INDEX_TYPE_UINT16. 16 bit indices halve the index fetch bandwidth,
+// but only address 65536 vertices.
+std::vector<uint8_t> PackIndices(const std::vector<uint32_t>& indices, VkIndexType indexType);
@@ -1,8 +1,11 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <glm/gtc/matrix_transform.hpp>
+
 #include <iostream>
 #include <cstdlib>
+#include <cmath>
 #include <cstdint>
 #include <algorithm>
 #include <stdexcept>
@@ -10,13 +13,78 @@
 #include <set>
 #include <optional>
 #include <fstream>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#include "async_compute.h"
+#include "benchmark.h"
+#include "depth_buffer.h"
+#include "device_selection.h"
+#include "dynamic_state.h"
+#include "frame_commands.h"
+#include "frame_pacer.h"
+#include "frame_stats.h"
+#include "gpu_allocator.h"
+#include "gpu_profiler.h"
+#include "hash.h"
+#include "job_system.h"
+#include "multisampling.h"
+#include "pipeline_cache.h"
+#include "pipeline_library.h"
+#include "present_policy.h"
+#include "queue_timeline.h"
+#include "render_graph.h"
+#include "shader_compiler.h"
+#include "shader_registry.h"
+#include "specialization_constants.h"
+#include "upload_engine.h"
+#include "vertex.h"
 
 // In screen coordinates.
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
-// How many frames should be processed concurrently.
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// How many frames should be processed concurrently in headless mode, unless changed from the command line.
+// With a window the present policy decides, and keys 1-4 change it at runtime.
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+// Headless mode has no window to close, so it stops after this many frames unless --frames is given.
+const uint64_t DEFAULT_HEADLESS_FRAME_COUNT = 1000;
+
+// Draw calls recorded per frame. The same triangle is drawn again, more draws only add recording work.
+const uint32_t DEFAULT_DRAW_COUNT = 1;
+
+// Triangles in the mesh every draw call renders.
+const uint32_t DEFAULT_TRIANGLES_PER_DRAW = 1;
+
+// A benchmark renders this many frames before measuring, so caches, clocks and the swapchain have settled,
+// then measures this many unless --frames is given.
+const uint64_t DEFAULT_BENCHMARK_WARMUP_FRAMES = 100;
+const uint64_t DEFAULT_BENCHMARK_FRAME_COUNT = 1000;
+
+// Pipelines compile in the background on this many threads. They are separate from the record threads,
+// so a long compile never holds up recording a frame.
+const uint32_t DEFAULT_COMPILE_THREADS = 2;
+
+// How often the shader sources are checked for changes.
+const std::chrono::milliseconds SHADER_POLL_INTERVAL(250);
+
+// Specialization constant ids declared in shaders/shader.frag.
+const uint32_t COLOR_MODE_CONSTANT_ID = 0;
+
+// local_size_x of shaders/animate.comp, and how far its triangles turn every frame. Tied to frames instead of time,
+// so a benchmark renders the same frames on every run.
+const uint32_t VERTEX_ANIMATION_LOCAL_SIZE = 64;
+const float VERTEX_ANIMATION_RADIANS_PER_FRAME = 0.01f;
+
+// Camera looking at the mesh: vertical field of view and depth range. Reversed-Z keeps the depth precision
+// over the whole range, so the near plane can be close without the far one suffering for it.
+const float CAMERA_FOV_Y = glm::radians(60.0f);
+const float CAMERA_NEAR_PLANE = 0.1f;
+const float CAMERA_FAR_PLANE = 100.0f;
 
 // Not all graphics card are capable with desired extensions. So we must check their support.
 const std::vector<const char*> REQUIRED_PHYSICAL_DEVICE_EXTENSIONS = {
@@ -64,33 +132,372 @@ void PrintMessage(std::string msg)
 }
 
 
-static std::vector<char> ReadFile(const std::string& filename)
+// Values of COLOR_MODE in shaders/shader.frag.
+enum class ColorMode : int32_t
 {
-	// ::ate - read from end of file. To determine the size of the file for buffer allocation.
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	Vertex = 0,
+	Grayscale = 1,
+	Inverted = 2,
+	Count
+};
+
 
-	if (!file.is_open()) {
-		throw std::runtime_error("Failed to open file");
+const char* GetColorModeName(ColorMode colorMode)
+{
+	switch (colorMode) {
+	case ColorMode::Vertex:
+		return "vertex";
+	case ColorMode::Grayscale:
+		return "grayscale";
+	case ColorMode::Inverted:
+		return "inverted";
+	default:
+		return "unknown";
 	}
+}
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
 
-	// Return to beginning of the file.
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
+const char* GetPresentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "fifo";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "fifo-relaxed";
+	default:
+		return "unknown";
+	}
+}
+
+
+// Where the compute pass animating the vertices runs.
+enum class ComputeMode
+{
+	// No compute pass, the triangles are drawn from the uploaded vertex buffers.
+	Off,
+	// On a queue of a compute family without graphics, concurrently with rendering. Falls back to the graphics queue.
+	Async,
+	// On the graphics queue, before the frame's rendering. For comparing with Async.
+	Graphics
+};
+
 
-	return buffer;
+const char* GetComputeModeName(ComputeMode computeMode)
+{
+	switch (computeMode) {
+	case ComputeMode::Off:
+		return "off";
+	case ComputeMode::Async:
+		return "async";
+	case ComputeMode::Graphics:
+		return "graphics";
+	default:
+		return "unknown";
+	}
+}
+
+
+// Push constants of shaders/animate.comp.
+struct VertexAnimationConstants
+{
+	uint32_t triangleCount = 0;
+	uint32_t columns = 0;
+	uint32_t rows = 0;
+	// In floats.
+	uint32_t vertexStride = 0;
+	uint32_t writeColors = 0;
+	float angle = 0.0f;
+};
+
+
+// Values for the specialization constants of the triangle shaders. Each distinct permutation is a pipeline of its own,
+// compiled from the same SPIR-V with the branches it doesn't take removed.
+struct ShaderPermutation
+{
+	ColorMode colorMode = ColorMode::Vertex;
+
+	SpecializationConstants GetFragmentConstants() const
+	{
+		SpecializationConstants constants;
+		constants.Set(COLOR_MODE_CONSTANT_ID, static_cast<int32_t>(colorMode));
+		return constants;
+	}
+};
+
+
+// Settings that can be changed from the command line.
+struct ApplicationOptions
+{
+	// --frames-in-flight <1-4>: overrides the present policy. Zero takes it from the policy.
+	uint32_t framesInFlight = 0;
+
+	// --present-policy <latency|throughput|power>: present mode, swapchain image count and frames in flight.
+	// Key P cycles through them.
+	PresentPolicy presentPolicy = PresentPolicy::Latency;
+
+	// --pipeline-cache <path>, --no-pipeline-cache clears it to force a cold start.
+	std::string pipelineCachePath = "pipeline_cache.bin";
+
+	// --headless: render into offscreen images without a window and read the frames back to host memory.
+	bool headless = false;
+
+	// --frames <N>: stop after N frames. Zero means run until the window is closed.
+	uint64_t frameCount = 0;
+
+	// --capture <file.ppm>: headless only, write the last rendered frame to a PPM image.
+	std::string capturePath;
+
+	// --draws <N>: draw calls recorded per frame, to measure the recording cost per draw.
+	uint32_t drawCount = DEFAULT_DRAW_COUNT;
+
+	// --record-threads <N>: worker threads recording the draws into secondary command buffers.
+	// Zero records everything inline on the main thread.
+	uint32_t recordThreads = 0;
+
+	// --vertex-streams <interleaved|split>
+	VertexStreamLayout vertexStreamLayout = VertexStreamLayout::Interleaved;
+
+	// --index-type <16|32>
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+
+	// --msaa <1|2|4|8|16|32|64>: samples per pixel, lowered to what the device supports. One turns multisampling off.
+	uint32_t msaaSamples = 1;
+
+	// --compile-threads <N>: threads compiling pipelines in the background. Zero compiles on the requesting thread.
+	uint32_t compileThreads = DEFAULT_COMPILE_THREADS;
+
+	// --shader-cache <dir>: where SPIR-V compiled from the GLSL sources at runtime is kept.
+	std::string shaderCachePath = "shader_cache";
+
+	// --precompiled-shaders: load shaders/*.spv instead of compiling the sources, without hot reload.
+	bool precompiledShaders = false;
+
+	// --color-mode <vertex|grayscale|inverted>: the initial shader permutation. Key C cycles through them.
+	ColorMode colorMode = ColorMode::Vertex;
+
+	// --trace <file.json>: record CPU and GPU scopes of every frame and write them as a Chrome trace on exit.
+	std::string tracePath;
+
+	// --frame-stats <file>: write the frame time percentiles on exit to this file instead of stdout.
+	std::string frameStatsPath;
+
+	// --triangles <N>: triangles per draw call.
+	uint32_t trianglesPerDraw = DEFAULT_TRIANGLES_PER_DRAW;
+
+	// --present-mode <fifo|fifo-relaxed|mailbox|immediate>: preferred over the default choice if the surface supports it.
+	std::optional<VkPresentModeKHR> presentMode;
+
+	// --benchmark <results.json>: render warmupFrames, then measure frameCount frames and write the results as JSON.
+	std::string benchmarkPath;
+
+	// --warmup-frames <N>: frames rendered before a benchmark starts measuring.
+	uint64_t warmupFrames = DEFAULT_BENCHMARK_WARMUP_FRAMES;
+
+	// --device <name|uuid>: use the best suitable device whose name contains this, or with this UUID,
+	// instead of the best suitable one overall.
+	std::string deviceOverride;
+
+	// --compute <off|async|graphics>: animate the triangles with a compute pass every frame, on a compute queue
+	// of its own or on the graphics queue.
+	ComputeMode computeMode = ComputeMode::Off;
+};
+
+
+ApplicationOptions ParseOptions(int argc, char** argv)
+{
+	ApplicationOptions options;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		if (arg == "--frames-in-flight" && i + 1 < argc) {
+			options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--pipeline-cache" && i + 1 < argc) {
+			options.pipelineCachePath = argv[++i];
+		}
+		else if (arg == "--no-pipeline-cache") {
+			options.pipelineCachePath.clear();
+		}
+		else if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			options.frameCount = std::stoull(argv[++i]);
+		}
+		else if (arg == "--capture" && i + 1 < argc) {
+			options.capturePath = argv[++i];
+		}
+		else if (arg == "--draws" && i + 1 < argc) {
+			options.drawCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+			if (options.drawCount == 0) {
+				throw std::runtime_error("--draws must be at least 1");
+			}
+		}
+		else if (arg == "--record-threads" && i + 1 < argc) {
+			options.recordThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--vertex-streams" && i + 1 < argc) {
+			std::string value = argv[++i];
+			if (value == "interleaved") {
+				options.vertexStreamLayout = VertexStreamLayout::Interleaved;
+			}
+			else if (value == "split") {
+				options.vertexStreamLayout = VertexStreamLayout::Split;
+			}
+			else {
+				throw std::runtime_error("--vertex-streams must be interleaved or split");
+			}
+		}
+		else if (arg == "--compile-threads" && i + 1 < argc) {
+			options.compileThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--shader-cache" && i + 1 < argc) {
+			options.shaderCachePath = argv[++i];
+		}
+		else if (arg == "--precompiled-shaders") {
+			options.precompiledShaders = true;
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			options.tracePath = argv[++i];
+		}
+		else if (arg == "--frame-stats" && i + 1 < argc) {
+			options.frameStatsPath = argv[++i];
+		}
+		else if (arg == "--color-mode" && i + 1 < argc) {
+			std::string value = argv[++i];
+			if (value == "vertex") {
+				options.colorMode = ColorMode::Vertex;
+			}
+			else if (value == "grayscale") {
+				options.colorMode = ColorMode::Grayscale;
+			}
+			else if (value == "inverted") {
+				options.colorMode = ColorMode::Inverted;
+			}
+			else {
+				throw std::runtime_error("--color-mode must be vertex, grayscale or inverted");
+			}
+		}
+		else if (arg == "--present-policy" && i + 1 < argc) {
+			std::string value = argv[++i];
+			if (value == "latency") {
+				options.presentPolicy = PresentPolicy::Latency;
+			}
+			else if (value == "throughput") {
+				options.presentPolicy = PresentPolicy::Throughput;
+			}
+			else if (value == "power") {
+				options.presentPolicy = PresentPolicy::Power;
+			}
+			else {
+				throw std::runtime_error("--present-policy must be latency, throughput or power");
+			}
+		}
+		else if (arg == "--triangles" && i + 1 < argc) {
+			options.trianglesPerDraw = static_cast<uint32_t>(std::stoul(argv[++i]));
+			if (options.trianglesPerDraw == 0) {
+				throw std::runtime_error("--triangles must be at least 1");
+			}
+		}
+		else if (arg == "--present-mode" && i + 1 < argc) {
+			std::string value = argv[++i];
+			if (value == "fifo") {
+				options.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+			}
+			else if (value == "fifo-relaxed") {
+				options.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+			}
+			else if (value == "mailbox") {
+				options.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+			}
+			else if (value == "immediate") {
+				options.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			}
+			else {
+				throw std::runtime_error("--present-mode must be fifo, fifo-relaxed, mailbox or immediate");
+			}
+		}
+		else if (arg == "--benchmark" && i + 1 < argc) {
+			options.benchmarkPath = argv[++i];
+		}
+		else if (arg == "--warmup-frames" && i + 1 < argc) {
+			options.warmupFrames = std::stoull(argv[++i]);
+		}
+		else if (arg == "--device" && i + 1 < argc) {
+			options.deviceOverride = argv[++i];
+		}
+		else if (arg == "--compute" && i + 1 < argc) {
+			std::string value = argv[++i];
+			if (value == "off") {
+				options.computeMode = ComputeMode::Off;
+			}
+			else if (value == "async") {
+				options.computeMode = ComputeMode::Async;
+			}
+			else if (value == "graphics") {
+				options.computeMode = ComputeMode::Graphics;
+			}
+			else {
+				throw std::runtime_error("--compute must be off, async or graphics");
+			}
+		}
+		else if (arg == "--index-type" && i + 1 < argc) {
+			std::string value = argv[++i];
+			if (value == "16") {
+				options.indexType = VK_INDEX_TYPE_UINT16;
+			}
+			else if (value == "32") {
+				options.indexType = VK_INDEX_TYPE_UINT32;
+			}
+			else {
+				throw std::runtime_error("--index-type must be 16 or 32");
+			}
+		}
+		else if (arg == "--msaa" && i + 1 < argc) {
+			options.msaaSamples = static_cast<uint32_t>(std::stoul(argv[++i]));
+			// Sample counts are powers of two up to VK_SAMPLE_COUNT_64_BIT.
+			if (options.msaaSamples == 0 || options.msaaSamples > 64 || (options.msaaSamples & (options.msaaSamples - 1)) != 0) {
+				throw std::runtime_error("--msaa must be 1, 2, 4, 8, 16, 32 or 64");
+			}
+		}
+		else {
+			throw std::runtime_error("Unknown command line option: " + arg);
+		}
+	}
+
+	// In a benchmark --frames counts the measured frames, the warm-up comes on top.
+	if (!options.benchmarkPath.empty() && options.frameCount == 0) {
+		options.frameCount = DEFAULT_BENCHMARK_FRAME_COUNT;
+	}
+
+	if (options.headless && options.frameCount == 0) {
+		options.frameCount = DEFAULT_HEADLESS_FRAME_COUNT;
+	}
+
+	// Every triangle has vertices of its own, 16 bit indices can address 65536 of them.
+	if (options.indexType == VK_INDEX_TYPE_UINT16 && static_cast<uint64_t>(options.trianglesPerDraw) * 3 > 65536) {
+		throw std::runtime_error("--triangles above 21845 needs --index-type 32");
+	}
+
+	return options;
 }
 
 
 class TriangleApplication
 {
 public:
+	explicit TriangleApplication(const ApplicationOptions& options) : presentPolicy(options.presentPolicy), options(options) {}
+
 	void Run()
 	{
-		InitWindow();
+		if (!options.headless) {
+			InitWindow();
+		}
 		InitVulkan();
 		MainLoop();
 		CleanUp();
@@ -101,27 +508,150 @@ private:
 		glfwInit();
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // Do not use OpenGL.
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE); // No resize for a while.
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+
+		glfwSetWindowUserPointer(window, this);
+		glfwSetKeyCallback(window, KeyCallback);
+		glfwSetFramebufferSizeCallback(window, FramebufferResizeCallback);
+	}
+
+
+	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height)
+	{
+		// Drivers usually report VK_ERROR_OUT_OF_DATE_KHR after a resize, but they are not required to.
+		// So the resize is also tracked explicitly and the swapchain is recreated after the next present.
+		auto app = reinterpret_cast<TriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->framebufferResized = true;
+	}
+
+
+	static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+	{
+		// Keys 1-4 change the number of frames in flight. The change is applied in MainLoop, 
+		// because the device has to be idle to replace the synchronization objects.
+		if (action == GLFW_PRESS && key >= GLFW_KEY_1 && key <= GLFW_KEY_4) {
+			auto app = reinterpret_cast<TriangleApplication*>(glfwGetWindowUserPointer(window));
+			app->requestedFramesInFlight = static_cast<uint32_t>(key - GLFW_KEY_0);
+		}
+
+		// Key C switches to the next shader permutation.
+		if (action == GLFW_PRESS && key == GLFW_KEY_C) {
+			auto app = reinterpret_cast<TriangleApplication*>(glfwGetWindowUserPointer(window));
+			app->colorModeChangeRequested = true;
+		}
+
+		// Key P switches to the next present policy.
+		if (action == GLFW_PRESS && key == GLFW_KEY_P) {
+			auto app = reinterpret_cast<TriangleApplication*>(glfwGetWindowUserPointer(window));
+			app->presentPolicyChangeRequested = true;
+		}
 	}
 
 
 	void InitVulkan()
 	{
+		auto initStart = std::chrono::steady_clock::now();
+
 		CreateInstance();
 		SetupDebugMessenger();
-		CreateSurface();
+		if (!options.headless) {
+			CreateSurface();
+		}
 		SelectPhysicalDevice();
 		CreateLogicalDevice();
-		CreateSwapchain();
+		CreateAllocator();
+		CreateUploadEngine();
+		CreatePipelineCache();
+		CreatePipelineLibrary();
+		if (options.headless) {
+			CreateOffscreenTargets();
+			CreateReadbackBuffers();
+		}
+		else {
+			CreateSwapchain();
+		}
 		CreateImageViews();
-		CreateRenderPass();
+		CreateCommandPools();
+		CreateRenderGraph();
 		CreateGraphicsPipeline();
-		CreateFramebuffers();
-		CreateCommandPool();
-		CreateCommandBuffers();
+		CreateMeshBuffers();
+		if (options.computeMode != ComputeMode::Off) {
+			CreateVertexAnimation();
+		}
 		CreateSyncObjects();
+
+		ReportStartupTime(std::chrono::steady_clock::now() - initStart);
+		ReportMemoryStatistics();
+	}
+
+
+	void CreatePipelineCache()
+	{
+		pipelineCache.Init(physicalDevice, logicalDevice, options.pipelineCachePath);
+
+		if (pipelineCache.IsWarm()) {
+			PrintMessage("Pipeline cache loaded: " + std::to_string(pipelineCache.GetLoadedSize()) + " bytes");
+		}
+	}
+
+
+	void CreatePipelineLibrary()
+	{
+		if (!options.precompiledShaders) {
+			shaderCompiler.Init(options.shaderCachePath);
+		}
+
+		shaderRegistry.Init(logicalDevice);
+		pipelineLibrary.Init(logicalDevice, pipelineCache, shaderRegistry, options.compileThreads);
+
+		permutation.colorMode = options.colorMode;
+	}
+
+
+	void ReportPipelineStatistics()
+	{
+		PipelineLibraryStats stats = pipelineLibrary.GetStats();
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "Pipelines: " << stats.requestCount << " requests, " << stats.dedupCount << " deduplicated"
+			<< " | compiled: " << stats.compiledCount << " on " << pipelineLibrary.GetCompileThreadCount() << " threads"
+			<< " | pending: " << stats.pendingCount << " | failed: " << stats.failedCount;
+
+		if (stats.compiledCount > 0) {
+			std::cout << " | compile avg: " << stats.totalCompileMs / stats.compiledCount << " ms, max: " << stats.maxCompileMs << " ms";
+		}
+		std::cout << std::endl;
+
+		// One line per non-empty bucket of the compile time histogram.
+		double bucketStartMs = 0.0;
+		double bucketEndMs = 1.0;
+		for (uint32_t i = 0; i < PipelineLibraryStats::HISTOGRAM_BUCKET_COUNT; ++i) {
+			if (stats.compileHistogram[i] > 0) {
+				std::cout << std::setprecision(0) << "  " << std::setw(5) << bucketStartMs << " - ";
+				if (i + 1 < PipelineLibraryStats::HISTOGRAM_BUCKET_COUNT) {
+					std::cout << std::setw(5) << bucketEndMs << " ms: ";
+				}
+				else {
+					std::cout << "  inf ms: ";
+				}
+				std::cout << stats.compileHistogram[i] << std::endl;
+			}
+
+			bucketStartMs = bucketEndMs;
+			bucketEndMs *= 2.0;
+		}
+	}
+
+
+	void ReportStartupTime(std::chrono::steady_clock::duration initTime)
+	{
+		// Compare the numbers of the first launch (cold) with the following ones (warm) to see what the cache saves.
+		std::cout << std::fixed << std::setprecision(2)
+			<< "Startup with " << (pipelineCache.IsWarm() ? "warm" : "cold") << " pipeline cache"
+			<< " | pipeline creation: " << pipelineCreationMs << " ms"
+			<< " | InitVulkan: " << std::chrono::duration<double, std::milli>(initTime).count() << " ms" << std::endl;
 	}
 
 
@@ -150,11 +680,84 @@ private:
 	}
 
 
+	bool IsBenchmark() const
+	{
+		return !options.benchmarkPath.empty();
+	}
+
+
+	bool ShouldStop(uint64_t framesRendered)
+	{
+		uint64_t frameCount = options.frameCount + (IsBenchmark() ? options.warmupFrames : 0);
+		if (options.frameCount > 0 && framesRendered >= frameCount) {
+			return true;
+		}
+
+		return !options.headless && glfwWindowShouldClose(window);
+	}
+
+
 	void MainLoop()
 	{
-		while (!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
+		auto loopStart = std::chrono::steady_clock::now();
+		auto reportStart = loopStart;
+		auto shaderPollStart = loopStart;
+		uint64_t framesRendered = 0;
+
+		while (!ShouldStop(framesRendered)) {
+			// The frame is rendered from the input as of now, its input to present latency starts here.
+			if (!options.headless) {
+				glfwPollEvents();
+			}
+			inputTime = std::chrono::steady_clock::now();
+
+			if (requestedFramesInFlight != 0) {
+				uint32_t framesInFlight = framePacer.SetFramesInFlight(requestedFramesInFlight);
+				requestedFramesInFlight = 0;
+
+				PrintMessage("Frames in flight: " + std::to_string(framesInFlight));
+				ResetAverages();
+				reportStart = std::chrono::steady_clock::now();
+			}
+
+			if (colorModeChangeRequested) {
+				colorModeChangeRequested = false;
+				CycleColorMode();
+			}
+
+			if (presentPolicyChangeRequested) {
+				presentPolicyChangeRequested = false;
+				CyclePresentPolicy();
+				ResetAverages();
+				reportStart = std::chrono::steady_clock::now();
+			}
+
+			// Averages and frame samples of a benchmark start with the first frame after the warm-up.
+			if (IsBenchmark() && framesRendered == options.warmupFrames) {
+				ResetAverages();
+				presentLatency.ResetSamples();
+				benchmarkRecorder.Begin(frameStats);
+			}
+
+			// Edited shader sources are picked up a few times per second, checking every frame would only add file system calls.
+			// Not during a benchmark, a recompile in the middle would show up in the results.
+			if (!options.precompiledShaders && !IsBenchmark() && std::chrono::steady_clock::now() - shaderPollStart >= SHADER_POLL_INTERVAL) {
+				ReloadChangedShaders();
+				shaderPollStart = std::chrono::steady_clock::now();
+			}
+
 			DrawFrame();
+			++framesRendered;
+
+			benchmarkRecorder.Update(frameStats);
+
+			// Report frame timings once per second. A benchmark keeps averaging over all measured frames instead.
+			auto now = std::chrono::steady_clock::now();
+			if (!IsBenchmark() && now - reportStart >= std::chrono::seconds(1)) {
+				ReportFrameTimings(now - reportStart);
+				ResetAverages();
+				reportStart = now;
+			}
 		}
 
 		// All of the operations in DrawFrame are asynchronous. That means that when we exit the loop in MainLoop, 
@@ -162,32 +765,253 @@ private:
 		// To fix that problem, we should wait for the logical device to finish operations before exiting MainLoop 
 		// and destroying the window.
 		vkDeviceWaitIdle(logicalDevice);
+
+		if (IsBenchmark()) {
+			benchmarkRecorder.End(frameStats);
+			WriteBenchmark(framesRendered);
+		}
+
+		ReportPipelineStatistics();
+
+		ReportFrameStatistics();
+
+		ReportPresentLatency();
+
+		gpuProfiler.CollectAll();
+		if (gpuProfiler.IsTracing()) {
+			gpuProfiler.WriteChromeTrace(options.tracePath);
+
+			std::string message = "Trace written to " + options.tracePath;
+			if (!gpuProfiler.IsCalibrated()) {
+				message += " (GPU scopes placed at submission, timestamps are not calibrated)";
+			}
+			if (gpuProfiler.GetDroppedEventCount() > 0) {
+				message += ", " + std::to_string(gpuProfiler.GetDroppedEventCount()) + " events dropped";
+			}
+			PrintMessage(message);
+		}
+
+		if (options.headless) {
+			// The last frames in flight are complete now. Read them back oldest first, so the capture holds the newest one.
+			for (uint32_t i = 0; i < readbackBuffers.size(); ++i) {
+				ReadbackFrame((framePacer.GetCurrentFrame() + i) % static_cast<uint32_t>(readbackBuffers.size()));
+			}
+
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+			std::cout << std::fixed << std::setprecision(2)
+				<< "Headless: " << framesRendered << " frames in " << seconds << " s"
+				<< " | " << framesRendered / seconds << " FPS"
+				<< " | frames read back: " << readbackFrameCount << std::endl;
+
+			if (!options.capturePath.empty()) {
+				WriteCapture(options.capturePath);
+			}
+		}
 	}
 
 
-	void CleanUp()
+	void ReportFrameTimings(std::chrono::steady_clock::duration interval)
 	{
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-			vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], nullptr);
-			vkDestroySemaphore(logicalDevice, imageAvailableSemaphores[i], nullptr);
-			vkDestroyFence(logicalDevice, inFlightFences[i], nullptr);
+		double seconds = std::chrono::duration<double>(interval).count();
+		FrameTimings average = framePacer.GetAverageTimings();
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "Frames in flight: " << framePacer.GetFramesInFlight()
+			<< " | FPS: " << framePacer.GetAveragedFrameCount() / seconds
+			<< " | CPU wait: " << average.cpuWaitMs << " ms";
+
+		if (average.gpuBusyMs >= 0.0) {
+			std::cout << " | GPU busy: " << average.gpuBusyMs << " ms";
+		}
+		else {
+			std::cout << " | GPU busy: n/a";
+		}
+
+		// Percentiles of the frames since the last report.
+		FrameStatsSummary summary = frameStats.Summarize(static_cast<uint32_t>(std::min<uint64_t>(recordedFrameCount, FrameStatsRing::CAPACITY)));
+		if (summary.frameCount > 0) {
+			const FrameStatPercentiles& frameTime = summary[FrameStat::FrameTime];
+			std::cout << " | Frame p50/p95/p99: " << frameTime.p50 << "/" << frameTime.p95 << "/" << frameTime.p99 << " ms"
+				<< " | Hitches: " << summary.hitchCount;
+		}
+
+		if (presentLatency.GetSampleCount(presentPolicy) > 0) {
+			std::cout << " | Input to present p50: " << presentLatency.GetPercentiles(presentPolicy).p50 << " ms";
 		}
 
-		vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
+		std::vector<GpuScopeTiming> scopeTimings = gpuProfiler.GetGpuAverages();
+		for (size_t i = 0; i < scopeTimings.size(); ++i) {
+			std::cout << (i == 0 ? " | GPU scopes: " : ", ") << scopeTimings[i].name << " " << scopeTimings[i].averageMs << " ms";
+		}
 
-		for (auto framebuffer : swapchainFramebuffers) {
-			vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+		if (recordedFrameCount > 0) {
+			// CPU cost of recording a frame, including the pool reset. Divided by the draw count it shows the cost per draw.
+			double recordMs = std::chrono::duration<double, std::milli>(recordTimeSum).count() / recordedFrameCount;
+			std::cout << " | Record: " << recordMs << " ms (" << std::setprecision(3)
+				<< recordMs * 1000.0 / options.drawCount << " us/draw, " << options.drawCount << " draws, "
+				<< jobSystem.GetWorkerCount() << " threads)";
 		}
 
-		vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
+		std::cout << std::endl;
+	}
+
+
+	void ReportFrameStatistics()
+	{
+		FrameStatsSummary summary = frameStats.Summarize(FrameStatsRing::CAPACITY);
+		if (summary.frameCount == 0) {
+			return;
+		}
+
+		if (options.frameStatsPath.empty()) {
+			WriteFrameStatsSummary(std::cout, summary);
+		}
+		else {
+			std::ofstream file(options.frameStatsPath, std::ios::trunc);
+			WriteFrameStatsSummary(file, summary);
+
+			if (!file.good()) {
+				throw std::runtime_error("Failed to write " + options.frameStatsPath);
+			}
+			PrintMessage("Frame statistics written to " + options.frameStatsPath);
+		}
+
+		std::cout << "Hitches: " << frameStats.GetHitchCount() << " of " << frameStats.GetFrameCount() << " frames" << std::endl;
+	}
+
+
+	void WriteBenchmark(uint64_t framesRendered)
+	{
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+		BenchmarkSettings settings;
+		settings.deviceName = deviceProperties.deviceName;
+		settings.deviceUuid = FormatDeviceUuid(physicalDeviceUuid);
+		settings.computeMode = options.computeMode == ComputeMode::Off ? "off" : (computeQueue.IsAsync() ? "async" : "graphics");
+		settings.headless = options.headless;
+		settings.warmupFrames = options.warmupFrames;
+		settings.measuredFrames = options.frameCount;
+		settings.framesInFlight = framePacer.GetFramesInFlight();
+		settings.presentMode = options.headless ? "none" : GetPresentModeName(swapchainPresentMode);
+		settings.presentPolicy = options.headless ? "none" : GetPresentPolicyName(presentPolicy);
+		settings.swapchainImageCount = static_cast<uint32_t>(swapchainImages.size());
+		settings.drawCount = options.drawCount;
+		settings.trianglesPerDraw = options.trianglesPerDraw;
+		settings.recordThreadCount = jobSystem.GetWorkerCount();
+		settings.vertexStreamCount = static_cast<uint32_t>(vertexBuffers.size());
+		settings.indexSize = options.indexType == VK_INDEX_TYPE_UINT32 ? 4 : 2;
+		settings.sampleCount = static_cast<uint32_t>(msaaSamples);
+
+		BenchmarkResults results;
+		results.frameCount = framesRendered - std::min(framesRendered, options.warmupFrames);
+		results.completed = results.frameCount >= options.frameCount;
+		results.seconds = benchmarkRecorder.GetSeconds();
+		results.frameStats = SummarizeFrameSamples(benchmarkRecorder.GetSamples());
+		results.gpuFrameMs = framePacer.GetAverageTimings().gpuBusyMs;
+		results.inputToPresentSampleCount = presentLatency.GetSampleCount(presentPolicy);
+		results.inputToPresentMs = presentLatency.GetPercentiles(presentPolicy);
+		results.isInputToPresentDisplayed = presentLatency.IsWaitingForPresent();
+
+		GpuAllocatorStats allocatorStats = gpuAllocator.GetStats();
+		results.peakGpuBlockBytes = allocatorStats.peakBlockBytes;
+		results.peakGpuUsedBytes = allocatorStats.peakUsedBytes;
+		results.peakProcessBytes = GetPeakProcessMemory();
+
+		WriteBenchmarkResults(options.benchmarkPath, settings, results);
+
+		std::ostringstream message;
+		message << std::fixed << std::setprecision(2) << "Benchmark results written to " << options.benchmarkPath
+			<< ": " << results.frameCount << " frames in " << results.seconds << " s";
+		if (!results.completed) {
+			message << ", stopped before all " << options.frameCount << " frames were measured";
+		}
+		PrintMessage(message.str());
+	}
+
+
+	void ReportPresentLatency()
+	{
+		if (options.headless) {
+			return;
+		}
+
+		std::cout << "Input to present latency per present policy, "
+			<< (presentLatency.IsWaitingForPresent() ? "until presented" : "until vkQueuePresentKHR returned, VK_KHR_present_wait is not available")
+			<< " (ms):\n" << std::fixed << std::setprecision(3)
+			<< std::left << std::setw(12) << "" << std::right << std::setw(10) << "frames"
+			<< std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+
+		for (uint32_t i = 0; i < PRESENT_POLICY_COUNT; ++i) {
+			PresentPolicy policy = static_cast<PresentPolicy>(i);
+			uint64_t sampleCount = presentLatency.GetSampleCount(policy);
+			if (sampleCount == 0) {
+				continue;
+			}
+
+			FrameStatPercentiles latency = presentLatency.GetPercentiles(policy);
+			std::cout << std::left << std::setw(12) << GetPresentPolicyName(policy) << std::right << std::setw(10) << sampleCount
+				<< std::setw(10) << latency.p50 << std::setw(10) << latency.p95 << std::setw(10) << latency.p99 << std::setw(10) << latency.max << "\n";
+		}
+		std::cout << std::flush;
+	}
+
+
+	void ResetAverages()
+	{
+		framePacer.ResetAverages();
+		gpuProfiler.ResetAverages();
+		recordTimeSum = {};
+		recordedFrameCount = 0;
+	}
+
+
+	void CleanUp()
+	{
+		framePacer.Destroy();
+		gpuProfiler.Destroy();
+
+		DestroyReadbackBuffers();
+
+		// Workers are idle between frames, but they must be gone before their command pools are.
+		jobSystem.Destroy();
+		frameCommandPools.Destroy();
+
+		if (options.computeMode != ComputeMode::Off) {
+			DestroyVertexAnimation();
+		}
+		DestroyMeshBuffers();
+
+		CleanUpSwapchainViews();
+
+		// Waits for pipelines still compiling, they use the shader modules, the layout and the worker caches.
+		pipelineLibrary.Destroy();
+
+		shaderRegistry.Release(fragShader.codeHash);
+		shaderRegistry.Release(vertShader.codeHash);
+		shaderRegistry.Destroy();
+		shaderCompiler.Destroy();
+
 		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
-		vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+		renderGraph.Destroy();
 
-		for (auto imageView : swapchainImageViews) {
-			vkDestroyImageView(logicalDevice, imageView, nullptr);
+		// Offscreen targets are owned by the application, swapchain images by the swapchain.
+		// The swapchain extension is not enabled in headless mode, so its functions must not be called.
+		if (options.headless) {
+			DestroyOffscreenTargets();
+		}
+		else {
+			vkDestroySwapchainKHR(logicalDevice, swapchain, nullptr);
 		}
 
-		vkDestroySwapchainKHR(logicalDevice, swapchain, nullptr);
+		// Pipelines created during this run are stored for the next launch.
+		pipelineCache.Save();
+		pipelineCache.Destroy();
+
+		uploadEngine.Destroy();
+
+		// All buffers and images are destroyed by now, this releases the memory blocks.
+		gpuAllocator.Destroy();
 
 		// Logical devices don't interact directly with instances, which is why it's not included as a parameter.
 		vkDestroyDevice(logicalDevice, nullptr);
@@ -196,97 +1020,189 @@ private:
 			DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 		}
 
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+		if (surface != VK_NULL_HANDLE) {
+			vkDestroySurfaceKHR(instance, surface, nullptr);
+		}
+
 
 		vkDestroyInstance(instance, nullptr);
 
-		glfwDestroyWindow(window);
+		if (!options.headless) {
+			glfwDestroyWindow(window);
 
-		glfwTerminate();
+			glfwTerminate();
+		}
 	}
 
 
 	void CreateSyncObjects()
 	{
-		// Each frame should have its own set of semaphores.
-		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-		imagesInFlight.resize(swapchainImages.size(), VK_NULL_HANDLE);
+		// Semaphores live in the frame pacer: the graphics timeline and one acquire semaphore per frame in flight.
+		QueueFamilyIndices indices = FindQueueFamilies(physicalDevice);
+
+		framePacer.Init(physicalDevice, logicalDevice, indices.graphicsFamily.value(), GetInitialFramesInFlight(), swapchainImages.size());
 
-		VkSemaphoreCreateInfo semaphoreInfo{};
-		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+		if (isPresentWaitEnabled) {
+			waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(logicalDevice, "vkWaitForPresentKHR"));
+		}
+		presentLatency.Init(logicalDevice, waitForPresent);
 
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		// Initialize fence with signaled state to avoid looping in the begining of DrawFrame.
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		// Scopes are collected per frame slot, as many as there can ever be frames in flight.
+		gpuProfiler.Init(instance, physicalDevice, logicalDevice, indices.graphicsFamily.value(), FramePacer::MAX_FRAMES_IN_FLIGHT,
+			isCalibratedTimestampsEnabled, !options.tracePath.empty());
+	}
 
-		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-			if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(logicalDevice, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
 
-				throw std::runtime_error("Failed to create synchronization objects for a frame");
-			}
+	// --frames-in-flight wins over the present policy. Headless mode presents nothing, so it has no policy.
+	uint32_t GetInitialFramesInFlight() const
+	{
+		if (options.framesInFlight != 0) {
+			return options.framesInFlight;
 		}
+		return options.headless ? DEFAULT_FRAMES_IN_FLIGHT : presentConfig.framesInFlight;
 	}
 
 
 	void DrawFrame()
 	{
-		// Takes an array of fences and waits for either any or all of them to be signaled before returning.
-		vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-		
-		// Acquire an image from the swapchain.
-		// Third parameter specifies a timeout in nanoseconds for an image to become available. 
-		// Using the maximum value of a 64 bit unsigned integer disables the timeout.
-		// Index refers to the VkImage in swapchainImages array.
-		uint32_t imageIndex;
-		vkAcquireNextImageKHR(logicalDevice, swapchain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		// Wait until the GPU is done with the frame that used the current frame slot the last time.
+		// This is the only place where the CPU waits for the GPU, so up to framesInFlight frames overlap.
+		auto frameStart = std::chrono::steady_clock::now();
+		framePacer.BeginFrame();
+		auto frameWaitEnd = std::chrono::steady_clock::now();
+		gpuProfiler.AddCpuScope("wait for frame", frameStart, frameWaitEnd);
+
+		// Durations of the steps of the frame, pushed to the stats ring once it's submitted. The very first frame
+		// has no frame time and isn't pushed.
+		FrameSample sample;
+		sample[FrameStat::FrameTime] = ElapsedMs(lastFrameStart, frameStart);
+		sample[FrameStat::FrameWait] = ElapsedMs(frameStart, frameWaitEnd);
+		bool hasFrameTime = lastFrameStart != std::chrono::steady_clock::time_point{};
+		lastFrameStart = frameStart;
+
+		// The frame slot's last submission is complete, its GPU scopes can be read.
+		gpuProfiler.BeginFrame(framePacer.GetCurrentFrame());
+
+		// The compute pass goes first, so it runs on its queue while this thread acquires and records the frame.
+		TimelinePoint computeWait;
+		if (options.computeMode != ComputeMode::Off) {
+			CpuProfileScope scope(gpuProfiler, "submit compute");
+			computeWait = SubmitVertexAnimation();
+		}
 
-		// Check if a previous frame is using this image (i.e. there is its fence to wait on)
-		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-			vkWaitForFences(logicalDevice, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+		uint32_t imageIndex;
+		if (options.headless) {
+			// Offscreen targets are used round-robin, one per frame in flight. The timeline value waited for in BeginFrame
+			// guarantees that the frame rendered into this target framesInFlight frames ago is complete,
+			// so its readback buffer can be read now without stalling the queue.
+			imageIndex = framePacer.GetCurrentFrame();
+
+			CpuProfileScope scope(gpuProfiler, "readback");
+			ReadbackFrame(imageIndex);
 		}
-		// Mark the image as now being in use by this frame
-		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+		else {
+			// Acquire an image from the swapchain.
+			// Third parameter specifies a timeout in nanoseconds for an image to become available. 
+			// Using the maximum value of a 64 bit unsigned integer disables the timeout.
+			// Index refers to the VkImage in swapchainImages array.
+			auto acquireStart = std::chrono::steady_clock::now();
+			VkResult result = vkAcquireNextImageKHR(logicalDevice, swapchain, UINT64_MAX, framePacer.GetImageAvailableSemaphore(), VK_NULL_HANDLE, &imageIndex);
+			auto acquireEnd = std::chrono::steady_clock::now();
+			gpuProfiler.AddCpuScope("acquire", acquireStart, acquireEnd);
+			sample[FrameStat::Acquire] = ElapsedMs(acquireStart, acquireEnd);
+
+			// Acquire waits for the presentation engine to give up an image, presents have most likely finished now.
+			presentLatency.Poll();
+
+			// VK_ERROR_OUT_OF_DATE_KHR: the swapchain can't be used for rendering anymore, usually after a resize.
+			// Nothing has been acquired, so the frame is skipped. Its compute pass may already be submitted, and the
+			// animation has advanced by a frame. RecreateSwapchain() waits for the device to be idle, so that work has
+			// finished when it returns, before the next frame resets the slot's compute command pool.
+			// VK_SUBOPTIMAL_KHR: the image can still be presented, the swapchain is recreated after the present.
+			if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+				RecreateSwapchain();
+				return;
+			}
+			else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+				throw std::runtime_error("Failed to acquire swapchain image");
+			}
+		}
+
+		// Wait if a previous frame is still rendering to this image, then mark it as used by this frame.
+		auto imageWaitStart = std::chrono::steady_clock::now();
+		framePacer.WaitForImage(imageIndex);
+		auto imageWaitEnd = std::chrono::steady_clock::now();
+		gpuProfiler.AddCpuScope("wait for image", imageWaitStart, imageWaitEnd);
+		sample[FrameStat::FrameWait] += ElapsedMs(imageWaitStart, imageWaitEnd);
+
+		// The frame is recorded from scratch every time. The timeline value waited for in BeginFrame guarantees that
+		// the command pool of the current frame slot is not used by the GPU anymore, so it can be reset.
+		auto recordStart = std::chrono::steady_clock::now();
+
+		VkCommandBuffer commandBuffer = frameCommandPools.BeginFrame(framePacer.GetCurrentFrame());
+
+		// Take over resources uploaded on the transfer queue since the last frame.
+		VkPipelineStageFlags uploadWaitStages = 0;
+		TimelinePoint uploadWait = uploadEngine.RecordAcquire(commandBuffer, uploadWaitStages);
 
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		RecordCommandBuffer(commandBuffer, imageIndex);
+
+		auto recordEnd = std::chrono::steady_clock::now();
+		gpuProfiler.AddCpuScope("record", recordStart, recordEnd);
+		sample[FrameStat::Record] = ElapsedMs(recordStart, recordEnd);
+		recordTimeSum += recordEnd - recordStart;
+		++recordedFrameCount;
+
+		SubmitBatch submit;
 		// Specify which semaphores to wait on before execution begins and in which stage(s) of the pipeline to wait.
 		// We want to wait with writing colors to the image until it's available, so we're specifying the stage of the 
 		// graphics pipeline that writes to the color attachment. That means that theoretically the implementation can 
-		// already start executing vertex shader and such while the image is not yet available. Each entry in the waitStages 
-		// array corresponds to the semaphore with the same index in pWaitSemaphores.
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
-		// The next two parameters specify which command buffers to actually submit for execution. 
+		// already start executing vertex shader and such while the image is not yet available.
+		// Offscreen targets are not acquired, so there is nothing to wait on in headless mode.
+		if (!options.headless) {
+			submit.WaitBinary(framePacer.GetImageAvailableSemaphore(), VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		}
+		// Pending uploads: wait until the transfer queue's timeline has passed the copies.
+		submit.Wait(uploadWait, uploadWaitStages);
+		// Animated vertices: only vertex input waits for the compute pass, so the start of the frame overlaps with it.
+		submit.Wait(computeWait, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
 		// We should submit the command buffer that binds the swapchain image we just acquired as color attachment.
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
-		// The next two parameters specify which semaphores to signal once the command buffer(s) have finished execution.
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
-
-		// Unlike the semaphores, we manually need to restore the fence to the unsignaled state.
-		vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
-
-		// The function takes an array of VkSubmitInfo structures as argument for efficiency when the workload is much larger. 
-		// The last parameter references an optional fence that will be signaled when the command buffers finish execution.
-		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+		submit.AddCommandBuffer(commandBuffer);
+
+		// The frame's value on the graphics timeline tells the frame pacer when the frame slot and the image are free
+		// again, no fence needed. The binary semaphore lets the presentation wait for the rendering.
+		submit.Signal(framePacer.GetFrameCompletePoint());
+		VkSemaphore renderFinishedSemaphore = framePacer.GetRenderFinishedSemaphore();
+		if (!options.headless) {
+			submit.SignalBinary(renderFinishedSemaphore);
+		}
+
+		auto submitStart = std::chrono::steady_clock::now();
+		if (submit.Submit(graphicsQueue) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to submit draw command buffer");
 		}
+		auto submitEnd = std::chrono::steady_clock::now();
+		gpuProfiler.AddCpuScope("submit", submitStart, submitEnd);
+		gpuProfiler.EndFrame();
+		sample[FrameStat::Submit] = ElapsedMs(submitStart, submitEnd);
+
+		if (options.headless) {
+			readbackPending[imageIndex] = true;
+
+			framePacer.EndFrame();
+			if (hasFrameTime) {
+				frameStats.Push(sample);
+			}
+			return;
+		}
 
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		// Specify which semaphores to wait on before presentation can happen.
 		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
+		presentInfo.pWaitSemaphores = &renderFinishedSemaphore;
 		// Specify the swapchains to present images to and the index of the image for each swapchain. 
 		VkSwapchainKHR swapchains[] = { swapchain };
 		presentInfo.swapchainCount = 1;
@@ -296,141 +1212,253 @@ private:
 		// If using a single swapchain, then simply use the return value of the present function.
 		presentInfo.pResults = nullptr; // Optional
 
+		// With VK_KHR_present_wait every present gets an id, to find out when it was presented.
+		uint64_t presentId = presentLatency.GetNextPresentId();
+		VkPresentIdKHR presentIdInfo{};
+		presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentIdInfo.swapchainCount = 1;
+		presentIdInfo.pPresentIds = &presentId;
+		if (presentLatency.IsWaitingForPresent()) {
+			presentInfo.pNext = &presentIdInfo;
+		}
+
 		// Submits the request to present an image to the swapchain. 
-		vkQueuePresentKHR(presentQueue, &presentInfo);
-
-		vkQueueWaitIdle(presentQueue);
-
-		currentFrame = ++currentFrame % MAX_FRAMES_IN_FLIGHT;
-	}
-
-
-	void CreateRenderPass()
-	{
-		// Specify how many color and depth buffers there will be, how many samples to use for each of them,
-		// how their contents should be handled throughout the rendering operations. All of this info is in render pass object.
-
-		VkAttachmentDescription colorAttachment{};
-		colorAttachment.format = swapchainImageFormat;
-		// No multisampling for now.
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-
-		// loadOp - what to do with the data in the attachment before rendering.
-		// storeOp - after rendering.
-		// Apply to color and depth data.
-		// 1. VK_ATTACHMENT_LOAD_OP_LOAD: Preserve the existing contents of the attachment.
-		// 2. VK_ATTACHMENT_LOAD_OP_CLEAR: Clear the values to a constant at the start.
-		// 3. VK_ATTACHMENT_LOAD_OP_DONT_CARE: Existing contents are undefined; we don't care about them.
-		// 1. VK_ATTACHMENT_STORE_OP_STORE: Rendered contents will be stored in memory and can be read later.
-		// 2. VK_ATTACHMENT_STORE_OP_DONT_CARE: Contents of the framebuffer will be undefined after the rendering operation.
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		// Almost same for stencil buffer.
-		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		// Images need to be transitioned to specific layouts that are suitable for the operation that they're going 
-		// to be involved in next. 
-		// The initialLayout specifies which layout the image will have before the render pass begins. The finalLayout 
-		// specifies the layout to automatically transition to when the render pass finishes. Using VK_IMAGE_LAYOUT_UNDEFINED 
-		// for initialLayout means that we don't care what previous layout the image was in. The caveat of this special value 
-		// is that the contents of the image are not guaranteed to be preserved, but that doesn't matter since we're going 
-		// to clear it anyway. We want the image to be ready for presentation using the swapchain after rendering, 
-		// which is why we use VK_IMAGE_LAYOUT_PRESENT_SRC_KHR as finalLayout
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		// A single render pass can consist of multiple subpasses. Subpasses are subsequent rendering operations that depend 
-		// on the contents of framebuffers in previous passes, for example a sequence of post-processing effects that are 
-		// applied one after another. If you group these rendering operations into one render pass, then Vulkan is able to 
-		// reorder the operations and conserve memory bandwidth for possibly better performance. 
-		// For our very first triangle we'll stick to a single subpass.
-		// Every subpass references one or more of the attachments that we've described using the structure in the previous sections.
-
-		VkAttachmentReference colorAttachmentRef{};
-		// Attachment index.
-		colorAttachmentRef.attachment = 0;
-		// Specify which layout we would like the attachment to have during a subpass that uses this reference.
-		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-		// Subpass itself.
-		VkSubpassDescription subpass{};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		// Specify reference.
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorAttachmentRef;
-
-		VkRenderPassCreateInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = 1;
-		renderPassInfo.pAttachments = &colorAttachment;
-		renderPassInfo.subpassCount = 1;
-		renderPassInfo.pSubpasses = &subpass;
-
-		if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create render pass");
-		}
-
-		// The first two fields specify the indices of the dependency and the dependent subpass.
-		// The special value VK_SUBPASS_EXTERNAL refers to the implicit subpass before or after the render pass 
-		// depending on whether it is specified in srcSubpass or dstSubpass.The index 0 refers to our subpass, 
-		// which is the firstand only one. The dstSubpass must always be higher than srcSubpass to prevent cycles 
-		// in the dependency graph(unless one of the subpasses is VK_SUBPASS_EXTERNAL).
-		// ah...
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		// The next two fields specify the operations to wait on and the stages in which these operations occur. 
-		// We need to wait for the swapchain to finish reading from the image before we can access it. 
-		// This can be accomplished by waiting on the color attachment output stage itself.
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		// The operations that should wait on this are in the color attachment stage and involve the writing 
-		// of the color attachment. These settings will prevent the transition from happening until it's actually necessary 
-		// (and allowed): when we want to start writing colors to it.
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
-	}
-
-
-	void CreateGraphicsPipeline()
+		// No vkQueueWaitIdle here: the next frame only waits for its own timeline value, so CPU and GPU work overlap.
+		auto presentStart = std::chrono::steady_clock::now();
+		VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		auto presentEnd = std::chrono::steady_clock::now();
+		gpuProfiler.AddCpuScope("present", presentStart, presentEnd);
+		sample[FrameStat::Present] = ElapsedMs(presentStart, presentEnd);
+		presentLatency.OnPresent(swapchain, presentPolicy, inputTime);
+
+		framePacer.EndFrame();
+		if (hasFrameTime) {
+			frameStats.Push(sample);
+		}
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
+			framebufferResized = false;
+			RecreateSwapchain();
+		}
+		else if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to present swapchain image");
+		}
+	}
+
+
+	static float ElapsedMs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+	{
+		return std::chrono::duration<float, std::milli>(end - start).count();
+	}
+
+
+	void RecreateSwapchain()
+	{
+		// A minimized window has a zero sized framebuffer, and a swapchain can't have zero extent. Wait until it's visible again.
+		int width = 0, height = 0;
+		glfwGetFramebufferSize(window, &width, &height);
+		while ((width == 0 || height == 0) && !glfwWindowShouldClose(window)) {
+			glfwWaitEvents();
+			glfwGetFramebufferSize(window, &width, &height);
+		}
+
+		if (glfwWindowShouldClose(window)) {
+			return;
+		}
+
+		auto recreateStart = std::chrono::steady_clock::now();
+
+		// Framebuffers and image views may still be used by frames in flight.
+		vkDeviceWaitIdle(logicalDevice);
+
+		// Only what depends on the swapchain images and the extent is recreated. The render graph is described again
+		// for the new images. It keeps its render passes, so the same description gives the same render pass, and
+		// the pipeline survives, because viewport and scissor are dynamic state. A new format gives a new render pass,
+		// and the pipeline library needs a pipeline for its compatibility class. The old pipeline stays in the library,
+		// it's found again if the format ever changes back.
+		CleanUpSwapchainViews();
+
+		CreateSwapchain();
+		CreateImageViews();
+
+		uint64_t oldRenderPassHash = renderPassHash;
+		BuildRenderGraph();
+		if (renderPassHash != oldRenderPassHash) {
+			CreateGraphicsPipeline();
+		}
+
+		// The image count may differ, and the images are new, so none of them is in flight anymore.
+		framePacer.SetImageCount(swapchainImages.size());
+
+		double recreateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recreateStart).count();
+
+		std::ostringstream message;
+		message << std::fixed << std::setprecision(2) << "Swapchain recreated: " << swapchainExtent.width << "x" << swapchainExtent.height
+			<< ", " << swapchainImages.size() << " images in " << recreateMs << " ms";
+		PrintMessage(message.str());
+	}
+
+
+	void CleanUpSwapchainViews()
+	{
+		// The graph's framebuffers reference the image views, and its transient images have the swapchain extent.
+		renderGraph.Reset();
+
+		for (auto imageView : swapchainImageViews) {
+			vkDestroyImageView(logicalDevice, imageView, nullptr);
+		}
+		swapchainImageViews.clear();
+	}
+
+
+	// The mesh lies in the z = 0 plane, in Vulkan's clip space orientation with y pointing down. Neither the view nor the
+	// projection flips y, so it keeps that orientation. The camera is as far away as it takes for the height of the
+	// [-1, 1] square to fill the view.
+	void UpdateViewProjection()
+	{
+		float aspect = static_cast<float>(swapchainExtent.width) / static_cast<float>(swapchainExtent.height);
+		float distance = 1.0f / std::tan(CAMERA_FOV_Y * 0.5f);
+
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		viewProjection = MakeReversedZPerspective(CAMERA_FOV_Y, aspect, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE) * view;
+	}
+
+
+	void CreateRenderGraph()
+	{
+		depthFormat = SelectDepthFormat(physicalDevice);
+
+		msaaSamples = SelectSampleCount(physicalDevice, options.msaaSamples);
+		if (static_cast<uint32_t>(msaaSamples) != options.msaaSamples) {
+			PrintMessage("MSAA: " + std::to_string(options.msaaSamples) + "x is not supported, using " +
+				std::to_string(static_cast<uint32_t>(msaaSamples)) + "x");
+		}
+
+		renderGraph.Init(logicalDevice, gpuAllocator);
+		BuildRenderGraph();
+
+		PrintMessage("Render graph: " + renderGraph.GetSummary());
+	}
+
+
+	// Describes the frame as passes and the images they use. The graph derives the render pass from it: attachments,
+	// load and store ops, layout transitions and subpass dependencies, and the barriers between passes outside of render passes.
+	void BuildRenderGraph()
+	{
+		// The image the frame is rendered into, a swapchain image or an offscreen target. Its contents at the start
+		// of the frame don't matter, the scene clears it, so its layout is undefined.
+		// The acquire semaphore is waited on at the color attachment output stage, so starting there continues its
+		// dependency chain, and nothing has to be made available: the presentation engine only read the image.
+		// Presentation needs no dependency at the end: the render finished semaphore waits for all commands of the submission.
+		// Offscreen targets are not presented. They were last read by the readback copy of an earlier frame,
+		// and end up in the layout for copying.
+		RenderGraphImageState initialState;
+		RenderGraphImageState finalState;
+		if (options.headless) {
+			initialState = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TRANSFER_BIT, 0 };
+			finalState = { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0 };
+		}
+		else {
+			initialState = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 };
+			finalState = { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0 };
+		}
+		backbuffer = renderGraph.ImportImage("backbuffer", swapchainImageFormat, swapchainExtent, VK_SAMPLE_COUNT_1_BIT,
+			initialState, finalState);
+
+		scenePass = renderGraph.AddPass("scene", RenderGraphPassKind::Graphics,
+			[this](VkCommandBuffer commandBuffer, const RenderGraphPassContext& context) {
+				if (jobSystem.GetWorkerCount() > 0) {
+					ExecuteDrawsInParallel(commandBuffer, context);
+				}
+				else {
+					RecordDraws(commandBuffer, options.drawCount);
+				}
+			});
+
+		// With MSAA the scene is drawn into a multisampled image, which the end of the subpass resolves into the backbuffer.
+		// Resolving in the subpass instead of in a pass of its own lets tile based GPUs resolve straight from tile memory,
+		// the samples are never written out. Like depth, the multisampled image only lives inside the render pass.
+		VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+		if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+			RenderGraphImage sceneColor = renderGraph.CreateImage("scene color", swapchainImageFormat, swapchainExtent, msaaSamples);
+			renderGraph.ClearImage(scenePass, sceneColor, RenderGraphUsage::ColorAttachment, clearColor);
+			renderGraph.UseImage(scenePass, backbuffer, RenderGraphUsage::ResolveAttachment);
+		}
+		else {
+			renderGraph.ClearImage(scenePass, backbuffer, RenderGraphUsage::ColorAttachment, clearColor);
+		}
+
+		// Depth only matters while the scene is drawn. The graph neither loads nor stores it, so it never leaves the tile
+		// on tile based GPUs, and it lives in lazily allocated memory where the device has it.
+		RenderGraphImage depth = renderGraph.CreateImage("depth", depthFormat, swapchainExtent, msaaSamples);
+
+		VkClearValue clearDepth{};
+		clearDepth.depthStencil = { REVERSED_Z_CLEAR_DEPTH, 0 };
+		renderGraph.ClearImage(scenePass, depth, RenderGraphUsage::DepthStencilAttachment, clearDepth);
+
+		// With worker threads the draws come from secondary command buffers instead of being embedded in the primary one.
+		if (jobSystem.GetWorkerCount() > 0) {
+			renderGraph.SetSubpassContents(scenePass, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		}
+
+		if (options.headless) {
+			uint32_t readbackPass = renderGraph.AddPass("readback", RenderGraphPassKind::Commands,
+				[this](VkCommandBuffer commandBuffer, const RenderGraphPassContext&) {
+					uint32_t readbackScope = gpuProfiler.CmdBeginScope(commandBuffer, "readback copy");
+					RecordReadback(commandBuffer, recordingImageIndex);
+					gpuProfiler.CmdEndScope(commandBuffer, readbackScope);
+				});
+
+			renderGraph.UseImage(readbackPass, backbuffer, RenderGraphUsage::TransferSource);
+			// The copy writes a buffer the graph doesn't know about.
+			renderGraph.SetSideEffects(readbackPass);
+		}
+
+		renderGraph.Compile();
+
+		renderPass = renderGraph.GetRenderPass(scenePass);
+		renderPassHash = renderGraph.GetRenderPassHash(scenePass);
+	}
+
+
+	// placeholder: pipeline drawn with until the new one is compiled. Without one this waits for the compilation.
+	void CreateGraphicsPipeline(uint32_t placeholder = PipelineLibrary::INVALID_ID)
 	{
 		// ---------------------------------------------------
 		// DESCRIBE THE PROGRAMMABLE STAGES OF THE PIPELINE.
 		// ---------------------------------------------------
 
-		// Upload shaders as bytecode.
-		auto vertShaderCode = ReadFile("shaders/vert.spv");
-		auto fragShaderCode = ReadFile("shaders/frag.spv");
+		// The pipeline is described by value and created by the pipeline library, which hashes the description
+		// and only compiles pipelines it doesn't have yet.
+		GraphicsPipelineDesc desc;
 
-		VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-		VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+		// Shaders as SPIR-V bytecode. The registry loads every file once and shares the module with everyone
+		// who acquires it, so a recreated render pass reuses the modules. Pipelines are keyed by the code hash.
+		if (vertShader.module == VK_NULL_HANDLE) {
+			LoadShaders(vertShader, fragShader);
+		}
 
-		// Vertex shader stage info.
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertShaderStageInfo.module = vertShaderModule;
-		// Function to invoke, entrypoint. It is possible to combine multiple fragment shaders 
+		// Vertex shader stage.
+		// The entry point is the function to invoke. It is possible to combine multiple fragment shaders 
 		// into a single shader module and use different entry points to differentiate between their behaviors.
-		vertShaderStageInfo.pName = "main";
-		// Allows to specify values for shader constants. We can use a single shader module where its behavior 
-		// can be configured at pipeline creation by specifying different values for the constants used in it. 
-		// This is more efficient than configuring the shader using variables at render time, because the compiler 
-		// can do optimizations like eliminating if statements that depend on these values. 
-		vertShaderStageInfo.pSpecializationInfo = nullptr;
-
-		// Fragment shader stage info.
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
-		fragShaderStageInfo.pName = "main";
-		fragShaderStageInfo.pSpecializationInfo = nullptr;
-
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+		PipelineShaderStage vertShaderStage;
+		vertShaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		vertShaderStage.module = vertShader.module;
+		vertShaderStage.codeHash = vertShader.codeHash;
+		vertShaderStage.entryPoint = "main";
+
+		// Fragment shader stage.
+		PipelineShaderStage fragShaderStage;
+		fragShaderStage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		fragShaderStage.module = fragShader.module;
+		fragShaderStage.codeHash = fragShader.codeHash;
+		fragShaderStage.entryPoint = "main";
+		// Values for the shader's specialization constants. One shader module can be configured differently for every
+		// pipeline. This is more efficient than configuring the shader with variables at render time, because the
+		// compiler can eliminate the if statements that depend on these values.
+		fragShaderStage.specialization = permutation.GetFragmentConstants();
+
+		desc.stages = { vertShaderStage, fragShaderStage };
 
 		// ---------------------------------------------------
 		// DESCRIBE THE FIXED-FUNCTION STAGES OF THE PIPELINE.
@@ -441,61 +1469,32 @@ private:
 		// 1. Bindings: spacing between data and whether the data is per-vertex or per-instance.
 		// 2. Attribute descriptions: type of the attributes passed to the vertex shader, which binding 
 		//    to load them from and at which offset.
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 0;
-		vertexInputInfo.pVertexBindingDescriptions = nullptr; // Optional.
-		vertexInputInfo.vertexAttributeDescriptionCount = 0;
-		vertexInputInfo.pVertexAttributeDescriptions = nullptr; // Optional.
+		desc.vertexInput = GetVertexInputDescription(options.vertexStreamLayout);
 
 		// ---------------------------------------------------
 		// INPUT ASSEMBLY.
 		// ---------------------------------------------------
 
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		VkPipelineInputAssemblyStateCreateInfo& inputAssembly = desc.inputAssembly;
 		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		// If true, then it is possible to break up lines and triangles in the _STRIP topology modes
 		// by using a special index of 0xFFFF or 0xFFFFFFFF.
 		inputAssembly.primitiveRestartEnable = VK_FALSE;
 
 		// ---------------------------------------------------
-		// VIEWPORT.
+		// VIEWPORT AND SCISSOR.
 		// ---------------------------------------------------
 
 		// Viewport - region of the framebuffer, that the output will be fully rendered to.
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)swapchainExtent.width;
-		viewport.height = (float)swapchainExtent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		// ---------------------------------------------------
-		// SCISSOR.
-		// ---------------------------------------------------
-
 		// Scissor - region of the framebuffer. Any pixels outside the scissor rectangle will be discarded by the rasterizer. 
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapchainExtent;
-
-		// Viewport and scissor rectangle need to be combined into a viewport state.
-		// It is possible to use multiple viewports and scissor rectangles on some GPUs, so its members reference an array of them.
-		VkPipelineViewportStateCreateInfo viewportState{};
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
+		// Both are dynamic state (see dynamic_state.h), so the pipeline doesn't depend on the swapchain extent
+		// and survives a resize. The pipeline library declares one viewport and one scissor for every pipeline.
 
 		// ---------------------------------------------------
 		// RASTERIZER.
 		// ---------------------------------------------------
 
-		VkPipelineRasterizationStateCreateInfo rasterizer{};
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		VkPipelineRasterizationStateCreateInfo& rasterizer = desc.rasterization;
 		// If VK_TRUE, then fragments that are beyond the near and far planes are clamped instead of discarding. 
 		rasterizer.depthClampEnable = VK_FALSE;
 		// If VK_TRUE, then geometry never passes through the rasterizer stage. Basically disables any output to the framebuffer.
@@ -506,26 +1505,22 @@ private:
 		// 3. VK_POLYGON_MODE_POINT : polygon vertices are drawn as points.
 		// Using any mode other than fill requires enabling a GPU feature.
 		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		// Describes the thickness of lines in terms of number of fragments.
+		// Describes the thickness of lines in terms of number of fragments. Dynamic, so ignored here.
 		rasterizer.lineWidth = 1.0f;
 		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
 		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		// Whether depth bias is applied is part of the pipeline, the bias factors are dynamic state.
 		rasterizer.depthBiasEnable = VK_FALSE;
-		rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-		rasterizer.depthBiasClamp = 0.0f; // Optional
-		rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
 
 		// ---------------------------------------------------
 		// MSAA.
 		// ---------------------------------------------------
 
-		// Disable multisampling for now.
-		VkPipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		// Must match the attachments of the scene subpass. Fragments are shaded once per pixel, not per sample.
+		VkPipelineMultisampleStateCreateInfo& multisampling = desc.multisample;
 		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisampling.rasterizationSamples = msaaSamples;
 		multisampling.minSampleShading = 1.0f; // Optional
-		multisampling.pSampleMask = nullptr; // Optional
 		multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
 		multisampling.alphaToOneEnable = VK_FALSE; // Optional
 
@@ -533,8 +1528,9 @@ private:
 		// DEPTH AND STENCIL TESTING.
 		// ---------------------------------------------------
 
-		// Do not use depth and stencil testing for now.
-		// VkPipelineDepthStencilStateCreateInfo
+		// Reversed-Z depth test, see depth_buffer.h. The fragment shader neither discards nor writes depth,
+		// so the test runs before it and hidden fragments are never shaded.
+		desc.depthStencil = MakeReversedZDepthState();
 
 		// ---------------------------------------------------
 		// COLOR BLENDING.
@@ -574,223 +1570,481 @@ private:
 		// colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 		// colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 
-		// Global blending settings.
-		// Combine the old and new value using a bitwise operation.
-		VkPipelineColorBlendStateCreateInfo colorBlending{};
-		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlending.logicOpEnable = VK_FALSE;
-		colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-		colorBlending.blendConstants[0] = 0.0f; // Optional
-		colorBlending.blendConstants[1] = 0.0f; // Optional
-		colorBlending.blendConstants[2] = 0.0f; // Optional
-		colorBlending.blendConstants[3] = 0.0f; // Optional
+		// Global blending settings.
+		// Combine the old and new value using a bitwise operation.
+		VkPipelineColorBlendStateCreateInfo& colorBlending = desc.colorBlend;
+		colorBlending.logicOpEnable = VK_FALSE;
+		colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
+		// One attachment state per color attachment. blendConstants are dynamic state.
+		desc.blendAttachments = { colorBlendAttachment };
+
+
+		// ---------------------------------------------------
+		// DYNAMIC STATE.
+		// ---------------------------------------------------
+
+		// A limited amount of the state that we've specified in the previous structs can actually be changed without 
+		// recreating the pipeline. Examples are the size of the viewport, line width and blend constants.
+		// The pipeline library makes the states of dynamic_state.h dynamic in every pipeline, they are set from
+		// dynamicPipelineState in RecordDraws.
+
+		// ---------------------------------------------------
+		// PIPELINE LAYOUT.
+		// ---------------------------------------------------
+
+		// Doesn't depend on the render pass either, so it's created once.
+		if (pipelineLayout == VK_NULL_HANDLE) {
+			VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+			pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pipelineLayoutInfo.setLayoutCount = 0; // Optional
+			pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
+			// The view projection matrix of the vertex shader.
+			VkPushConstantRange pushConstantRange{};
+			pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+			pushConstantRange.offset = 0;
+			pushConstantRange.size = sizeof(glm::mat4);
+
+			pipelineLayoutInfo.pushConstantRangeCount = 1;
+			pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+			if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create pipeline layout");
+			}
+		}
+
+		// ---------------------------------------------------
+		// CREATE GRAPHICS PIPELINE.
+		// ---------------------------------------------------
+
+		desc.layout = pipelineLayout;
+		// The pipeline can be used with every render pass compatible with this one.
+		desc.renderPass = renderPass;
+		desc.renderPassHash = renderPassHash;
+		desc.subpass = renderGraph.GetSubpass(scenePass);
+
+		// The library compiles on its own threads. With a placeholder the frames keep drawing with it until the new
+		// pipeline is ready. Without one nothing can be drawn, so wait for it.
+		// With a warm pipeline cache the driver finds the compiled pipeline there instead of compiling the shaders again.
+		auto creationStart = std::chrono::steady_clock::now();
+
+		graphicsPipelineId = pipelineLibrary.Request(desc, placeholder);
+		if (placeholder != PipelineLibrary::INVALID_ID) {
+			return;
+		}
+
+		pipelineLibrary.Wait(graphicsPipelineId);
+		PrintMessage("Graphics pipeline created successfully");
+
+		pipelineCreationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - creationStart).count();
+	}
+
+
+	void LoadShaders(ShaderModule& vertex, ShaderModule& fragment)
+	{
+		if (options.precompiledShaders) {
+			vertex = shaderRegistry.Acquire("shaders/vert.spv");
+			fragment = shaderRegistry.Acquire("shaders/frag.spv");
+			return;
+		}
+
+		// Compiled from GLSL, or taken from the shader cache if the sources didn't change since they were compiled last.
+		std::string vertexPath = shaderCompiler.Compile("shaders/shader.vert", VK_SHADER_STAGE_VERTEX_BIT);
+		std::string fragmentPath = shaderCompiler.Compile("shaders/shader.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+		vertex = shaderRegistry.Acquire(vertexPath);
+		fragment = shaderRegistry.Acquire(fragmentPath);
+	}
+
+
+	void ReloadChangedShaders()
+	{
+		std::vector<std::string> changedSources = shaderCompiler.PollChangedSources();
+		if (changedSources.empty()) {
+			return;
+		}
+
+		auto reloadStart = std::chrono::steady_clock::now();
+
+		if (options.computeMode != ComputeMode::Off &&
+			std::find(changedSources.begin(), changedSources.end(), "shaders/animate.comp") != changedSources.end()) {
+			ReloadComputeShader();
+		}
+
+		// A shader with errors keeps the old pipeline running, the next save tries again.
+		ShaderModule newVertShader;
+		ShaderModule newFragShader;
+		try {
+			LoadShaders(newVertShader, newFragShader);
+		}
+		catch (const std::runtime_error& error) {
+			if (newVertShader.module != VK_NULL_HANDLE) {
+				shaderRegistry.Release(newVertShader.codeHash);
+			}
+			std::cerr << error.what() << std::endl;
+			return;
+		}
+
+		// The pipeline library keeps its own references to the modules of the current pipeline.
+		shaderRegistry.Release(vertShader.codeHash);
+		shaderRegistry.Release(fragShader.codeHash);
+		vertShader = newVertShader;
+		fragShader = newFragShader;
+
+		// The current pipeline stays in use until the new one is compiled.
+		CreateGraphicsPipeline(graphicsPipelineId);
+
+		double reloadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reloadStart).count();
+
+		std::ostringstream message;
+		message << std::fixed << std::setprecision(2) << "Shaders reloaded in " << reloadMs << " ms (" << changedSources[0];
+		for (size_t i = 1; i < changedSources.size(); ++i) {
+			message << ", " << changedSources[i];
+		}
+		message << ")";
+		PrintMessage(message.str());
+	}
+
+
+	void ReloadComputeShader()
+	{
+		ShaderModule newComputeShader;
+		try {
+			newComputeShader = LoadComputeShader();
+		}
+		catch (const std::runtime_error& error) {
+			std::cerr << error.what() << std::endl;
+			return;
+		}
+
+		// Compute pipelines are replaced in place, the frames in flight may still dispatch the old one.
+		vkDeviceWaitIdle(logicalDevice);
+		computePipeline.SetShader(newComputeShader.module);
+
+		shaderRegistry.Release(computeShader.codeHash);
+		computeShader = newComputeShader;
+	}
+
+
+	void CyclePresentPolicy()
+	{
+		if (options.headless) {
+			return;
+		}
+
+		uint32_t next = (static_cast<uint32_t>(presentPolicy) + 1) % PRESENT_POLICY_COUNT;
+		presentPolicy = static_cast<PresentPolicy>(next);
+
+		// The swapchain is recreated with the present mode and image count of the policy. Its frames in flight
+		// apply unless they were given on the command line.
+		RecreateSwapchain();
+		if (options.framesInFlight == 0) {
+			framePacer.SetFramesInFlight(presentConfig.framesInFlight);
+		}
+
+		PrintMessage(std::string("Present policy: ") + GetPresentPolicyName(presentPolicy) + ", " + GetPresentModeName(swapchainPresentMode) +
+			", " + std::to_string(swapchainImages.size()) + " images, " + std::to_string(framePacer.GetFramesInFlight()) + " frames in flight");
+	}
+
+
+	void CycleColorMode()
+	{
+		int32_t next = (static_cast<int32_t>(permutation.colorMode) + 1) % static_cast<int32_t>(ColorMode::Count);
+		permutation.colorMode = static_cast<ColorMode>(next);
+
+		// A permutation seen before is still in the pipeline library and used right away,
+		// a new one is drawn with the current pipeline until it's compiled.
+		CreateGraphicsPipeline(graphicsPipelineId);
+
+		PrintMessage(std::string("Color mode: ") + GetColorModeName(permutation.colorMode) +
+			(pipelineLibrary.IsReady(graphicsPipelineId) ? "" : " (compiling)"));
+	}
+
+
+	void CreateCommandPools()
+	{
+		// Command buffers are executed by submitting them on one of the device queues, like the graphics and 
+		// presentation queues we retrieved. Each command pool can only allocate command buffers that are submitted 
+		// on a single type of queue. We are going to record commands for drawing => choose graphics queue family.
+		QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(physicalDevice);
+
+		// 1. VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: hint that command buffers are rerecorded with new commands 
+		//    very often (may change memory allocation behavior).
+		// 2. VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: allow command buffers to be rerecorded individually, 
+		//    without this flag they all have to be reset together.
+		// Frames are re-recorded every time, so each frame slot gets a transient pool that is reset as a whole.
+		// A pool per slot is needed, because a pool can only be reset when none of its command buffers is in flight.
+		// Recording threads get their own pools on top of that.
+		jobSystem.Init(options.recordThreads);
+		frameCommandPools.Init(logicalDevice, queueFamilyIndices.graphicsFamily.value(), FramePacer::MAX_FRAMES_IN_FLIGHT,
+			jobSystem.GetWorkerCount());
+	}
 
 
-		// ---------------------------------------------------
-		// DYNAMIC STATE.
-		// ---------------------------------------------------
+	void CreateMeshBuffers()
+	{
+		// The triangle shader.vert used to hardcode, now as real vertex and index data.
+		// --triangles splits it into a grid of smaller ones, to scale the geometry work of every draw.
+		// Drawn indexed like real meshes, but every triangle has vertices of its own, so nothing comes out of the
+		// post-transform cache. This is the baseline of the indexed path, without vertex reuse.
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		BuildTriangleGrid(options.trianglesPerDraw, vertices, indices);
+
+		std::vector<std::vector<uint8_t>> streams = PackVertexStreams(vertices, options.vertexStreamLayout);
+		std::vector<uint8_t> packedIndices = PackIndices(indices, options.indexType);
+		indexCount = static_cast<uint32_t>(indices.size());
+
+		// Device local memory is the fastest for the GPU to read, but it's usually not host visible.
+		// The upload engine copies the data over on the transfer queue, all buffers in one batch.
+		// The first frame acquires them and waits for the batch on the GPU, the CPU never waits.
+		vertexBuffers.resize(streams.size());
+		vertexBufferAllocations.resize(streams.size());
+
+		for (size_t i = 0; i < streams.size(); ++i) {
+			vertexBuffers[i] = CreateDeviceLocalBuffer(streams[i].size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBufferAllocations[i]);
+			uploadEngine.UploadBuffer(vertexBuffers[i], 0, streams[i].data(), streams[i].size(),
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		}
 
-		// A limited amount of the state that we've specified in the previous structs can actually be changed without 
-		// recreating the pipeline. Examples are the size of the viewport, line width and blend constants.
-		// This will cause the configuration of these values to be ignored and you will be required to specify the data at drawing time.
-		VkDynamicState dynamicStates[] = {
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_LINE_WIDTH
-		};
+		indexBuffer = CreateDeviceLocalBuffer(packedIndices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBufferAllocation);
+		uploadEngine.UploadBuffer(indexBuffer, 0, packedIndices.data(), packedIndices.size(),
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
 
-		VkPipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = 2;
-		dynamicState.pDynamicStates = dynamicStates;
+		uploadEngine.Flush();
+	}
 
-		// ---------------------------------------------------
-		// PIPELINE LAYOUT.
-		// ---------------------------------------------------
 
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 0; // Optional
-		pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-		pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-		pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+	VkBuffer CreateDeviceLocalBuffer(VkDeviceSize size, VkBufferUsageFlags usage, GpuAllocation& allocation)
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		// Exclusive even with a dedicated transfer queue. The upload engine transfers the ownership,
+		// which is cheaper for the GPU than concurrent sharing.
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		return gpuAllocator.CreateBuffer(bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocation);
+	}
 
-		if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create pipeline layout");
+
+	void DestroyMeshBuffers()
+	{
+		for (size_t i = 0; i < vertexBuffers.size(); ++i) {
+			gpuAllocator.DestroyBuffer(vertexBuffers[i], vertexBufferAllocations[i]);
 		}
+		vertexBuffers.clear();
+		vertexBufferAllocations.clear();
 
-		// ---------------------------------------------------
-		// CREATE GRAPHICS PIPELINE.
-		// ---------------------------------------------------
+		gpuAllocator.DestroyBuffer(indexBuffer, indexBufferAllocation);
+		indexBuffer = VK_NULL_HANDLE;
+	}
 
-		// Shader stages.
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-		// Fixed-function.
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssembly;
-		pipelineInfo.pViewportState = &viewportState;
-		pipelineInfo.pRasterizationState = &rasterizer;
-		pipelineInfo.pMultisampleState = &multisampling;
-		pipelineInfo.pDepthStencilState = nullptr; // Optional
-		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = nullptr; // Optional
-		// Pipeline layout.
-		pipelineInfo.layout = pipelineLayout;
-		// Render pass.
-		pipelineInfo.renderPass = renderPass;
-		pipelineInfo.subpass = 0; // index
-		// Vulkan allows to create a new graphics pipeline by deriving from an existing pipeline. The idea of pipeline 
-		// derivatives is that it is less expensive to set up pipelines when they have much functionality in common 
-		// with an existing pipeline and switching between pipelines from the same parent can also be done quicker.
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-		pipelineInfo.basePipelineIndex = -1; // Optional
-
-		// Designed to take multiple VkGraphicsPipelineCreateInfo objects and create multiple VkPipeline objects in a single call.
-		if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create graphics pipeline");
+
+	void CreateVertexAnimation()
+	{
+		// The compute pass writes the first vertex stream of every frame slot into a buffer of its own, which the
+		// frame then draws from instead of the uploaded one. A slot's buffer is only rewritten once the frame
+		// that drew from it has completed, so compute and rendering never touch the same buffer at the same time.
+		QueueFamilyIndices indices = FindQueueFamilies(physicalDevice);
+		uint32_t graphicsFamily = indices.graphicsFamily.value();
+
+		if (options.computeMode == ComputeMode::Async && computeQueueHandle != VK_NULL_HANDLE) {
+			computeQueue.Init(logicalDevice, computeQueueHandle, indices.computeFamily.value(), graphicsFamily, FramePacer::MAX_FRAMES_IN_FLIGHT);
+		}
+		else {
+			if (options.computeMode == ComputeMode::Async) {
+				PrintMessage("No compute queue family without graphics, the compute pass runs on the graphics queue");
+			}
+			computeQueue.Init(logicalDevice, graphicsQueue, graphicsFamily, graphicsFamily, FramePacer::MAX_FRAMES_IN_FLIGHT);
+		}
+
+		computeShader = LoadComputeShader();
+		computePipeline.Init(logicalDevice, pipelineCache.Get(), computeShader.module, 1, sizeof(VertexAnimationConstants),
+			FramePacer::MAX_FRAMES_IN_FLIGHT);
+
+		// Written on one family and read on the other. Concurrent sharing spares the ownership transfer barriers
+		// on both queues every frame, the buffers are small enough for it not to matter.
+		uint32_t queueFamilies[] = { graphicsFamily, computeQueue.GetQueueFamily() };
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = static_cast<VkDeviceSize>(options.trianglesPerDraw) * 3 * GetVertexInputDescription(options.vertexStreamLayout).bindings[0].stride;
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		if (computeQueue.IsAsync()) {
+			bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			bufferInfo.queueFamilyIndexCount = 2;
+			bufferInfo.pQueueFamilyIndices = queueFamilies;
 		}
 		else {
-			PrintMessage("Graphics pipeline created successfully");
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		}
 
+		animatedVertexBuffers.resize(FramePacer::MAX_FRAMES_IN_FLIGHT);
+		animatedVertexAllocations.resize(FramePacer::MAX_FRAMES_IN_FLIGHT);
+		animationDescriptorSets.resize(FramePacer::MAX_FRAMES_IN_FLIGHT);
+
+		for (uint32_t i = 0; i < FramePacer::MAX_FRAMES_IN_FLIGHT; ++i) {
+			animatedVertexBuffers[i] = gpuAllocator.CreateBuffer(bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, animatedVertexAllocations[i]);
+
+			VkDescriptorBufferInfo descriptorInfo{};
+			descriptorInfo.buffer = animatedVertexBuffers[i];
+			descriptorInfo.offset = 0;
+			descriptorInfo.range = VK_WHOLE_SIZE;
+			animationDescriptorSets[i] = computePipeline.CreateDescriptorSet({ descriptorInfo });
+		}
 
-		vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
-		vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
+		PrintMessage(std::string("Compute pass on the ") + (computeQueue.IsAsync() ? "async compute" : "graphics") + " queue");
 	}
 
 
-	VkShaderModule CreateShaderModule(const std::vector<char>& shaderCode)
+	void DestroyVertexAnimation()
 	{
-		VkShaderModuleCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = shaderCode.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+		computeQueue.Destroy();
+		computePipeline.Destroy();
 
-		VkShaderModule shaderModule;
-		if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create shader module");
+		for (size_t i = 0; i < animatedVertexBuffers.size(); ++i) {
+			gpuAllocator.DestroyBuffer(animatedVertexBuffers[i], animatedVertexAllocations[i]);
 		}
+		animatedVertexBuffers.clear();
+		animatedVertexAllocations.clear();
+		animationDescriptorSets.clear();
 
-		return shaderModule;
+		shaderRegistry.Release(computeShader.codeHash);
+		computeShader = {};
 	}
 
 
-	void CreateFramebuffers()
+	ShaderModule LoadComputeShader()
 	{
-		swapchainFramebuffers.resize(swapchainImageViews.size());
+		if (options.precompiledShaders) {
+			return shaderRegistry.Acquire("shaders/animate.spv");
+		}
 
-		for (size_t i = 0; i < swapchainImageViews.size(); i++) {
-			VkImageView attachments[] = {
-				swapchainImageViews[i]
-			};
+		std::string path = shaderCompiler.Compile("shaders/animate.comp", VK_SHADER_STAGE_COMPUTE_BIT);
+		return shaderRegistry.Acquire(path);
+	}
 
-			VkFramebufferCreateInfo framebufferInfo{};
-			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebufferInfo.renderPass = renderPass;
-			framebufferInfo.attachmentCount = 1;
-			framebufferInfo.pAttachments = attachments;
-			framebufferInfo.width = swapchainExtent.width;
-			framebufferInfo.height = swapchainExtent.height;
-			framebufferInfo.layers = 1;
 
-			if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &swapchainFramebuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to create framebuffer");
-			}
-		}
+	// Records and submits the compute pass of the current frame slot. Returns the timeline point the frame's
+	// rendering has to wait for.
+	TimelinePoint SubmitVertexAnimation()
+	{
+		uint32_t slot = framePacer.GetCurrentFrame();
+		VkCommandBuffer commandBuffer = computeQueue.BeginFrame(slot);
+
+		VertexAnimationConstants constants;
+		constants.triangleCount = options.trianglesPerDraw;
+		GetTriangleGridSize(options.trianglesPerDraw, constants.columns, constants.rows);
+		constants.vertexStride = GetVertexInputDescription(options.vertexStreamLayout).bindings[0].stride / static_cast<uint32_t>(sizeof(float));
+		// Split streams keep the colors in the uploaded buffer of binding 1.
+		constants.writeColors = options.vertexStreamLayout == VertexStreamLayout::Interleaved ? 1 : 0;
+		// Wrapped to one turn, a float angle would lose precision after a few hours.
+		constants.angle = static_cast<float>(std::fmod(animationFrame * static_cast<double>(VERTEX_ANIMATION_RADIANS_PER_FRAME), 2.0 * 3.14159265358979));
+		++animationFrame;
+
+		computePipeline.CmdDispatch(commandBuffer, animationDescriptorSets[slot], &constants, options.trianglesPerDraw,
+			VERTEX_ANIMATION_LOCAL_SIZE);
+
+		return computeQueue.Submit(commandBuffer);
 	}
 
 
-	void CreateCommandPool()
+	void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 	{
-		// Command buffers are executed by submitting them on one of the device queues, like the graphics and 
-		// presentation queues we retrieved. Each command pool can only allocate command buffers that are submitted 
-		// on a single type of queue. We are going to record commands for drawing => choose graphics queue family.
+		// Timestamps around the whole frame give the GPU busy time. The pacer reads them per image.
+		framePacer.CmdBeginTiming(commandBuffer, imageIndex);
 
-		QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(physicalDevice);
+		// Named GPU scopes for the profiler, per pass.
+		gpuProfiler.CmdBeginFrame(commandBuffer);
+		uint32_t frameScope = gpuProfiler.CmdBeginScope(commandBuffer, "frame");
+		uint32_t renderGraphScope = gpuProfiler.CmdBeginScope(commandBuffer, "render graph");
 
-		VkCommandPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		// 1. VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: hint that command buffers are rerecorded with new commands 
-		//    very often (may change memory allocation behavior).
-		// 2. VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: allow command buffers to be rerecorded individually, 
-		//    without this flag they all have to be reset together.
-		poolInfo.flags = 0; // Optional
+		// The passes of the graph record the draws and, in headless mode, the readback copy, with the render passes
+		// and barriers the graph derived around them.
+		recordingImageIndex = imageIndex;
+		renderGraph.BindImage(backbuffer, swapchainImages[imageIndex], swapchainImageViews[imageIndex]);
+		renderGraph.Execute(commandBuffer);
+
+		gpuProfiler.CmdEndScope(commandBuffer, renderGraphScope);
 
-		if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create command pool!");
+		gpuProfiler.CmdEndScope(commandBuffer, frameScope);
+		framePacer.CmdEndTiming(commandBuffer, imageIndex);
+
+		// Finished recording the command buffer.
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record command buffer");
 		}
 	}
 
 
-	void CreateCommandBuffers()
+	void RecordDraws(VkCommandBuffer commandBuffer, uint32_t drawCount)
 	{
-		commandBuffers.resize(swapchainFramebuffers.size());
+		// Until a pipeline is compiled the library hands out its placeholder. Without one there is nothing to draw with.
+		VkPipeline pipeline = pipelineLibrary.Get(graphicsPipelineId);
+		if (pipeline == VK_NULL_HANDLE) {
+			return;
+		}
+
+		// The second parameter specifies if the pipeline object is a graphics or compute pipeline.
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
-		// Allocated command buffers can be primary or secondary.
-		// 1. VK_COMMAND_BUFFER_LEVEL_PRIMARY: can be submitted to a queue for execution, but cannot be called 
-		// from other command buffers.
-		// 2. VK_COMMAND_BUFFER_LEVEL_SECONDARY: cannot be submitted directly, but can be called from primary command buffers.
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+		// Dynamic state is not inherited by secondary command buffers, so it is set wherever draws are recorded.
+		CmdSetDynamicState(commandBuffer, dynamicPipelineState);
+		// Neither are push constants.
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &viewProjection);
+
+		// One vertex buffer per binding, starting at binding 0. The compute pass replaces the first one with the
+		// buffer it animated for this frame slot.
+		std::vector<VkBuffer> boundVertexBuffers = vertexBuffers;
+		if (options.computeMode != ComputeMode::Off) {
+			boundVertexBuffers[0] = animatedVertexBuffers[framePacer.GetCurrentFrame()];
+		}
+		std::vector<VkDeviceSize> offsets(boundVertexBuffers.size(), 0);
+		vkCmdBindVertexBuffers(commandBuffer, 0, static_cast<uint32_t>(boundVertexBuffers.size()), boundVertexBuffers.data(), offsets.data());
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, options.indexType);
 
-		if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to allocate command buffers");
+		for (uint32_t i = 0; i < drawCount; ++i) {
+			// Index count, instance count, firstIndex offset, vertexOffset added to the indices, firstInstance offset.
+			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
 		}
+	}
 
-		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0; // Optional
-			// Relevant for secondary command buffers. It specifies which state to inherit from the 
-			// calling primary command buffers.
-			beginInfo.pInheritanceInfo = nullptr; // Optional
 
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to begin recording command buffer");
+	void ExecuteDrawsInParallel(VkCommandBuffer commandBuffer, const RenderGraphPassContext& context)
+	{
+		// Secondary command buffers inherit the render pass instance from the primary and nothing else,
+		// so every one of them binds the pipeline again.
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = context.renderPass;
+		inheritanceInfo.subpass = context.subpass;
+		// Optional, but knowing the framebuffer may let the driver record more efficient commands.
+		inheritanceInfo.framebuffer = context.framebuffer;
+
+		// One contiguous range of draws per worker. Splitting finer would only add secondaries to execute.
+		uint32_t jobCount = std::min(options.drawCount, jobSystem.GetWorkerCount());
+		uint32_t frameSlot = framePacer.GetCurrentFrame();
+		std::vector<VkCommandBuffer> secondaries(jobCount);
+
+		jobSystem.Dispatch(jobCount, [&](uint32_t jobIndex, uint32_t workerIndex) {
+			CpuProfileScope scope(gpuProfiler, "record draws");
+
+			uint32_t firstDraw = static_cast<uint32_t>(uint64_t(options.drawCount) * jobIndex / jobCount);
+			uint32_t endDraw = static_cast<uint32_t>(uint64_t(options.drawCount) * (jobIndex + 1) / jobCount);
+
+			VkCommandBuffer secondary = frameCommandPools.BeginSecondary(frameSlot, workerIndex, inheritanceInfo);
+			RecordDraws(secondary, endDraw - firstDraw);
+
+			if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to record secondary command buffer");
 			}
 
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass;
-			renderPassInfo.framebuffer = swapchainFramebuffers[i];
-			// Size of the render area. The render area defines where shader loads and stores will take place.
-			// The pixels outside this region will have undefined values.
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = swapchainExtent;
-
-			// Define the clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR.
-			VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-			renderPassInfo.clearValueCount = 1;
-			renderPassInfo.pClearValues = &clearColor;
-
-			// The third parameter controls how the drawing commands within the render pass will be provided.
-			// 1. VK_SUBPASS_CONTENTS_INLINE: the render pass commands will be embedded in the primary command buffer 
-			//    itself and no secondary command buffers will be executed.
-			// 2. VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: the render pass commands will be executed from secondary 
-			//    command buffers.
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			// The second parameter specifies if the pipeline object is a graphics or compute pipeline.
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-			// Vertex count, instance count, firstVertex offset, firstInstance offset.
-			vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
-
-			vkCmdEndRenderPass(commandBuffers[i]);
-
-			// Finished recording the command buffer.
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("Failed to record command buffer");
-			}
-		}
+			// Indexed by job, so the draws are executed in the same order as they would be inline.
+			secondaries[jobIndex] = secondary;
+		});
+
+		vkCmdExecuteCommands(commandBuffer, jobCount, secondaries.data());
 	}
 
 
@@ -803,7 +2057,7 @@ private:
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = VK_API_VERSION_1_2;
 
 
 		// Specify app info, global extensions and validation layers we want to use.
@@ -841,7 +2095,8 @@ private:
 			PrintMessage("All GLFW extensions are supported by Vulkan");
 		}
 
-		if (!CheckVulkanValidationLayerSupport()) {
+		// Build machines often have no layers installed at all, so only check when the layers are actually requested.
+		if (VALIDATION_LAYERS_ENABLED && !CheckVulkanValidationLayerSupport()) {
 			throw std::runtime_error("Some validation layers are not available to Vulkan");
 		}
 		else {
@@ -856,7 +2111,8 @@ private:
 
 	void SelectPhysicalDevice()
 	{
-		// Find GPUs with Vulkan support and then initialize physicalDevice.
+		// Find GPUs with Vulkan support, rank them and initialize physicalDevice with the best suitable one.
+		// Machines with several GPUs often list an integrated GPU or a CPU implementation first.
 		uint32_t deviceCount = 0;
 		vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
 
@@ -867,18 +2123,27 @@ private:
 		std::vector<VkPhysicalDevice> deviceList(deviceCount);
 		vkEnumeratePhysicalDevices(instance, &deviceCount, deviceList.data());
 
-		for (const auto& device : deviceList) {
-			if (CheckPhysicalDeviceRequirements(device)) {
-				physicalDevice = device;
-				break;
+		std::vector<DeviceCandidate> candidates;
+		for (uint32_t i = 0; i < deviceCount; ++i) {
+			DeviceCandidate candidate = DescribePhysicalDevice(deviceList[i], i);
+			candidate.rejectReason = GetPhysicalDeviceRejectReason(candidate.device);
+			if (candidate.IsSuitable()) {
+				ScorePhysicalDevice(candidate);
+				ScorePhysicalDevicePresentation(candidate);
 			}
+			candidates.push_back(candidate);
 		}
 
-		if (physicalDevice == VK_NULL_HANDLE) {
-			throw std::runtime_error("Failed to find a suitable Physical Device");
-		}
+		RankDeviceCandidates(candidates);
+		size_t selectedIndex = PickDeviceCandidate(candidates, options.deviceOverride);
 
+		std::cout << std::endl;
+		WriteDeviceRanking(std::cout, candidates, selectedIndex);
 
+		physicalDevice = candidates[selectedIndex].device;
+		physicalDeviceUuid = candidates[selectedIndex].uuid;
+
+		PrintMessage("Physical Device selected: " + candidates[selectedIndex].name);
 	}
 
 
@@ -899,7 +2164,7 @@ private:
 		for (int i = 0; i < static_cast<uint32_t>(extList.size()); ++i) {
 			bool found = false;
 			for (const auto& vulkanExt : vulkanExtList) {
-				if (strcmp(vulkanExt.extensionName, extList[i])) {
+				if (strcmp(vulkanExt.extensionName, extList[i]) == 0) {
 					found = true;
 					break;
 				}
@@ -925,7 +2190,7 @@ private:
 		for (const char* layerName : VALIDATION_LAYERS_LIST) {
 			bool found = false;
 			for (const auto& vulkanLayerName : vulkanLayerList) {
-				if (strcmp(vulkanLayerName.layerName, layerName)) {
+				if (strcmp(vulkanLayerName.layerName, layerName) == 0) {
 					found = true;
 					break;
 				}
@@ -1001,7 +2266,7 @@ private:
 	}
 
 
-	VkPresentModeKHR SelectSwapchainPresentationMode(const std::vector<VkPresentModeKHR>& availablePresentationModes) {
+	VkPresentModeKHR SelectSwapchainPresentationMode(const std::vector<VkPresentModeKHR>& availablePresentationModes, VkPresentModeKHR policyMode) {
 		// Presentation mode represents the actual conditions for showing images to the screen. There are four modes in Vulkan:
 		// 1. VK_PRESENT_MODE_IMMEDIATE_KHR: images submitted by application are transferred to the screen immediately.
 		//    Not wait for vsync. This mode may result in visible screen tearing.
@@ -1022,13 +2287,19 @@ private:
 		//    the framerate is unlocked.
 
 		// FIFO_KHR is guaranteed to be available.
-		// Looking for the preferred mode.
-		for (const auto& availablePresentationMode : availablePresentationModes) {
-			if (availablePresentationMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-				return availablePresentationMode;
+		// A mode from the command line comes first, otherwise the one of the present policy.
+		if (options.presentMode.has_value()) {
+			for (const auto& availablePresentationMode : availablePresentationModes) {
+				if (availablePresentationMode == options.presentMode.value()) {
+					return availablePresentationMode;
+				}
 			}
+
+			PrintMessage(std::string("Present mode ") + GetPresentModeName(options.presentMode.value()) + " is not supported, using " +
+				GetPresentModeName(policyMode));
 		}
-		return VK_PRESENT_MODE_FIFO_KHR;
+
+		return policyMode;
 	}
 
 
@@ -1064,19 +2335,17 @@ private:
 		// For each find an optimal value.
 		SwapchainSupportDetails details = QuerySwapchainSupportDetails(physicalDevice);
 
+		// Present mode, image count and frames in flight follow from the present policy.
+		presentConfig = SelectPresentConfig(presentPolicy, details.surfCapabilities, details.presentationModes);
+
 		VkSurfaceFormatKHR format = SelectSwapchainSurfaceFormat(details.surfFormats);
-		VkPresentModeKHR presentationMode = SelectSwapchainPresentationMode(details.presentationModes);
+		VkPresentModeKHR presentationMode = SelectSwapchainPresentationMode(details.presentationModes, presentConfig.presentMode);
+		swapchainPresentMode = presentationMode;
 		VkExtent2D extent = SelectSwapchainExtent(details.surfCapabilities);
 
-		// How many images are in swapchain. Required minimum number for device is in minImageCount.
-		// Sticking to this minimum means that we may sometimes have to wait on the driver to complete internal operations,
-		// before we can acquire another image to render to. So it is recommended to request at least one more image than the minimum.
-		uint32_t imageCount = details.surfCapabilities.minImageCount + 1;
-
-		// Ensure that we do not exceed the maximum. If maxImageCount == 0, then there is no maximum.
-		if (details.surfCapabilities.maxImageCount > 0 && imageCount > details.surfCapabilities.maxImageCount) {
-			imageCount = details.surfCapabilities.maxImageCount;
-		}
+		// How many images are in swapchain. Required minimum number for device is in minImageCount, the policy asks
+		// for more when images should queue up, and never for more than maxImageCount.
+		uint32_t imageCount = presentConfig.imageCount;
 
 		VkSwapchainCreateInfoKHR createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -1131,19 +2400,29 @@ private:
 		createInfo.clipped = VK_TRUE;
 
 		// It is possible that swapchain becomes invalid or unoptimized while application is running.
-		// Example: window was resized. In that case the swapchain needs to be recreated from scratch and a reference 
-		// to the old one must be specified in this field. NULL_HANDLE for now. 
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+		// Example: window was resized. In that case the swapchain needs to be recreated and a reference 
+		// to the old one is specified in this field, so the driver can reuse its resources.
+		// The old swapchain is retired by this call and only destroyed afterwards. VK_NULL_HANDLE on the first call.
+		VkSwapchainKHR oldSwapchain = swapchain;
+		createInfo.oldSwapchain = oldSwapchain;
 
 		if (vkCreateSwapchainKHR(logicalDevice, &createInfo, nullptr, &swapchain) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create swapchain");
 		}
-		else {
+		else if (oldSwapchain == VK_NULL_HANDLE) {
 			PrintMessage("Swapchain created successfully");
 		}
 
+		if (oldSwapchain != VK_NULL_HANDLE) {
+			presentLatency.OnSwapchainDestroyed();
+			vkDestroySwapchainKHR(logicalDevice, oldSwapchain, nullptr);
+		}
+
 		swapchainImageFormat = format.format;
 		swapchainExtent = extent;
+		// Following the extent is all a resize takes from the pipeline side.
+		dynamicPipelineState = MakeDynamicPipelineState(swapchainExtent);
+		UpdateViewProjection();
 
 		// Retrieve handles for images.
 		vkGetSwapchainImagesKHR(logicalDevice, swapchain, &imageCount, nullptr);
@@ -1183,48 +2462,279 @@ private:
 	}
 
 
+	void CreateAllocator()
+	{
+		// Every buffer and image gets its memory from here instead of its own vkAllocateMemory.
+		gpuAllocator.Init(physicalDevice, logicalDevice);
+	}
+
+
+	void CreateUploadEngine()
+	{
+		// Uploads go through the dedicated transfer queue if the device has one, otherwise through the graphics queue.
+		QueueFamilyIndices indices = FindQueueFamilies(physicalDevice);
+
+		if (indices.transferFamily.has_value()) {
+			uploadEngine.Init(logicalDevice, gpuAllocator, transferQueue, indices.transferFamily.value(), indices.graphicsFamily.value());
+		}
+		else {
+			uploadEngine.Init(logicalDevice, gpuAllocator, graphicsQueue, indices.graphicsFamily.value(), indices.graphicsFamily.value());
+		}
+	}
+
+
+	void ReportMemoryStatistics()
+	{
+		GpuAllocatorStats stats = gpuAllocator.GetStats();
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "GPU memory: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks"
+			<< " | used: " << stats.usedBytes / (1024.0 * 1024.0) << " MiB"
+			<< " | reserved: " << stats.reservedBytes / (1024.0 * 1024.0) << " MiB"
+			<< " | blocks: " << stats.blockBytes / (1024.0 * 1024.0) << " MiB"
+			<< " | fragmentation: " << stats.fragmentation * 100.0 << " %" << std::endl;
+
+		std::cout << "Uploads: " << uploadEngine.GetUploadedBytes() / 1024.0 << " KiB in " << uploadEngine.GetBatchCount() << " batches"
+			<< " | queue: " << (uploadEngine.IsDedicatedTransferQueue() ? "dedicated transfer" : "graphics") << std::endl;
+
+		if (options.computeMode != ComputeMode::Off) {
+			std::cout << "Compute: " << animatedVertexBuffers.size() << " animated vertex buffers"
+				<< " | queue: " << (computeQueue.IsAsync() ? "async compute" : "graphics") << std::endl;
+		}
+	}
+
+
+	void CreateOffscreenTargets()
+	{
+		// Headless mode renders into images owned by the application instead of swapchain images.
+		// There is one target per frame in flight, so every frame renders and reads back independently.
+		// The SRGB format gives the same bytes the window would show.
+		swapchainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+		swapchainExtent = { WIDTH, HEIGHT };
+		dynamicPipelineState = MakeDynamicPipelineState(swapchainExtent);
+		UpdateViewProjection();
+
+		uint32_t imageCount = std::clamp(GetInitialFramesInFlight(), FramePacer::MIN_FRAMES_IN_FLIGHT, FramePacer::MAX_FRAMES_IN_FLIGHT);
+		swapchainImages.resize(imageCount);
+		offscreenImageAllocations.resize(imageCount);
+
+		for (uint32_t i = 0; i < imageCount; ++i) {
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = swapchainImageFormat;
+			imageInfo.extent = { swapchainExtent.width, swapchainExtent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			// Optimal tiling is the fastest layout to render into. It is not readable by the host,
+			// that's why the frame is copied into a linear buffer afterwards.
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			swapchainImages[i] = gpuAllocator.CreateImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, offscreenImageAllocations[i]);
+		}
+
+		PrintMessage("Offscreen targets created successfully");
+	}
+
+
+	void DestroyOffscreenTargets()
+	{
+		for (size_t i = 0; i < offscreenImageAllocations.size(); ++i) {
+			gpuAllocator.DestroyImage(swapchainImages[i], offscreenImageAllocations[i]);
+		}
+
+		offscreenImageAllocations.clear();
+	}
+
+
+	void CreateReadbackBuffers()
+	{
+		// Tightly packed RGBA8, the layout vkCmdCopyImageToBuffer writes with bufferRowLength = 0.
+		readbackSize = VkDeviceSize(swapchainExtent.width) * swapchainExtent.height * 4;
+
+		size_t count = swapchainImages.size();
+		readbackBuffers.resize(count);
+		readbackAllocations.resize(count);
+		readbackPending.assign(count, false);
+		lastReadbackFrame.resize(static_cast<size_t>(readbackSize));
+
+		for (size_t i = 0; i < count; ++i) {
+			VkBufferCreateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			bufferInfo.size = readbackSize;
+			bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			// Coherent memory needs no invalidate before reading. Cached memory makes CPU reads much faster.
+			// Host visible blocks are persistently mapped by the allocator.
+			readbackBuffers[i] = gpuAllocator.CreateBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VK_MEMORY_PROPERTY_HOST_CACHED_BIT, readbackAllocations[i]);
+		}
+	}
+
+
+	void DestroyReadbackBuffers()
+	{
+		for (size_t i = 0; i < readbackBuffers.size(); ++i) {
+			gpuAllocator.DestroyBuffer(readbackBuffers[i], readbackAllocations[i]);
+		}
+
+		readbackBuffers.clear();
+		readbackAllocations.clear();
+	}
+
+
+	void RecordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		// The render pass has already moved the image into the layout for copying, its outgoing dependency
+		// makes the copy wait for the color writes.
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		// Zero means tightly packed.
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { swapchainExtent.width, swapchainExtent.height, 1 };
+
+		vkCmdCopyImageToBuffer(commandBuffer, swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			readbackBuffers[imageIndex], 1, &region);
+
+		// Make the copied data available to host reads once the frame's timeline value is reached.
+		VkBufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = readbackBuffers[imageIndex];
+		bufferBarrier.offset = 0;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			0, nullptr, 1, &bufferBarrier, 0, nullptr);
+	}
+
+
+	void ReadbackFrame(uint32_t imageIndex)
+	{
+		// Only called after the frame that filled this buffer has reached its timeline value.
+		if (!readbackPending[imageIndex]) {
+			return;
+		}
+		readbackPending[imageIndex] = false;
+
+		std::memcpy(lastReadbackFrame.data(), readbackAllocations[imageIndex].mapped, lastReadbackFrame.size());
+		++readbackFrameCount;
+	}
+
+
+	void WriteCapture(const std::string& path)
+	{
+		if (readbackFrameCount == 0) {
+			throw std::runtime_error("No frame was read back, nothing to capture");
+		}
+
+		// Binary PPM: a tiny header and RGB bytes. Readable by most image viewers and trivial to diff in tests.
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open " + path + " for writing");
+		}
+
+		file << "P6\n" << swapchainExtent.width << " " << swapchainExtent.height << "\n255\n";
+
+		for (size_t i = 0; i < lastReadbackFrame.size(); i += 4) {
+			file.write(reinterpret_cast<const char*>(&lastReadbackFrame[i]), 3);
+		}
+
+		PrintMessage("Captured frame written to " + path);
+	}
+
+
 	struct QueueFamilyIndices
 	{
+
 		// std::optional is a wrapper that contains no value until assign something to it.
 		// To check if there is a value, use the method has_value().
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
 
-		bool IsValid() { return graphicsFamily.has_value() && presentFamily.has_value(); }
+		// Dedicated transfer family. Without it uploads go through the graphics queue.
+		std::optional<uint32_t> transferFamily;
+
+		// Compute family without graphics, for async compute. Without it compute work goes through the graphics queue.
+		std::optional<uint32_t> computeFamily;
+
+		// Headless mode doesn't present, so it doesn't need a present family.
+		bool IsValid(bool needsPresent = true) { return graphicsFamily.has_value() && (presentFamily.has_value() || !needsPresent); }
 	};
 
 
-	bool CheckPhysicalDeviceRequirements(const VkPhysicalDevice& device)
+	// Empty if the device can run the application, otherwise why it can't.
+	std::string GetPhysicalDeviceRejectReason(const VkPhysicalDevice& device)
 	{
 		// Name, type, supported Vulkan version.
 		VkPhysicalDeviceProperties deviceProperties;
 		vkGetPhysicalDeviceProperties(device, &deviceProperties);
 
-		// Whether GPU support texture compression, 64 bit floats, multiview rendering.
-		VkPhysicalDeviceFeatures deviceFeatures;
-		vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
 		QueueFamilyIndices indices = FindQueueFamilies(device);
+		if (!indices.IsValid(!options.headless)) {
+			return options.headless ? "no graphics queue" : "no graphics queue or no queue presenting to the window";
+		}
 
-		VkBool32 isRequiredExtensionsSupported = CheckPhysicalDeviceRequiredExtensionSupport(device);
+		if (!CheckPhysicalDeviceRequiredExtensionSupport(device)) {
+			return "missing required extensions";
+		}
 
-		VkBool32 isSwapchainValid = false;
-		// If swapchain is available at all.
-		if (isRequiredExtensionsSupported) {
+		// Headless mode renders without a swapchain.
+		if (!options.headless) {
 			SwapchainSupportDetails details = QuerySwapchainSupportDetails(device);
 			// It is enough if there is support for at least one format and one presentation mode.
-			isSwapchainValid = !details.surfFormats.empty() && !details.presentationModes.empty();
+			if (details.surfFormats.empty() || details.presentationModes.empty()) {
+				return "no surface format or present mode for the window";
+			}
+		}
+
+		// Timeline semaphores are core since Vulkan 1.2, but still optional for some older drivers.
+		if (deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+			return "Vulkan 1.2 not supported";
+		}
+
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &vulkan12Features;
+		vkGetPhysicalDeviceFeatures2(device, &features2);
+
+		if (!vulkan12Features.timelineSemaphore) {
+			return "no timeline semaphores";
 		}
 
-		VkBool32 isSuitable = indices.IsValid() && isRequiredExtensionsSupported && isSwapchainValid;
+		return {};
+	}
+
 
-		if (isSuitable) {
-			std::string str = "Physical Device selected: ";
-			str += deviceProperties.deviceName;
-			PrintMessage(str);
+	// Score terms that depend on the window surface. Nothing to add in headless mode.
+	void ScorePhysicalDevicePresentation(DeviceCandidate& candidate)
+	{
+		if (options.headless) {
+			return;
 		}
 
-		return isSuitable;
+		// The GPU driving the display presents from its graphics queue. Another GPU has to copy every frame over to it.
+		QueueFamilyIndices indices = FindQueueFamilies(candidate.device);
+		candidate.AddScore("graphics queue presents", indices.graphicsFamily == indices.presentFamily ? 250 : 0);
+
+		candidate.AddScore("present wait", IsPresentWaitSupported(candidate.device) ? 200 : 0);
 	}
 
 
@@ -1232,20 +2742,53 @@ private:
 	{
 		QueueFamilyIndices indices = FindQueueFamilies(physicalDevice);
 
-		// We know queue families that GPU support. Create queue families with one queue in each.
+		// We know queue families that GPU support. Create one queue per role (graphics, present, transfer, compute).
+		// Graphics and present share a queue when they share a family. Transfer and compute may share a family too,
+		// then each gets a queue of its own if the family has enough, otherwise they share one.
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+		std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyList.data());
+
+		std::vector<uint32_t> queueCounts(queueFamilyCount, 0);
+		auto addQueue = [&](uint32_t family) {
+			uint32_t queueIndex = std::min(queueCounts[family], queueFamilyList[family].queueCount - 1);
+			queueCounts[family] = queueIndex + 1;
+			return queueIndex;
+		};
+
+		addQueue(indices.graphicsFamily.value());
+		uint32_t presentQueueIndex = 0;
+		if (indices.presentFamily.has_value() && indices.presentFamily != indices.graphicsFamily) {
+			presentQueueIndex = addQueue(indices.presentFamily.value());
+		}
+		uint32_t transferQueueIndex = 0;
+		if (indices.transferFamily.has_value()) {
+			transferQueueIndex = addQueue(indices.transferFamily.value());
+		}
+		// Only asked for when it's used, an idle queue may still cost the driver a hardware queue slot.
+		bool isComputeQueueUsed = options.computeMode == ComputeMode::Async && indices.computeFamily.has_value();
+		uint32_t computeQueueIndex = 0;
+		if (isComputeQueueUsed) {
+			computeQueueIndex = addQueue(indices.computeFamily.value());
+		}
+
+		// Vulkan lets you assign priorities to queues to influence the scheduling of command buffer execution 
+		// using floating point numbers between 0.0 and 1.0. This is required even if there is only a single queue.
+		std::vector<float> queuePriorities(*std::max_element(queueCounts.begin(), queueCounts.end()), 1.0f);
+
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfoList{};
-		std::set<uint32_t> uniqueQueueFamilyIndices{ indices.graphicsFamily.value(), indices.presentFamily.value() };
+		for (uint32_t family = 0; family < queueFamilyCount; ++family) {
+			if (queueCounts[family] == 0) {
+				continue;
+			}
 
-		float queuePriority = 1.0f;
-		for (const auto& queueFamilyIndex : uniqueQueueFamilyIndices) {
 			VkDeviceQueueCreateInfo queueCreateInfo{};
 			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-			queueCreateInfo.queueCount = 1;
-
-			// Vulkan lets you assign priorities to queues to influence the scheduling of command buffer execution 
-			// using floating point numbers between 0.0 and 1.0. This is required even if there is only a single queue.
-			queueCreateInfo.pQueuePriorities = &queuePriority;
+			queueCreateInfo.queueFamilyIndex = family;
+			queueCreateInfo.queueCount = queueCounts[family];
+			queueCreateInfo.pQueuePriorities = queuePriorities.data();
 
 			queueCreateInfoList.push_back(queueCreateInfo);
 		}
@@ -1255,8 +2798,30 @@ private:
 		// Assign to VK_FALSE by default for a while.
 		VkPhysicalDeviceFeatures deviceFeatures{};
 
+		// Vulkan 1.2 features are enabled through the pNext chain.
+		// Timeline semaphores synchronize uploads on the transfer queue with rendering.
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.timelineSemaphore = VK_TRUE;
+
+		// Present ids and waiting for them tell when a frame was actually presented, for the input to present latency.
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		presentWaitFeatures.presentWait = VK_TRUE;
+
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		presentIdFeatures.presentId = VK_TRUE;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+
+		isPresentWaitEnabled = !options.headless && IsPresentWaitSupported(physicalDevice);
+		if (isPresentWaitEnabled) {
+			vulkan12Features.pNext = &presentIdFeatures;
+		}
+
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = &vulkan12Features;
 		createInfo.pQueueCreateInfos = queueCreateInfoList.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfoList.size());
 		createInfo.pEnabledFeatures = &deviceFeatures;
@@ -1266,8 +2831,20 @@ private:
 		// For example VK_KHR_swapchain is a device specific extension.
 		// Previous implementations of Vulkan made a distinction between instance and device specific validation layers, 
 		// but this is no longer the case. Set them to be compatible with older implementations.
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(REQUIRED_PHYSICAL_DEVICE_EXTENSIONS.size());
-		createInfo.ppEnabledExtensionNames = REQUIRED_PHYSICAL_DEVICE_EXTENSIONS.data();
+		std::vector<const char*> deviceExtList = GetRequiredDeviceExtensions();
+
+		// Optional extensions are enabled when the device has them.
+		isCalibratedTimestampsEnabled = IsDeviceExtensionSupported(physicalDevice, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+		if (isCalibratedTimestampsEnabled) {
+			deviceExtList.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+		}
+		if (isPresentWaitEnabled) {
+			deviceExtList.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			deviceExtList.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		}
+
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtList.size());
+		createInfo.ppEnabledExtensionNames = deviceExtList.data();
 		if (VALIDATION_LAYERS_ENABLED) {
 			createInfo.enabledLayerCount = static_cast<uint32_t>(VALIDATION_LAYERS_LIST.size());
 			createInfo.ppEnabledLayerNames = VALIDATION_LAYERS_LIST.data();
@@ -1282,7 +2859,15 @@ private:
 
 		// Retrieve queue handle for our queue family. The third parameter is an index of queue in queue family.
 		vkGetDeviceQueue(logicalDevice, indices.graphicsFamily.value(), 0, &graphicsQueue);
-		vkGetDeviceQueue(logicalDevice, indices.presentFamily.value(), 0, &presentQueue);
+		if (indices.presentFamily.has_value()) {
+			vkGetDeviceQueue(logicalDevice, indices.presentFamily.value(), presentQueueIndex, &presentQueue);
+		}
+		if (indices.transferFamily.has_value()) {
+			vkGetDeviceQueue(logicalDevice, indices.transferFamily.value(), transferQueueIndex, &transferQueue);
+		}
+		if (isComputeQueueUsed) {
+			vkGetDeviceQueue(logicalDevice, indices.computeFamily.value(), computeQueueIndex, &computeQueueHandle);
+		}
 	}
 
 
@@ -1308,27 +2893,43 @@ private:
 		// 2. We need ensure that physical device supports Window System Integration (VK_KHR_surface).
 		//    i.e. physical device can present images to the surface we just created.
 		// Points 1 and 2 most likely will be the same queue families.
+		// 3. Optionally a family with VK_QUEUE_TRANSFER_BIT but without graphics. It is usually backed by the copy (DMA)
+		//    engines, which upload data while the graphics queue renders. Families without compute are the purest copy engines.
+		// 4. Optionally a family with VK_QUEUE_COMPUTE_BIT but without graphics, served by the async compute engines.
+		//    Preferably another family than the transfer one, so compute and uploads don't share a queue.
 		// 
-		int i = 0;
+		uint32_t i = 0;
 		for (const auto& queueFamily : queueFamilyList) {
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+			if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value()) {
 				indices.graphicsFamily = i;
 			}
 
 			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+			if (surface != VK_NULL_HANDLE) {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+			}
 
-			if (presentSupport) {
+			if (presentSupport && !indices.presentFamily.has_value()) {
 				indices.presentFamily = i;
 			}
 
-			if (indices.IsValid()) {
-				break;
+			bool isTransferOnly = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			bool isBetterTransfer = !indices.transferFamily.has_value() ||
+				((queueFamilyList[indices.transferFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT));
+			if (isTransferOnly && isBetterTransfer) {
+				indices.transferFamily = i;
 			}
 
 			++i;
 		}
 
+		for (uint32_t j = 0; j < queueFamilyCount; ++j) {
+			bool isComputeOnly = (queueFamilyList[j].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilyList[j].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			if (isComputeOnly && (!indices.computeFamily.has_value() || indices.computeFamily == indices.transferFamily)) {
+				indices.computeFamily = j;
+			}
+		}
+
 		return indices;
 	}
 
@@ -1337,11 +2938,15 @@ private:
 	{
 		// Specify the desired global extensions.
 		// Vulkan is platform agnostic, so for dealing with windows, we need an extension.
-		// Get extensions from GLFW.
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		// Get extensions from GLFW. Headless mode has no window, so no surface extensions are needed.
+		std::vector<const char*> extList;
+
+		if (!options.headless) {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-		std::vector<const char*> extList(glfwExtensions, glfwExtensions + glfwExtensionCount);
+			extList.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (VALIDATION_LAYERS_ENABLED) {
 			extList.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -1351,28 +2956,77 @@ private:
 	}
 
 
+	std::vector<const char*> GetRequiredDeviceExtensions()
+	{
+		// Headless rendering never presents, so it also works on devices (and software ICDs) without swapchain support.
+		if (options.headless) {
+			return {};
+		}
+
+		return REQUIRED_PHYSICAL_DEVICE_EXTENSIONS;
+	}
+
+
 	bool CheckPhysicalDeviceRequiredExtensionSupport(const VkPhysicalDevice& device)
 	{
-		// Check support of extensions from REQUIRED_PHYSICAL_DEVICE_EXTENSIONS list.
+		// Check support of extensions from GetRequiredDeviceExtensions() list.
+		const auto& deviceExtList = GetRequiredDeviceExtensions();
+
 		uint32_t deviceExtensionCount;
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &deviceExtensionCount, nullptr);
 
 		std::vector<VkExtensionProperties> deviceExtensionList(deviceExtensionCount);
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &deviceExtensionCount, deviceExtensionList.data());
 
-		std::set<std::string> requiredExtensionList(REQUIRED_PHYSICAL_DEVICE_EXTENSIONS.begin(), REQUIRED_PHYSICAL_DEVICE_EXTENSIONS.end());
+		std::set<std::string> requiredExtensionList(deviceExtList.begin(), deviceExtList.end());
 
 		for (const auto& deviceExtension : deviceExtensionList) {
 			requiredExtensionList.erase(deviceExtension.extensionName);
 		}
 
-		VkBool32 isSupported = requiredExtensionList.empty();
+		return requiredExtensionList.empty();
+	}
+
+
+	bool IsPresentWaitSupported(VkPhysicalDevice device)
+	{
+		if (!IsDeviceExtensionSupported(device, VK_KHR_PRESENT_ID_EXTENSION_NAME) ||
+			!IsDeviceExtensionSupported(device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+			return false;
+		}
+
+		// The extensions may be there without the features.
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features2);
 
-		if (isSupported) {
-			PrintMessage("All required extensions are supported by Physical Device");
+		return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+	}
+
+
+	bool IsDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+	{
+		uint32_t deviceExtensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &deviceExtensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> deviceExtensionList(deviceExtensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &deviceExtensionCount, deviceExtensionList.data());
+
+		for (const auto& deviceExtension : deviceExtensionList) {
+			if (std::strcmp(deviceExtension.extensionName, extensionName) == 0) {
+				return true;
+			}
 		}
 
-		return isSupported;
+		return false;
 	}
 
 
@@ -1402,7 +3056,8 @@ private:
 	// VkSurfaceKHR and its usage is platform agnostic, but its creation is not and use VK_KHR_win32_surface.
 	// Represents an abstract type of surface to present rendered images to. 
 	// The surface in program will be backed by the window that already opened with GLFW.
-	VkSurfaceKHR surface;
+	// Stays VK_NULL_HANDLE in headless mode.
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 
 	GLFWwindow* window = nullptr;
 
@@ -1417,10 +3072,17 @@ private:
 
 	// Store physical device (GPU). Implicitly destroyed, when VkInstance destroyed.
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	std::array<uint8_t, VK_UUID_SIZE> physicalDeviceUuid{};
 
 	// Store logical device. Application view on actual device.
 	VkDevice logicalDevice;
 
+	// VK_EXT_calibrated_timestamps is optional. With it GPU scopes are placed exactly on the CPU timeline.
+	bool isCalibratedTimestampsEnabled = false;
+
+	// VK_KHR_present_id and VK_KHR_present_wait are optional. With them the input to present latency ends when the frame is presented.
+	bool isPresentWaitEnabled = false;
+
 	// Store handle.
 	// The queues are automatically created along with the logical device and
 	// this handle needs to interface with these queues.
@@ -1428,63 +3090,173 @@ private:
 	VkQueue graphicsQueue;
 
 	// Queue for present image to the window surface.
-	VkQueue presentQueue;
+	VkQueue presentQueue = VK_NULL_HANDLE;
+
+	// Queue of the dedicated transfer family, if the device has one.
+	VkQueue transferQueue = VK_NULL_HANDLE;
+
+	// Only with --compute async on a device with a compute family. computeQueue submits to it.
+	VkQueue computeQueueHandle = VK_NULL_HANDLE;
 
-	VkSwapchainKHR swapchain;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 	VkFormat swapchainImageFormat;
 	VkExtent2D swapchainExtent;
+	VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+	// Changed at runtime with key P. The config is what the policy asked for on the current surface.
+	PresentPolicy presentPolicy = PresentPolicy::Latency;
+	PresentConfig presentConfig;
 
 	// Images created for swapchain by device and automatically cleaned up once the swap chain has been destroyed.
+	// In headless mode these are the offscreen targets, owned by the application.
 	std::vector<VkImage> swapchainImages;
 
+	// Memory of the offscreen targets (headless mode only).
+	std::vector<GpuAllocation> offscreenImageAllocations;
+
+	// Host-visible ring of buffers the offscreen targets are copied into, one per target (headless mode only).
+	// Persistently mapped, the CPU reads a buffer once the frame that filled it has reached its timeline value.
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<GpuAllocation> readbackAllocations;
+	std::vector<bool> readbackPending;
+	VkDeviceSize readbackSize = 0;
+
+	// Copy of the newest frame that was read back, tightly packed RGBA.
+	std::vector<uint8_t> lastReadbackFrame;
+	uint64_t readbackFrameCount = 0;
+
+
 	// Describes how to access the image and which part of the image to access.
 	// Example: if it should be treated as a 2D texture depth texture without any mipmapping levels.
 	std::vector<VkImageView> swapchainImageViews;
 
+	// The frame as passes and the images they use. Owns the render passes, the framebuffers and the transient images.
 	// The image that we have to use for the attachment depends on which image the swapchain returns when we retrieve 
-	// one for presentation. That means that we have to create a framebuffer for all of the images in the swapchain and 
-	// use the one that corresponds to the retrieved image at drawing time.
-	std::vector<VkFramebuffer> swapchainFramebuffers;
+	// one for presentation, so the backbuffer is bound to it at drawing time.
+	RenderGraph renderGraph;
+	RenderGraphImage backbuffer = 0;
+	uint32_t scenePass = 0;
+	// Image index of the command buffer being recorded, for the passes of the graph.
+	uint32_t recordingImageIndex = 0;
+
+	// Render pass of the scene pass, owned by the render graph.
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+
+	// Identifies the compatibility class of renderPass for the pipeline library.
+	uint64_t renderPassHash = 0;
+
+	// Creates, deduplicates and owns all pipelines.
+	PipelineLibrary pipelineLibrary;
+	uint32_t graphicsPipelineId = PipelineLibrary::INVALID_ID;
+
+	// Compiles the GLSL sources and watches them for changes.
+	ShaderCompiler shaderCompiler;
+
+	// Owns the shader modules, shared by all pipelines that use them.
+	ShaderRegistry shaderRegistry;
+	ShaderModule vertShader;
+	ShaderModule fragShader;
+
+	// Specialization constant values of the current pipeline.
+	ShaderPermutation permutation;
+
+	// Viewport, scissor and the other state the pipeline leaves to record time.
+	DynamicPipelineState dynamicPipelineState;
+
+	// Camera transform of the vertex shader, reversed-Z. Follows the aspect ratio of the extent.
+	glm::mat4 viewProjection{ 1.0f };
+
+	// Of the scene's depth buffer, picked from the formats the device supports.
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+	// Of the scene's color and depth attachments. With more than one, the color is resolved into the backbuffer.
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Sub-allocates the memory of all buffers and images from a few large blocks.
+	GpuAllocator gpuAllocator;
 
-	VkRenderPass renderPass;
+	// Copies data into device local resources on the transfer queue.
+	UploadEngine uploadEngine;
+
+	// Compiled pipelines, persisted between launches.
+	PipelineCache pipelineCache;
+
+
+	// Time until the graphics pipeline was ready, for cold/warm cache comparison.
+	double pipelineCreationMs = 0.0;
 
-	VkPipeline graphicsPipeline;
 
 	// Specify uniform values for shaders.
-	VkPipelineLayout pipelineLayout;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
 
 	// Command pools manage the memory that is used to store the buffers and command buffers are allocated from them.
-	VkCommandPool commandPool;
+	// One transient pool per frame slot, reset and re-recorded every frame.
+	FrameCommandPools frameCommandPools;
+
+	// Device local vertex buffers of the mesh, one per binding of the vertex stream layout.
+	std::vector<VkBuffer> vertexBuffers;
+	std::vector<GpuAllocation> vertexBufferAllocations;
+
+	// Indices of the mesh, 16 or 32 bit as given by options.indexType.
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	GpuAllocation indexBufferAllocation;
+	uint32_t indexCount = 0;
+
+	// Compute pass animating the first vertex stream, with --compute. One output buffer and descriptor set per frame slot.
+	ComputeQueue computeQueue;
+	ComputePipeline computePipeline;
+	ShaderModule computeShader;
+	std::vector<VkBuffer> animatedVertexBuffers;
+	std::vector<GpuAllocation> animatedVertexAllocations;
+	std::vector<VkDescriptorSet> animationDescriptorSets;
+	uint64_t animationFrame = 0;
+
+	// Worker threads for recording secondary command buffers.
+
+	JobSystem jobSystem;
 
-	// One of the drawing commands involves binding the right VkFramebuffer => we have to record a command buffer 
-	// for every image in the swapchain.
-	// Command buffers automatically freed when their command pool is destroyed.
-	std::vector<VkCommandBuffer> commandBuffers;
+	// CPU time spent recording frames since the last report.
 
-	// Image has been acquired and is ready for rendering.
-	std::vector<VkSemaphore> imageAvailableSemaphores;
+	std::chrono::steady_clock::duration recordTimeSum{};
+	uint64_t recordedFrameCount = 0;
 
-	// Signal that rendering has finished and presentation can happen.
-	std::vector<VkSemaphore> renderFinishedSemaphores;
 
-	// Fences for CPU-GPU synchronization.
-	std::vector<VkFence> inFlightFences;
+	// Semaphores of the frames in flight.
+	FramePacer framePacer;
 
-	// If MAX_FRAMES_IN_FLIGHT is higher than the number of swapchain images or vkAcquireNextImageKHR returns 
-	// images out-of-order, then it's possible that we may start rendering to a swapchain image that is already in flight. 
-	// To avoid this, we need to track for each swapchain image if a frame in flight is currently using it.
-	std::vector<VkFence> imagesInFlight;
+	// Named CPU and GPU scopes of every frame, for the report and --trace.
+	GpuProfiler gpuProfiler;
 
-	// Frame index in terms of MAX_FRAMES_IN_FLIGHT.
-	size_t currentFrame;
+	// CPU durations of the last frames, for percentiles and hitches.
+	FrameStatsRing frameStats;
+	std::chrono::steady_clock::time_point lastFrameStart{};
+
+	// Every frame sample of the measured part of --benchmark.
+	BenchmarkRecorder benchmarkRecorder;
+
+	// Input to present latency per present policy. Input is sampled at the start of every frame.
+	PresentLatencyTracker presentLatency;
+	std::chrono::steady_clock::time_point inputTime{};
+
+	// Set by KeyCallback, applied in MainLoop. Zero if there is no pending request.
+	uint32_t requestedFramesInFlight = 0;
+
+	// Set by FramebufferResizeCallback, the swapchain is recreated after the next present.
+	bool framebufferResized = false;
+
+	// Set by KeyCallback, applied in MainLoop.
+	bool colorModeChangeRequested = false;
+	bool presentPolicyChangeRequested = false;
+
+	ApplicationOptions options;
 };
 
-int main()
+int main(int argc, char** argv)
 {
-	TriangleApplication app;
-
 	try {
+		TriangleApplication app(ParseOptions(argc, argv));
 		app.Run();
+
 	}
 	catch (std::exception& e) {
 		std::cout << e.what() << std::endl;